@@ -0,0 +1,127 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Measure the cost of receiving notifications from an observable,
+ * depending on the number of notifications pulled by each call to
+ * evl_read_observable().
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <error.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <evl/evl.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/observable.h>
+#include <evl/observable-evl.h>
+
+#define MAX_BATCH	64
+
+static long loops = 10000;
+
+static int batch_sizes[] = { 1, 4, 16, 32, 64 };
+
+static inline long long diff_ns(const struct timespec *t1,
+				const struct timespec *t0)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		(t1->tv_nsec - t0->tv_nsec);
+}
+
+/*
+ * Post MAX_BATCH notices at once, then read them back @batch at a
+ * time. Only the reads are timed.
+ */
+static void run(int ofd, int batch)
+{
+	struct evl_notification nf[MAX_BATCH];
+	struct evl_notice ntc[MAX_BATCH];
+	struct timespec t0, t1;
+	long long total = 0;
+	int ret, got, n;
+	long loop;
+
+	for (n = 0; n < MAX_BATCH; n++) {
+		ntc[n].tag = EVL_NOTICE_USER;
+		ntc[n].event.val = n;
+	}
+
+	for (loop = 0; loop < loops; loop++) {
+		ret = evl_update_observable(ofd, ntc, MAX_BATCH);
+		if (ret != MAX_BATCH)
+			error(1, ret < 0 ? -ret : EAGAIN,
+				"evl_update_observable()");
+
+		evl_read_clock(EVL_CLOCK_MONOTONIC, &t0);
+
+		for (got = 0; got < MAX_BATCH; got += ret) {
+			ret = evl_read_observable(ofd, nf, batch);
+			if (ret <= 0)
+				error(1, -ret, "evl_read_observable()");
+		}
+
+		evl_read_clock(EVL_CLOCK_MONOTONIC, &t1);
+		total += diff_ns(&t1, &t0);
+	}
+
+	printf("batch %-4d %8.1f ns/notification\n", batch,
+		(double)total / (loops * MAX_BATCH));
+}
+
+static void usage(const char *progname)
+{
+	fprintf(stderr, "usage: %s [-n <loops>]\n", progname);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sched_param param;
+	int tfd, ofd, ret, c;
+	unsigned int n;
+
+	while ((c = getopt(argc, argv, "n:h")) != EOF) {
+		switch (c) {
+		case 'n':
+			loops = atol(optarg);
+			if (loops <= 0)
+				error(1, EINVAL, "invalid loop count");
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	param.sched_priority = 1;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+		error(1, errno, "pthread_setschedparam()");
+
+	tfd = evl_attach_self("observable-read:%d", getpid());
+	if (tfd < 0)
+		error(1, -tfd, "evl_attach_self()");
+
+	ofd = evl_new_observable("observable-read:%d", getpid());
+	if (ofd < 0)
+		error(1, -ofd, "evl_new_observable()");
+
+	ret = evl_subscribe(ofd, MAX_BATCH, 0);
+	if (ret)
+		error(1, -ret, "evl_subscribe()");
+
+	for (n = 0; n < sizeof(batch_sizes) / sizeof(batch_sizes[0]); n++)
+		run(ofd, batch_sizes[n]);
+
+	return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Measure the cost of an out-of-band syscall with and without
+ * switching the cancellation type around it.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <error.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <evl/evl.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/syscall.h>
+#include <evl/syscall-evl.h>
+
+static long loops = 1000000;
+
+static inline long long diff_ns(const struct timespec *t1,
+				const struct timespec *t0)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		(t1->tv_nsec - t0->tv_nsec);
+}
+
+static void run(const char *label, int tfd,
+		int (*call)(int efd, unsigned long request, ...))
+{
+	struct evl_thread_state statebuf;
+	struct timespec t0, t1;
+	long n;
+
+	evl_read_clock(EVL_CLOCK_MONOTONIC, &t0);
+
+	for (n = 0; n < loops; n++) {
+		if (call(tfd, EVL_THRIOC_GET_STATE, &statebuf))
+			error(1, errno, "%s failed", label);
+	}
+
+	evl_read_clock(EVL_CLOCK_MONOTONIC, &t1);
+
+	printf("%-24s %8.1f ns/call\n", label,
+		(double)diff_ns(&t1, &t0) / loops);
+}
+
+static void usage(const char *progname)
+{
+	fprintf(stderr, "usage: %s [-n <loops>]\n", progname);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sched_param param;
+	int tfd, c;
+
+	while ((c = getopt(argc, argv, "n:h")) != EOF) {
+		switch (c) {
+		case 'n':
+			loops = atol(optarg);
+			if (loops <= 0)
+				error(1, EINVAL, "invalid loop count");
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	param.sched_priority = 1;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+		error(1, errno, "pthread_setschedparam()");
+
+	tfd = evl_attach_self("oob-syscall:%d", getpid());
+	if (tfd < 0)
+		error(1, -tfd, "evl_attach_self()");
+
+	run("oob_ioctl", tfd, oob_ioctl);
+	run("oob_ioctl_nocancel", tfd, oob_ioctl_nocancel);
+	evl_set_oob_cancel(EVL_OOB_CANCEL_NONE);
+	run("oob_ioctl (no cancel)", tfd, oob_ioctl);
+
+	return 0;
+}
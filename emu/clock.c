@@ -0,0 +1,283 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <evl/clock.h>
+#include "internal.h"
+
+struct emu_timer {
+	clockid_t clock_id;
+	struct timespec date;		/* Next shot, zero if disarmed. */
+	struct timespec interval;
+};
+
+int emu_timeout(const struct __evl_timespec *kts, struct timespec *ts)
+{
+	if (kts == NULL || (kts->tv_sec == 0 && kts->tv_nsec == 0))
+		return 0;
+
+	ts->tv_sec = kts->tv_sec;
+	ts->tv_nsec = kts->tv_nsec;
+
+	return 1;
+}
+
+/* Must hold emu_lock. */
+clockid_t emu_clockid(int clockfd)
+{
+	struct emu_element *e;
+
+	switch (clockfd) {
+	case EVL_CLOCK_MONOTONIC:
+		return CLOCK_MONOTONIC;
+	case EVL_CLOCK_REALTIME:
+		return CLOCK_REALTIME;
+	}
+
+	e = emu_lookup_fd(clockfd);
+	if (e && e->class == &emu_clock_class)
+		return (clockid_t)(long)e->priv;
+
+	return CLOCK_MONOTONIC;
+}
+
+static int clock_create(struct emu_element *e, void *attrs)
+{
+	if (!strcmp(e->name, EVL_CLOCK_MONOTONIC_DEV))
+		e->priv = (void *)(long)CLOCK_MONOTONIC;
+	else if (!strcmp(e->name, EVL_CLOCK_REALTIME_DEV))
+		e->priv = (void *)(long)CLOCK_REALTIME;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int clock_ioctl(struct emu_element *e,
+		unsigned long request, void *arg)
+{
+	clockid_t clock_id = (clockid_t)(long)e->priv;
+	struct __evl_timespec *kts = arg;
+	struct timespec ts;
+	int ret;
+
+	switch (request) {
+	case EVL_CLKIOC_GET_TIME:
+		ret = clock_gettime(clock_id, arg);
+		break;
+	case EVL_CLKIOC_GET_RES:
+		ret = clock_getres(clock_id, arg);
+		break;
+	case EVL_CLKIOC_SET_TIME:
+		ts.tv_sec = kts->tv_sec;
+		ts.tv_nsec = kts->tv_nsec;
+		ret = clock_settime(clock_id, &ts);
+		break;
+	case EVL_CLKIOC_SLEEP:
+		ts.tv_sec = kts->tv_sec;
+		ts.tv_nsec = kts->tv_nsec;
+		return -clock_nanosleep(clock_id, TIMER_ABSTIME, &ts, NULL);
+	case EVL_CLKIOC_NEW_TIMER:
+		ret = emu_new_element_fd(&emu_timer_class,
+					(void *)(long)clock_id, O_CLOEXEC);
+		if (ret < 0)
+			return ret;
+		*(int *)arg = ret;
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+
+	return ret ? -errno : 0;
+}
+
+const struct emu_class emu_clock_class = {
+	.name = EVL_CLOCK_DEV,
+	.type = EMU_CLOCK,
+	.create = clock_create,
+	.ioctl = clock_ioctl,
+};
+
+static inline long long ts_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static inline void ns_to_ts(long long ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / 1000000000LL;
+	ts->tv_nsec = ns % 1000000000LL;
+}
+
+static inline bool timer_armed(struct emu_timer *tm)
+{
+	return tm->date.tv_sec || tm->date.tv_nsec;
+}
+
+/*
+ * Collect the expired shots, advancing the timer to the next one.
+ * Must hold emu_lock.
+ */
+static __u64 timer_ticks(struct emu_timer *tm)
+{
+	long long now, date, period;
+	struct timespec ts;
+	__u64 ticks;
+
+	if (!timer_armed(tm))
+		return 0;
+
+	clock_gettime(tm->clock_id, &ts);
+	now = ts_to_ns(&ts);
+	date = ts_to_ns(&tm->date);
+	if (now < date)
+		return 0;
+
+	period = ts_to_ns(&tm->interval);
+	if (period == 0) {
+		memset(&tm->date, 0, sizeof(tm->date));
+		return 1;
+	}
+
+	ticks = (now - date) / period + 1;
+	ns_to_ts(date + ticks * period, &tm->date);
+
+	return ticks;
+}
+
+static int tfd_create(struct emu_element *e, void *attrs)
+{
+	struct emu_timer *tm;
+
+	tm = calloc(1, sizeof(*tm));
+	if (tm == NULL)
+		return -ENOMEM;
+
+	tm->clock_id = (clockid_t)(long)attrs;
+	e->priv = tm;
+
+	return 0;
+}
+
+static void tfd_destroy(struct emu_element *e)
+{
+	free(e->priv);
+}
+
+static void get_timer(struct emu_timer *tm, struct __evl_itimerspec *kits)
+{
+	kits->it_value.tv_sec = tm->date.tv_sec;
+	kits->it_value.tv_nsec = tm->date.tv_nsec;
+	kits->it_interval.tv_sec = tm->interval.tv_sec;
+	kits->it_interval.tv_nsec = tm->interval.tv_nsec;
+}
+
+static int tfd_ioctl(struct emu_element *e,
+		unsigned long request, void *arg)
+{
+	struct emu_timer *tm = e->priv;
+	struct evl_timerfd_setreq *sreq;
+	struct __evl_itimerspec *kits;
+
+	switch (request) {
+	case EVL_TFDIOC_SET:
+		sreq = arg;
+		kits = (struct __evl_itimerspec *)(long)sreq->value_ptr;
+		if (kits == NULL)
+			return -EINVAL;
+		pthread_mutex_lock(&emu_lock);
+		if (sreq->ovalue_ptr)
+			get_timer(tm, (void *)(long)sreq->ovalue_ptr);
+		/* The first shot is an absolute date. */
+		tm->date.tv_sec = kits->it_value.tv_sec;
+		tm->date.tv_nsec = kits->it_value.tv_nsec;
+		tm->interval.tv_sec = kits->it_interval.tv_sec;
+		tm->interval.tv_nsec = kits->it_interval.tv_nsec;
+		emu_notify();
+		pthread_mutex_unlock(&emu_lock);
+		return 0;
+	case EVL_TFDIOC_GET:
+		pthread_mutex_lock(&emu_lock);
+		get_timer(tm, arg);
+		pthread_mutex_unlock(&emu_lock);
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
+static ssize_t tfd_read(struct emu_element *e, void *buf,
+			size_t count, int flags)
+{
+	struct emu_timer *tm = e->priv;
+	struct timespec mono;
+	__u64 ticks;
+
+	if (count < sizeof(ticks))
+		return -EINVAL;
+
+	pthread_mutex_lock(&emu_lock);
+
+	for (;;) {
+		ticks = timer_ticks(tm);
+		if (ticks)
+			break;
+		if (flags & EMU_IO_NONBLOCK) {
+			pthread_mutex_unlock(&emu_lock);
+			return -EAGAIN;
+		}
+		/* Sleep until the next shot, or until the timer is reset. */
+		if (timer_armed(tm)) {
+			emu_abs_timeout(tm->clock_id, &tm->date, &mono);
+			emu_wait_event(&mono);
+		} else {
+			emu_wait_event(NULL);
+		}
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	memcpy(buf, &ticks, sizeof(ticks));
+
+	return sizeof(ticks);
+}
+
+static int tfd_poll(struct emu_element *e)
+{
+	struct emu_timer *tm = e->priv;
+	struct timespec ts;
+
+	if (!timer_armed(tm))
+		return 0;
+
+	clock_gettime(tm->clock_id, &ts);
+
+	return ts_to_ns(&ts) >= ts_to_ns(&tm->date) ? POLLIN|POLLRDNORM : 0;
+}
+
+/* Returns the next shot of a timer on the monotonic clock, if any. */
+int emu_timer_deadline(struct emu_element *e, struct timespec *mono)
+{
+	struct emu_timer *tm = e->priv;
+
+	if (!timer_armed(tm))
+		return 0;
+
+	return emu_abs_timeout(tm->clock_id, &tm->date, mono);
+}
+
+const struct emu_class emu_timer_class = {
+	.name = "timer",
+	.type = EMU_TIMER,
+	.create = tfd_create,
+	.destroy = tfd_destroy,
+	.ioctl = tfd_ioctl,
+	.read = tfd_read,
+	.poll = tfd_poll,
+};
@@ -0,0 +1,958 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * In-process stand-in for the EVL core, preloaded into applications
+ * linked against libevl. We interpose on the few libc calls libevl
+ * uses to talk to the core (open, ioctl, prctl, mmap and friends),
+ * serving requests which refer to /dev/evl from the emulated
+ * elements, passing everything else to libc.
+ */
+
+/*
+ * We define both the plain and the 64bit variants of the file calls,
+ * do not let glibc redirect the former to the latter.
+ */
+#undef _FILE_OFFSET_BITS
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <evl/evl.h>
+#include <evl/control.h>
+#include <evl/syscall.h>
+#include <asm-generic/dovetail.h>
+#include "internal.h"
+
+#define EVL_DEV_PREFIX		"/dev/evl/"
+#define EMU_SHM_SIZE		(2 * 1024 * 1024)
+#define EMU_STATE_SLOT		128
+#define EMU_STATE_SLOTS		(EMU_SHM_SIZE / EMU_STATE_SLOT)
+#define EMU_DEV_MAJOR		240	/* Local/experimental range. */
+
+pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Broadcast on any change of state of I/O elements. */
+static pthread_cond_t emu_event;
+
+void *emu_shared_memory;
+
+size_t emu_shm_size = EMU_SHM_SIZE;
+
+static unsigned long state_map[EMU_STATE_SLOTS / (8 * sizeof(long))];
+
+static DEFINE_LIST_HEAD(registry);
+
+static struct emu_element **fd_table;
+
+static int fd_table_size;
+
+static fundle_t next_fundle = 1;
+
+static unsigned long next_serial;
+
+static int (*real_open)(const char *path, int flags, ...);
+static int (*real_close)(int fd);
+static int (*real_ioctl)(int fd, unsigned long request, ...);
+static int (*real_prctl)(int option, ...);
+static void *(*real_mmap)(void *addr, size_t length, int prot,
+			int flags, int fd, off_t offset);
+static int (*real_munmap)(void *addr, size_t length);
+static ssize_t (*real_read)(int fd, void *buf, size_t count);
+static ssize_t (*real_write)(int fd, const void *buf, size_t count);
+static int (*real_fcntl)(int fd, int cmd, ...);
+static int (*real_dup)(int oldfd);
+static int (*real_dup2)(int oldfd, int newfd);
+static int (*real_dup3)(int oldfd, int newfd, int flags);
+static int (*real_fstat)(int fd, struct stat *st);
+
+static const struct emu_class control_class = {
+	.name = "control",
+	.type = EMU_CONTROL,
+};
+
+static const struct emu_class factory_class = {
+	.name = "clone",
+	.type = EMU_FACTORY,
+};
+
+static const struct emu_class *classes[] = {
+	&emu_thread_class,
+	&emu_monitor_class,
+	&emu_clock_class,
+	&emu_proxy_class,
+	&emu_xbuf_class,
+	&emu_observable_class,
+	&emu_poll_class,
+};
+
+const struct emu_class *emu_find_class(const char *name)
+{
+	unsigned int n;
+
+	for (n = 0; n < sizeof(classes) / sizeof(classes[0]); n++)
+		if (!strcmp(classes[n]->name, name))
+			return classes[n];
+
+	return NULL;
+}
+
+int emu_alloc_state(size_t size, __u32 *r_offset)
+{
+	unsigned int n, bits = 8 * sizeof(long);
+
+	if (size > EMU_STATE_SLOT)
+		return -EINVAL;
+
+	/* Slot #0 is never handed out. */
+	for (n = 1; n < EMU_STATE_SLOTS; n++) {
+		if (state_map[n / bits] & (1UL << (n % bits)))
+			continue;
+		state_map[n / bits] |= 1UL << (n % bits);
+		*r_offset = n * EMU_STATE_SLOT;
+		memset(emu_shared_memory + *r_offset, 0, EMU_STATE_SLOT);
+		return 0;
+	}
+
+	return -ENOMEM;
+}
+
+void emu_free_state(__u32 offset)
+{
+	unsigned int n = offset / EMU_STATE_SLOT, bits = 8 * sizeof(long);
+
+	state_map[n / bits] &= ~(1UL << (n % bits));
+}
+
+fundle_t emu_alloc_fundle(void)
+{
+	return evl_get_index(next_fundle++);
+}
+
+/*
+ * Convert an absolute timeout on @clock_id to the monotonic clock
+ * we sleep on. Returns zero if @deadline is NULL (i.e. infinite),
+ * non-zero otherwise.
+ */
+int emu_abs_timeout(clockid_t clock_id, const struct timespec *deadline,
+		struct timespec *mono)
+{
+	struct timespec now;
+	long long delta;
+
+	if (deadline == NULL)
+		return 0;
+
+	if (clock_id == CLOCK_MONOTONIC) {
+		*mono = *deadline;
+		return 1;
+	}
+
+	clock_gettime(clock_id, &now);
+	delta = (deadline->tv_sec - now.tv_sec) * 1000000000LL +
+		deadline->tv_nsec - now.tv_nsec;
+	if (delta < 0)
+		delta = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	delta += now.tv_nsec;
+	mono->tv_sec = now.tv_sec + delta / 1000000000LL;
+	mono->tv_nsec = delta % 1000000000LL;
+
+	return 1;
+}
+
+/*
+ * Wait for some I/O element to change state, until @deadline on the
+ * monotonic clock if non-NULL. Must hold emu_lock.
+ */
+int emu_wait_event(const struct timespec *deadline)
+{
+	int ret;
+
+	if (deadline == NULL) {
+		pthread_cond_wait(&emu_event, &emu_lock);
+		return 0;
+	}
+
+	ret = pthread_cond_timedwait(&emu_event, &emu_lock, deadline);
+
+	return ret == ETIMEDOUT ? -ETIMEDOUT : 0;
+}
+
+/* Must hold emu_lock. */
+void emu_notify(void)
+{
+	pthread_cond_broadcast(&emu_event);
+}
+
+static int install_fd(int fd, struct emu_element *e)
+{
+	struct emu_element **table;
+	int size;
+
+	if (fd >= fd_table_size) {
+		size = fd_table_size ? fd_table_size : 64;
+		while (size <= fd)
+			size *= 2;
+		table = realloc(fd_table, size * sizeof(*table));
+		if (table == NULL)
+			return -ENOMEM;
+		memset(table + fd_table_size, 0,
+			(size - fd_table_size) * sizeof(*table));
+		fd_table = table;
+		fd_table_size = size;
+	}
+
+	fd_table[fd] = e;
+	e->refs++;
+	e->fds++;
+
+	return 0;
+}
+
+static void destroy_element(struct emu_element *e)
+{
+	if (e->class->destroy)
+		e->class->destroy(e);
+
+	if (e->state)
+		emu_free_state(e->state_offset);
+
+	if (e->name)
+		list_remove(&e->next);
+
+	free(e->name);
+	free(e);
+}
+
+/* Must hold emu_lock. */
+static void drop_fd(int fd)
+{
+	struct emu_element *e;
+
+	if (fd < 0 || fd >= fd_table_size || fd_table[fd] == NULL)
+		return;
+
+	e = fd_table[fd];
+	fd_table[fd] = NULL;
+
+	/*
+	 * Closing the last descriptor kicks the threads still waiting
+	 * on the element, which keep it alive until they leave.
+	 */
+	if (--e->fds == 0) {
+		e->closed = true;
+		if (e->class->release)
+			e->class->release(e);
+		emu_notify();
+	}
+
+	if (--e->refs == 0)
+		destroy_element(e);
+}
+
+/* Must hold emu_lock. */
+struct emu_element *emu_lookup_fd(int fd)
+{
+	if (fd < 0 || fd >= fd_table_size)
+		return NULL;
+
+	return fd_table[fd];
+}
+
+struct emu_element *emu_get_element(int fd)
+{
+	struct emu_element *e;
+
+	pthread_mutex_lock(&emu_lock);
+
+	e = emu_lookup_fd(fd);
+	if (e)
+		e->refs++;
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return e;
+}
+
+/* Must hold emu_lock. */
+void __emu_put_element(struct emu_element *e)
+{
+	if (--e->refs == 0)
+		destroy_element(e);
+}
+
+void emu_put_element(struct emu_element *e)
+{
+	pthread_mutex_lock(&emu_lock);
+	__emu_put_element(e);
+	pthread_mutex_unlock(&emu_lock);
+}
+
+/* Get a real descriptor standing for an element. */
+static int new_fd(struct emu_element *e, int oflags)
+{
+	int fd, ret;
+
+	fd = eventfd(0, (oflags & O_CLOEXEC ? EFD_CLOEXEC : 0) |
+		(oflags & O_NONBLOCK ? EFD_NONBLOCK : 0));
+	if (fd < 0)
+		return -errno;
+
+	ret = install_fd(fd, e);
+	if (ret) {
+		real_close(fd);
+		return ret;
+	}
+
+	return fd;
+}
+
+static struct emu_element *new_element(const struct emu_class *class)
+{
+	struct emu_element *e;
+
+	e = calloc(1, sizeof(*e));
+	if (e == NULL)
+		return NULL;
+
+	e->class = class;
+	e->serial = ++next_serial;
+	inith(&e->next);
+
+	return e;
+}
+
+static struct emu_element *lookup_element(const struct emu_class *class,
+					const char *name)
+{
+	struct emu_element *e;
+
+	list_for_each_entry(e, &registry, next) {
+		if (e->class == class && !strcmp(e->name, name))
+			return e;
+	}
+
+	return NULL;
+}
+
+/* Must hold emu_lock. */
+static int create_element(const struct emu_class *class,
+			const char *name, void *attrs, int clone_flags,
+			struct emu_element **r_e)
+{
+	struct emu_element *e;
+	int ret;
+
+	if (name && lookup_element(class, name))
+		return -EEXIST;
+
+	e = new_element(class);
+	if (e == NULL)
+		return -ENOMEM;
+
+	if (name) {
+		e->name = strdup(name);
+		if (e->name == NULL) {
+			free(e);
+			return -ENOMEM;
+		}
+	}
+
+	e->clone_flags = clone_flags;
+	ret = class->create(e, attrs);
+	if (ret) {
+		free(e->name);
+		free(e);
+		return ret;
+	}
+
+	if (name)
+		list_append(&e->next, &registry);
+
+	*r_e = e;
+
+	return 0;
+}
+
+static int open_device(const char *path, int oflags)
+{
+	const struct emu_class *class;
+	struct emu_element *e;
+	char type[64];
+	const char *name;
+	size_t len;
+	int ret;
+
+	path += strlen(EVL_DEV_PREFIX);
+
+	if (!strcmp(path, "control")) {
+		e = new_element(&control_class);
+		if (e == NULL)
+			return -ENOMEM;
+		ret = new_fd(e, oflags);
+		if (ret < 0)
+			free(e);
+		return ret;
+	}
+
+	name = strchr(path, '/');
+	len = name ? (size_t)(name - path) : strlen(path);
+	if (len >= sizeof(type))
+		return -ENAMETOOLONG;
+
+	memcpy(type, path, len);
+	type[len] = '\0';
+	class = emu_find_class(type);
+	if (class == NULL)
+		return -EOPNOTSUPP;
+
+	if (name == NULL) {	/* evl_open_raw() */
+		if (!class->raw)
+			return -EOPNOTSUPP;
+		ret = create_element(class, NULL, NULL, 0, &e);
+		if (ret)
+			return ret;
+		ret = new_fd(e, oflags);
+		if (ret < 0)
+			destroy_element(e);
+		return ret;
+	}
+
+	name++;
+	if (!strcmp(name, "clone")) {
+		e = new_element(&factory_class);
+		if (e == NULL)
+			return -ENOMEM;
+		e->priv = (void *)class;
+		ret = new_fd(e, oflags);
+		if (ret < 0)
+			free(e);
+		return ret;
+	}
+
+	e = lookup_element(class, name);
+	if (e == NULL) {
+		/* The clocks are always there. */
+		if (class != &emu_clock_class)
+			return -ENOENT;
+		ret = create_element(class, name, NULL, EVL_CLONE_PUBLIC, &e);
+		if (ret)
+			return ret;
+		e->public = true;
+	} else if (!e->public) {
+		return -ENOENT;
+	}
+
+	return new_fd(e, oflags);
+}
+
+/* Create an anonymous element, returning a descriptor to it. */
+int emu_new_element_fd(const struct emu_class *class, void *attrs, int oflags)
+{
+	struct emu_element *e;
+	int ret;
+
+	pthread_mutex_lock(&emu_lock);
+
+	ret = create_element(class, NULL, attrs, 0, &e);
+	if (ret == 0) {
+		ret = new_fd(e, oflags);
+		if (ret < 0)
+			destroy_element(e);
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return ret;
+}
+
+static int clone_element(struct emu_element *factory,
+			struct evl_clone_req *req)
+{
+	const struct emu_class *class = factory->priv;
+	const char *name = (const char *)(long)req->name_ptr;
+	struct emu_element *e;
+	int ret, efd = -1;
+
+	/* Names are unique per class, private elements included. */
+	ret = create_element(class, name, (void *)(long)req->attrs_ptr,
+			req->clone_flags, &e);
+	if (ret)
+		return ret;
+
+	e->public = !!(req->clone_flags & EVL_CLONE_PUBLIC);
+
+	/*
+	 * Like the core, we return a descriptor for private elements
+	 * only. libevl opens the device of public ones next, until
+	 * then they live with no reference.
+	 */
+	if (!(req->clone_flags & EVL_CLONE_PUBLIC)) {
+		efd = new_fd(e, O_CLOEXEC);
+		if (efd < 0) {
+			destroy_element(e);
+			return efd;
+		}
+	}
+
+	req->eids.minor = 0;
+	req->eids.fundle = e->fundle;
+	req->eids.state_offset = e->state_offset;
+	req->efd = efd;
+
+	return 0;
+}
+
+static int control_ioctl(unsigned long request, void *arg)
+{
+	struct evl_core_info *info;
+	struct evl_cpu_state *cpst;
+
+	switch (request) {
+	case EVL_CTLIOC_GET_COREINFO:
+		info = arg;
+		info->abi_base = EVL_ABI_PREREQ;
+		info->abi_current = EVL_ABI_PREREQ;
+		info->fpu_features = 0;
+		info->shm_size = emu_shm_size;
+		return 0;
+	case EVL_CTLIOC_GET_CPUSTATE:
+		cpst = arg;
+		*(__u32 *)(long)cpst->state_ptr = EVL_CPU_OOB;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int do_ioctl(int fd, unsigned long request, void *arg, bool *handled)
+{
+	struct emu_element *e;
+	int ret;
+
+	e = emu_get_element(fd);
+	if (e == NULL) {
+		*handled = false;
+		return 0;
+	}
+
+	*handled = true;
+
+	/* Like the kernel, only consider the 32bit command. */
+	request = (unsigned int)request;
+
+	switch (e->class->type) {
+	case EMU_CONTROL:
+		ret = control_ioctl(request, arg);
+		break;
+	case EMU_FACTORY:
+		if (request != EVL_IOC_CLONE) {
+			ret = -ENOTTY;
+			break;
+		}
+		pthread_mutex_lock(&emu_lock);
+		ret = clone_element(e, arg);
+		pthread_mutex_unlock(&emu_lock);
+		break;
+	default:
+		ret = e->class->ioctl ?
+			e->class->ioctl(e, request, arg) : -ENOTTY;
+	}
+
+	emu_put_element(e);
+
+	return ret;
+}
+
+static int io_flags(int fd, bool oob)
+{
+	int flags = oob ? EMU_IO_OOB : 0;
+
+	if (real_fcntl(fd, F_GETFL) & O_NONBLOCK)
+		flags |= EMU_IO_NONBLOCK;
+
+	return flags;
+}
+
+static ssize_t do_read(int fd, void *buf, size_t count,
+		bool oob, bool *handled)
+{
+	struct emu_element *e;
+	ssize_t ret;
+
+	e = emu_get_element(fd);
+	if (e == NULL) {
+		*handled = false;
+		return 0;
+	}
+
+	*handled = true;
+	ret = e->class->read ?
+		e->class->read(e, buf, count, io_flags(fd, oob)) : -EINVAL;
+	emu_put_element(e);
+
+	return ret;
+}
+
+static ssize_t do_write(int fd, const void *buf, size_t count,
+			bool oob, bool *handled)
+{
+	struct emu_element *e;
+	ssize_t ret;
+
+	e = emu_get_element(fd);
+	if (e == NULL) {
+		*handled = false;
+		return 0;
+	}
+
+	*handled = true;
+	ret = e->class->write ?
+		e->class->write(e, buf, count, io_flags(fd, oob)) : -EINVAL;
+	emu_put_element(e);
+
+	return ret;
+}
+
+static inline long set_errno(long ret)
+{
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+static void copy_fd(int oldfd, int newfd)
+{
+	if (newfd < 0)
+		return;
+
+	pthread_mutex_lock(&emu_lock);
+
+	if (oldfd >= 0 && oldfd < fd_table_size && fd_table[oldfd])
+		install_fd(newfd, fd_table[oldfd]);
+
+	pthread_mutex_unlock(&emu_lock);
+}
+
+static void forget_fd(int fd)
+{
+	pthread_mutex_lock(&emu_lock);
+	drop_fd(fd);
+	pthread_mutex_unlock(&emu_lock);
+}
+
+/* Interposed libc calls. */
+
+/* Fortified open() calls, glibc declares them only if enabled. */
+int __open_2(const char *path, int flags);
+int __open64_2(const char *path, int flags);
+
+int open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+	int ret;
+
+	if (strncmp(path, EVL_DEV_PREFIX, strlen(EVL_DEV_PREFIX))) {
+		if (flags & (O_CREAT|O_TMPFILE)) {
+			va_start(ap, flags);
+			mode = va_arg(ap, mode_t);
+			va_end(ap);
+		}
+		return real_open(path, flags, mode);
+	}
+
+	pthread_mutex_lock(&emu_lock);
+	ret = open_device(path, flags);
+	pthread_mutex_unlock(&emu_lock);
+
+	return set_errno(ret);
+}
+
+int open64(const char *path, int flags, ...)
+	__attribute__((alias("open")));
+
+int __open_2(const char *path, int flags)
+{
+	return open(path, flags);
+}
+
+int __open64_2(const char *path, int flags)
+	__attribute__((alias("__open_2")));
+
+int close(int fd)
+{
+	int ret;
+
+	/*
+	 * Release the descriptor for real before the waiters learn
+	 * about the closure, so that their next request fails with
+	 * EBADF. Holding the lock prevents the number from being
+	 * reused in the meantime.
+	 */
+	pthread_mutex_lock(&emu_lock);
+	ret = real_close(fd);
+	drop_fd(fd);
+	pthread_mutex_unlock(&emu_lock);
+
+	return ret;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	bool handled;
+	va_list ap;
+	void *arg;
+	int ret;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	ret = do_ioctl(fd, request, arg, &handled);
+	if (!handled)
+		return real_ioctl(fd, request, arg);
+
+	return set_errno(ret);
+}
+
+int prctl(int option, ...)
+{
+	unsigned long a0, a1, a2, a3;
+	bool handled;
+	va_list ap;
+	long ret;
+
+	va_start(ap, option);
+	a0 = va_arg(ap, unsigned long);
+	a1 = va_arg(ap, unsigned long);
+	a2 = va_arg(ap, unsigned long);
+	a3 = va_arg(ap, unsigned long);
+	va_end(ap);
+
+	if (!(option & __OOB_SYSCALL_BIT))
+		return real_prctl(option, a0, a1, a2, a3);
+
+	switch (option & ~__OOB_SYSCALL_BIT) {
+	case sys_evl_ioctl:
+		ret = do_ioctl(a0, a1, (void *)a2, &handled);
+		break;
+	case sys_evl_read:
+		ret = do_read(a0, (void *)a1, a2, true, &handled);
+		break;
+	case sys_evl_write:
+		ret = do_write(a0, (const void *)a1, a2, true, &handled);
+		break;
+	default:
+		return set_errno(-ENOSYS);
+	}
+
+	if (!handled)
+		ret = -EBADF;
+
+	return set_errno(ret);
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags,
+	int fd, off_t offset)
+{
+	struct emu_element *e;
+
+	e = emu_get_element(fd);
+	if (e == NULL)
+		return real_mmap(addr, length, prot, flags, fd, offset);
+
+	emu_put_element(e);
+
+	if (e->class->type != EMU_CONTROL || length > emu_shm_size) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	return emu_shared_memory;
+}
+
+void *mmap64(void *addr, size_t length, int prot, int flags,
+	int fd, off_t offset)
+	__attribute__((alias("mmap")));
+
+int munmap(void *addr, size_t length)
+{
+	if (addr == emu_shared_memory)
+		return 0;
+
+	return real_munmap(addr, length);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+	bool handled;
+	ssize_t ret;
+
+	ret = do_read(fd, buf, count, false, &handled);
+	if (!handled)
+		return real_read(fd, buf, count);
+
+	return set_errno(ret);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	bool handled;
+	ssize_t ret;
+
+	ret = do_write(fd, buf, count, false, &handled);
+	if (!handled)
+		return real_write(fd, buf, count);
+
+	return set_errno(ret);
+}
+
+int fcntl(int fd, int cmd, ...)
+{
+	va_list ap;
+	long arg;
+	int ret;
+
+	va_start(ap, cmd);
+	arg = va_arg(ap, long);
+	va_end(ap);
+
+	ret = real_fcntl(fd, cmd, arg);
+	if (cmd == F_DUPFD || cmd == F_DUPFD_CLOEXEC)
+		copy_fd(fd, ret);
+
+	return ret;
+}
+
+int fcntl64(int fd, int cmd, ...)
+	__attribute__((alias("fcntl")));
+
+int dup(int oldfd)
+{
+	int ret = real_dup(oldfd);
+
+	copy_fd(oldfd, ret);
+
+	return ret;
+}
+
+int dup2(int oldfd, int newfd)
+{
+	int ret;
+
+	if (oldfd != newfd)
+		forget_fd(newfd);
+
+	ret = real_dup2(oldfd, newfd);
+	if (oldfd != newfd)
+		copy_fd(oldfd, ret);
+
+	return ret;
+}
+
+int dup3(int oldfd, int newfd, int flags)
+{
+	int ret;
+
+	forget_fd(newfd);
+	ret = real_dup3(oldfd, newfd, flags);
+	copy_fd(oldfd, ret);
+
+	return ret;
+}
+
+/*
+ * All eventfds share the same anonymous inode, give each element
+ * its own identity like device files have with the real core.
+ */
+int fstat(int fd, struct stat *st)
+{
+	struct emu_element *e;
+	int ret;
+
+	ret = real_fstat(fd, st);
+	if (ret)
+		return ret;
+
+	pthread_mutex_lock(&emu_lock);
+
+	e = emu_lookup_fd(fd);
+	if (e) {
+		st->st_rdev = makedev(EMU_DEV_MAJOR, e->class->type);
+		st->st_ino = e->serial;
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return 0;
+}
+
+static void atfork_prepare(void)
+{
+	pthread_mutex_lock(&emu_lock);
+}
+
+static void atfork_parent(void)
+{
+	pthread_mutex_unlock(&emu_lock);
+}
+
+/* The child of fork() is not attached to the core. */
+static void atfork_child(void)
+{
+	pthread_mutex_unlock(&emu_lock);
+	emu_current = NULL;
+}
+
+#define resolve(__sym)	\
+	(real_ ## __sym = dlsym(RTLD_NEXT, #__sym))
+
+static __attribute__((constructor)) void emu_init(void)
+{
+	pthread_condattr_t cattr;
+
+	resolve(open);
+	resolve(close);
+	resolve(ioctl);
+	resolve(prctl);
+	resolve(mmap);
+	resolve(munmap);
+	resolve(read);
+	resolve(write);
+	resolve(fcntl);
+	resolve(dup);
+	resolve(dup2);
+	resolve(dup3);
+	resolve(fstat);
+
+	emu_shared_memory = real_mmap(NULL, EMU_SHM_SIZE,
+				PROT_READ|PROT_WRITE,
+				MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (emu_shared_memory == MAP_FAILED)
+		abort();
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&emu_event, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
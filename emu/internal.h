@@ -0,0 +1,148 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _EVL_EMU_INTERNAL_H
+#define _EVL_EMU_INTERNAL_H
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/types.h>
+#include <evl/list.h>
+#include <evl/types.h>
+#include <evl/factory.h>
+#include <evl/sched.h>
+#include <evl/thread.h>
+
+/*
+ * The stand-in runs the core side of every request in the context of
+ * the calling thread, like the real core does. A single lock
+ * serializes the emulated core state, except the fast lock word of
+ * gates which the waiters sleep on using futexes.
+ */
+extern pthread_mutex_t emu_lock;
+
+enum emu_type {
+	EMU_CONTROL,
+	EMU_FACTORY,
+	EMU_THREAD,
+	EMU_MONITOR,
+	EMU_CLOCK,
+	EMU_TIMER,
+	EMU_PROXY,
+	EMU_XBUF,
+	EMU_OBSERVABLE,
+	EMU_POLL,
+};
+
+/* I/O request flags. */
+#define EMU_IO_OOB	(1 << 0)	/* Via the oob syscalls. */
+#define EMU_IO_NONBLOCK	(1 << 1)	/* O_NONBLOCK is set. */
+
+struct emu_element;
+
+struct emu_class {
+	const char *name;
+	enum emu_type type;
+	bool raw;		/* evl_open_raw() creates an instance. */
+	/* Called under emu_lock, except ioctl, read and write. */
+	int (*create)(struct emu_element *e, void *attrs);
+	void (*release)(struct emu_element *e);
+	void (*destroy)(struct emu_element *e);
+	int (*ioctl)(struct emu_element *e, unsigned long request, void *arg);
+	ssize_t (*read)(struct emu_element *e, void *buf,
+			size_t count, int flags);
+	ssize_t (*write)(struct emu_element *e, const void *buf,
+			size_t count, int flags);
+	/* Return the POLL* readiness bits. */
+	int (*poll)(struct emu_element *e);
+	/* A poll set starts or stops watching the element. */
+	void (*watch)(struct emu_element *e, bool on);
+};
+
+struct emu_element {
+	const struct emu_class *class;
+	char *name;		/* NULL if anonymous. */
+	bool public;		/* Has a device file. */
+	bool closed;		/* No descriptor left. */
+	int clone_flags;
+	int refs;		/* Open descriptors and pending requests. */
+	int fds;		/* Open descriptors. */
+	fundle_t fundle;
+	unsigned long serial;	/* Stands for the inode number. */
+	__u32 state_offset;
+	void *state;		/* In the shared memory, or NULL. */
+	struct list_head next;	/* In the registry. */
+	void *priv;
+};
+
+extern void *emu_shared_memory;
+
+extern size_t emu_shm_size;
+
+/* Thread stand-in, see thread.c. */
+struct emu_thread {
+	struct emu_element *element;
+	struct evl_user_window *u_window;
+	__u32 mode;
+	struct evl_sched_attrs attrs;
+	pthread_cond_t cond;	/* Sleeping on emulated waits. */
+	void *signal_target;	/* Event targeted by evl_signal_thread(). */
+	void *wait_gate;	/* Gate the thread sleeps on. */
+	bool unblocked;
+	struct list_head next;	/* In the thread list. */
+};
+
+extern __thread struct emu_thread *emu_current;
+
+const struct emu_class *emu_find_class(const char *name);
+
+int emu_new_element_fd(const struct emu_class *class,
+		void *attrs, int oflags);
+
+struct emu_element *emu_lookup_fd(int fd);
+
+struct emu_element *emu_get_element(int fd);
+
+void __emu_put_element(struct emu_element *e);
+
+void emu_put_element(struct emu_element *e);
+
+int emu_alloc_state(size_t size, __u32 *r_offset);
+
+void emu_free_state(__u32 offset);
+
+fundle_t emu_alloc_fundle(void);
+
+int emu_wait_for(struct emu_thread *t, bool *cond,
+		clockid_t clock_id, const struct timespec *deadline);
+
+void emu_wake(struct emu_thread *t);
+
+int emu_timeout(const struct __evl_timespec *kts,
+		struct timespec *ts);
+
+clockid_t emu_clockid(int clockfd);
+
+int emu_signal_thread(struct emu_thread *t, int efd);
+
+int emu_timer_deadline(struct emu_element *e, struct timespec *mono);
+
+int emu_wait_event(const struct timespec *deadline);
+
+void emu_notify(void);
+
+int emu_abs_timeout(clockid_t clock_id, const struct timespec *deadline,
+		struct timespec *mono);
+
+struct emu_thread *emu_find_thread(fundle_t fundle);
+
+extern const struct emu_class emu_thread_class,
+	emu_monitor_class, emu_clock_class, emu_timer_class,
+	emu_proxy_class, emu_xbuf_class, emu_observable_class,
+	emu_poll_class;
+
+#endif /* !_EVL_EMU_INTERNAL_H */
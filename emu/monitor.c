@@ -0,0 +1,700 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <evl/monitor.h>
+#include "internal.h"
+
+/* Same as EVL_MUTEX_FLCLAIM: the gate may have sleepers. */
+#define GATE_CLAIM	0x80000000U
+
+struct emu_monitor {
+	struct emu_element *element;
+	int type;
+	int protocol;
+	clockid_t clock_id;
+	struct evl_monitor_state *state;
+	/* Gate: events bound to it. Event: sleepers. */
+	struct list_head waiters;
+	/* Event: the gate it is bound to. */
+	struct emu_monitor *gate;
+	struct list_head gate_next;
+	bool targeted;
+};
+
+struct emu_waiter {
+	struct list_head next;
+	struct emu_thread *thread;
+	bool done;
+	int status;
+	__s32 bits;
+	bool exact;
+};
+
+static inline __u32 *gate_word(struct emu_monitor *gate)
+{
+	return (__u32 *)&gate->state->u.gate.owner;
+}
+
+static inline __s32 *event_value(struct emu_monitor *evt)
+{
+	return (__s32 *)&evt->state->u.event.value;
+}
+
+static int monitor_create(struct emu_element *e, void *attrs)
+{
+	struct evl_monitor_attrs *mattrs = attrs;
+	struct emu_monitor *m;
+	int ret;
+
+	if (mattrs == NULL)
+		return -EINVAL;
+
+	m = calloc(1, sizeof(*m));
+	if (m == NULL)
+		return -ENOMEM;
+
+	ret = emu_alloc_state(sizeof(*m->state), &e->state_offset);
+	if (ret) {
+		free(m);
+		return ret;
+	}
+
+	m->element = e;
+	m->type = mattrs->type;
+	m->protocol = mattrs->protocol;
+	m->clock_id = emu_clockid(mattrs->clockfd);
+	m->state = emu_shared_memory + e->state_offset;
+	inith(&m->waiters);
+	inith(&m->gate_next);
+
+	if (m->type == EVL_MONITOR_GATE) {
+		m->state->u.gate.ceiling = mattrs->initval;
+	} else {
+		m->state->u.event.value = mattrs->initval;
+		m->state->u.event.gate_offset = EVL_MONITOR_NOGATE;
+	}
+
+	e->state = m->state;
+	e->fundle = emu_alloc_fundle();
+	e->priv = m;
+
+	return 0;
+}
+
+static void grant(struct emu_waiter *w, int status);
+
+static void monitor_release(struct emu_element *e)
+{
+	struct emu_monitor *m = e->priv;
+	struct emu_waiter *w, *tmp;
+
+	if (m->type == EVL_MONITOR_GATE)
+		return;
+
+	list_for_each_entry_safe(w, tmp, &m->waiters, next)
+		grant(w, -EIDRM);
+}
+
+static void unbind_event(struct emu_monitor *evt)
+{
+	list_remove_init(&evt->gate_next);
+	evt->gate = NULL;
+	evt->state->u.event.gate_offset = EVL_MONITOR_NOGATE;
+}
+
+static void monitor_destroy(struct emu_element *e)
+{
+	struct emu_monitor *m = e->priv, *evt, *tmp;
+
+	if (m->type == EVL_MONITOR_GATE) {
+		list_for_each_entry_safe(evt, tmp, &m->waiters, gate_next)
+			unbind_event(evt);
+	} else if (m->gate) {
+		unbind_event(m);
+	}
+
+	free(m);
+}
+
+static int futex_wait(__u32 *word, __u32 val, clockid_t clock_id,
+		const struct timespec *deadline)
+{
+	int op = FUTEX_WAIT_BITSET;
+
+	if (clock_id == CLOCK_REALTIME)
+		op |= FUTEX_CLOCK_REALTIME;
+
+	if (syscall(SYS_futex, word, op, val, deadline,
+			NULL, FUTEX_BITSET_MATCH_ANY))
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * Follow the chain of gate owners from @gate, which leads back to
+ * @current on deadlock. Must hold emu_lock.
+ */
+static bool would_deadlock(struct emu_monitor *gate, fundle_t current)
+{
+	struct emu_thread *t;
+	fundle_t owner;
+	int depth;
+
+	/* Do not loop over a cycle @current is not part of. */
+	for (depth = 0; gate && depth < 64; depth++) {
+		owner = evl_get_index(__atomic_load_n(gate_word(gate),
+						__ATOMIC_ACQUIRE));
+		if (owner == current)
+			return true;
+		t = emu_find_thread(owner);
+		if (t == NULL)
+			return false;
+		gate = t->wait_gate;
+	}
+
+	return false;
+}
+
+static int gate_enter(struct emu_monitor *gate, fundle_t current,
+		const struct timespec *deadline)
+{
+	__u32 *word = gate_word(gate), h, claimed;
+	int ret;
+
+	h = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+
+	for (;;) {
+		/*
+		 * Grab the gate with the claim bit set, since we
+		 * cannot tell whether other threads still sleep on
+		 * it. This forces the owner through EXIT.
+		 */
+		if (evl_get_index(h) == EVL_NO_HANDLE) {
+			if (__atomic_compare_exchange_n(word, &h,
+					current | GATE_CLAIM, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+				return 0;
+			continue;
+		}
+
+		if (evl_get_index(h) == current)
+			return -EDEADLK;
+
+		claimed = h | GATE_CLAIM;
+		if (h != claimed &&
+			!__atomic_compare_exchange_n(word, &h, claimed, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+			continue;
+
+		pthread_mutex_lock(&emu_lock);
+		if (would_deadlock(gate, current)) {
+			pthread_mutex_unlock(&emu_lock);
+			return -EDEADLK;
+		}
+		emu_current->wait_gate = gate;
+		pthread_mutex_unlock(&emu_lock);
+
+		ret = futex_wait(word, claimed, gate->clock_id, deadline);
+		emu_current->wait_gate = NULL;
+		if (ret == -ETIMEDOUT)
+			return ret;
+
+		h = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+	}
+}
+
+static void grant(struct emu_waiter *w, int status)
+{
+	list_remove(&w->next);
+	w->status = status;
+	w->done = true;
+	emu_wake(w->thread);
+}
+
+/*
+ * Wake up the waiters of the events bound to @gate which have been
+ * signaled while the gate was held. Must hold emu_lock.
+ */
+static void flush_signals(struct emu_monitor *gate)
+{
+	struct emu_waiter *w, *wtmp;
+	struct evl_monitor_state *est;
+	struct emu_monitor *evt;
+
+	list_for_each_entry(evt, &gate->waiters, gate_next) {
+		est = evt->state;
+		if (est->flags & EVL_MONITOR_SIGNALED) {
+			list_for_each_entry_safe(w, wtmp, &evt->waiters, next) {
+				grant(w, 0);
+				if (!(est->flags & EVL_MONITOR_BROADCAST))
+					break;
+			}
+			est->flags &= ~(EVL_MONITOR_SIGNALED|EVL_MONITOR_BROADCAST);
+		}
+		if (evt->targeted) {
+			list_for_each_entry_safe(w, wtmp, &evt->waiters, next) {
+				if (w->thread->signal_target == evt) {
+					w->thread->signal_target = NULL;
+					grant(w, 0);
+				}
+			}
+			evt->targeted = false;
+		}
+	}
+
+	gate->state->flags &= ~EVL_MONITOR_SIGNALED;
+}
+
+static int gate_exit(struct emu_monitor *gate, fundle_t current)
+{
+	__u32 *word = gate_word(gate);
+
+	if (evl_get_index(__atomic_load_n(word, __ATOMIC_ACQUIRE)) != current)
+		return -EPERM;
+
+	if (gate->state->flags & EVL_MONITOR_SIGNALED) {
+		pthread_mutex_lock(&emu_lock);
+		flush_signals(gate);
+		pthread_mutex_unlock(&emu_lock);
+	}
+
+	__atomic_store_n(word, EVL_NO_HANDLE, __ATOMIC_RELEASE);
+
+	/*
+	 * Wake all sleepers, the first one to run gets the gate, the
+	 * others claim it again. Picking a single one could leave
+	 * the others stranded if it timed out meanwhile.
+	 */
+	syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+	return 0;
+}
+
+static int gate_tryenter(struct emu_monitor *gate, fundle_t current)
+{
+	__u32 *word = gate_word(gate), h = EVL_NO_HANDLE;
+
+	if (__atomic_compare_exchange_n(word, &h, current, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+		return 0;
+
+	return evl_get_index(h) == current ? -EDEADLK : -EBUSY;
+}
+
+static int get_deadline(__u64 timeout_ptr, struct timespec *ts)
+{
+	return emu_timeout((const struct __evl_timespec *)(long)timeout_ptr, ts);
+}
+
+static int wait_gated(struct emu_monitor *evt, struct emu_thread *t,
+		struct evl_monitor_waitreq *req)
+{
+	struct emu_element *gate_e;
+	struct emu_monitor *gate;
+	struct emu_waiter w;
+	struct timespec ts;
+	int ret, timed;
+
+	timed = get_deadline(req->timeout_ptr, &ts);
+
+	pthread_mutex_lock(&emu_lock);
+
+	gate_e = emu_lookup_fd(req->gatefd);
+	if (gate_e == NULL || gate_e->class != &emu_monitor_class ||
+		((struct emu_monitor *)gate_e->priv)->type != EVL_MONITOR_GATE) {
+		pthread_mutex_unlock(&emu_lock);
+		return -EINVAL;
+	}
+
+	gate = gate_e->priv;
+	if (evl_get_index(*gate_word(gate)) != t->element->fundle) {
+		pthread_mutex_unlock(&emu_lock);
+		return -EPERM;
+	}
+
+	if (evt->gate && evt->gate != gate) {
+		pthread_mutex_unlock(&emu_lock);
+		return -EBADFD;
+	}
+
+	gate_e->refs++;
+
+	if (evt->gate == NULL) {
+		evt->gate = gate;
+		list_append(&evt->gate_next, &gate->waiters);
+		evt->state->u.event.gate_offset = gate_e->state_offset;
+	}
+
+	memset(&w, 0, sizeof(w));
+	w.thread = t;
+	list_append(&w.next, &evt->waiters);
+
+	pthread_mutex_unlock(&emu_lock);
+
+	gate_exit(gate, t->element->fundle);
+
+	pthread_mutex_lock(&emu_lock);
+
+	ret = emu_wait_for(t, &w.done, evt->clock_id, timed ? &ts : NULL);
+	if (!w.done)
+		list_remove(&w.next);
+	if (list_empty(&evt->waiters))
+		unbind_event(evt);
+
+	pthread_mutex_unlock(&emu_lock);
+
+	gate_enter(gate, t->element->fundle, NULL);
+	emu_put_element(gate_e);
+
+	req->status = w.done ? w.status : ret;
+
+	return 0;
+}
+
+static int wait_count(struct emu_monitor *evt, struct emu_thread *t,
+		struct evl_monitor_waitreq *req)
+{
+	struct emu_waiter w;
+	struct timespec ts;
+	int ret, timed;
+
+	timed = get_deadline(req->timeout_ptr, &ts);
+
+	pthread_mutex_lock(&emu_lock);
+
+	/*
+	 * A negative count tells user space that some thread waits,
+	 * which sends posters to the core.
+	 */
+	if (__atomic_fetch_sub(event_value(evt), 1, __ATOMIC_ACQ_REL) > 0) {
+		pthread_mutex_unlock(&emu_lock);
+		req->status = 0;
+		return 0;
+	}
+
+	memset(&w, 0, sizeof(w));
+	w.thread = t;
+	list_append(&w.next, &evt->waiters);
+
+	ret = emu_wait_for(t, &w.done, evt->clock_id, timed ? &ts : NULL);
+	if (!w.done) {
+		list_remove(&w.next);
+		__atomic_fetch_add(event_value(evt), 1, __ATOMIC_ACQ_REL);
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	req->status = w.done ? w.status : ret;
+
+	return 0;
+}
+
+static __s32 match_bits(__s32 value, __s32 bits, bool exact)
+{
+	if (exact)
+		return (value & bits) == bits ? bits : 0;
+
+	return value & bits;
+}
+
+static int wait_mask(struct emu_monitor *evt, struct emu_thread *t,
+		struct evl_monitor_waitreq *req, bool exact)
+{
+	struct emu_waiter w;
+	struct timespec ts;
+	int ret, timed;
+	__s32 match;
+
+	timed = get_deadline(req->timeout_ptr, &ts);
+
+	pthread_mutex_lock(&emu_lock);
+
+	match = match_bits(*event_value(evt), req->value, exact);
+	if (match) {
+		__atomic_fetch_and(event_value(evt), ~match, __ATOMIC_ACQ_REL);
+		if (evt->state->u.event.pollrefs)
+			emu_notify();
+		pthread_mutex_unlock(&emu_lock);
+		req->value = match;
+		req->status = 0;
+		return 0;
+	}
+
+	memset(&w, 0, sizeof(w));
+	w.thread = t;
+	w.bits = req->value;
+	w.exact = exact;
+	list_append(&w.next, &evt->waiters);
+
+	ret = emu_wait_for(t, &w.done, evt->clock_id, timed ? &ts : NULL);
+	if (!w.done)
+		list_remove(&w.next);
+
+	pthread_mutex_unlock(&emu_lock);
+
+	req->value = w.bits;
+	req->status = w.done ? w.status : ret;
+
+	return 0;
+}
+
+static int trywait_mask(struct emu_monitor *evt,
+			struct evl_monitor_trywaitreq *req, bool exact)
+{
+	__s32 match;
+
+	pthread_mutex_lock(&emu_lock);
+
+	match = match_bits(*event_value(evt), req->value, exact);
+	if (match) {
+		__atomic_fetch_and(event_value(evt), ~match, __ATOMIC_ACQ_REL);
+		if (evt->state->u.event.pollrefs)
+			emu_notify();
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	if (!match)
+		return -EAGAIN;
+
+	req->value = match;
+
+	return 0;
+}
+
+/* Must hold emu_lock. */
+static void post_mask(struct emu_monitor *evt, __s32 bits, bool bcast)
+{
+	struct emu_waiter *w, *tmp;
+	__s32 value, match, consumed = 0;
+
+	value = __atomic_or_fetch(event_value(evt), bits, __ATOMIC_ACQ_REL);
+
+	/*
+	 * A broadcast hands the same bits over to every waiter it
+	 * satisfies, a regular post consumes them in FIFO order.
+	 */
+	list_for_each_entry_safe(w, tmp, &evt->waiters, next) {
+		match = match_bits(bcast ? value : value & ~consumed,
+				w->bits, w->exact);
+		if (!match)
+			continue;
+		w->bits = match;
+		consumed |= match;
+		grant(w, 0);
+	}
+
+	if (consumed)
+		__atomic_fetch_and(event_value(evt), ~consumed, __ATOMIC_ACQ_REL);
+}
+
+/* Must hold emu_lock. */
+static void post_count(struct emu_monitor *evt, __s32 count, bool flush)
+{
+	struct emu_waiter *w, *tmp;
+
+	if (flush) {
+		list_for_each_entry_safe(w, tmp, &evt->waiters, next) {
+			__atomic_fetch_add(event_value(evt), 1, __ATOMIC_ACQ_REL);
+			grant(w, -EAGAIN);
+		}
+		return;
+	}
+
+	/*
+	 * Like the real core, a signal credits a single unit and
+	 * readies at most one sleeper, whatever the signal value; a
+	 * zero value only notifies the pollers. Sleepers have taken
+	 * their unit in advance.
+	 */
+	if (count > 0) {
+		if (!list_empty(&evt->waiters))
+			grant(list_first_entry(&evt->waiters,
+					struct emu_waiter, next), 0);
+		__atomic_fetch_add(event_value(evt), 1, __ATOMIC_ACQ_REL);
+	}
+}
+
+static int event_post(struct emu_monitor *evt, __s32 *arg, bool bcast)
+{
+	pthread_mutex_lock(&emu_lock);
+
+	switch (evt->protocol) {
+	case EVL_EVENT_MASK:
+		post_mask(evt, *arg, bcast);
+		break;
+	case EVL_EVENT_COUNT:
+		post_count(evt, *arg, bcast);
+		break;
+	}
+
+	if (evt->state->u.event.pollrefs)
+		emu_notify();
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return 0;
+}
+
+static int event_wait(struct emu_monitor *evt, void *arg, bool exact)
+{
+	struct emu_thread *t = emu_current;
+
+	if (t == NULL)
+		return -EPERM;
+
+	switch (evt->protocol) {
+	case EVL_EVENT_GATED:
+		return wait_gated(evt, t, arg);
+	case EVL_EVENT_COUNT:
+		return wait_count(evt, t, arg);
+	case EVL_EVENT_MASK:
+		return wait_mask(evt, t, arg, exact);
+	default:
+		return -EINVAL;
+	}
+}
+
+static int event_unwait(struct evl_monitor_unwaitreq *req)
+{
+	struct emu_element *gate_e;
+	struct emu_thread *t = emu_current;
+	int ret;
+
+	if (t == NULL)
+		return -EPERM;
+
+	gate_e = emu_get_element(req->gatefd);
+	if (gate_e == NULL)
+		return -EBADF;
+
+	ret = gate_enter(gate_e->priv, t->element->fundle, NULL);
+	emu_put_element(gate_e);
+
+	return ret == -EDEADLK ? 0 : ret;
+}
+
+int emu_signal_thread(struct emu_thread *t, int efd)
+{
+	struct emu_monitor *evt;
+	struct emu_element *e;
+	int ret = 0;
+
+	pthread_mutex_lock(&emu_lock);
+
+	e = emu_lookup_fd(efd);
+	if (e == NULL || e->class != &emu_monitor_class) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	evt = e->priv;
+	t->signal_target = evt;
+	evt->targeted = true;
+out:
+	pthread_mutex_unlock(&emu_lock);
+
+	return ret;
+}
+
+static int monitor_poll(struct emu_element *e)
+{
+	struct emu_monitor *m = e->priv;
+	__s32 value;
+
+	if (m->type == EVL_MONITOR_GATE)
+		return 0;
+
+	value = __atomic_load_n(event_value(m), __ATOMIC_ACQUIRE);
+	switch (m->protocol) {
+	case EVL_EVENT_COUNT:
+		return value > 0 ? POLLIN|POLLRDNORM : 0;
+	case EVL_EVENT_MASK:
+		/* Writable once the posted bits have been consumed. */
+		return value ? POLLIN|POLLRDNORM : POLLOUT|POLLWRNORM;
+	default:
+		return 0;
+	}
+}
+
+/* Polled events have user space post them via the core. */
+static void monitor_watch(struct emu_element *e, bool on)
+{
+	struct emu_monitor *m = e->priv;
+
+	if (m->type != EVL_MONITOR_GATE)
+		__atomic_add_fetch(&m->state->u.event.pollrefs, on ? 1 : -1,
+				__ATOMIC_RELEASE);
+}
+
+static int monitor_ioctl(struct emu_element *e,
+			unsigned long request, void *arg)
+{
+	struct emu_monitor *m = e->priv;
+	struct evl_monitor_binding *bind;
+	struct timespec ts;
+	fundle_t current;
+	int ret;
+
+	current = emu_current ? emu_current->element->fundle : EVL_NO_HANDLE;
+
+	switch (request) {
+	case EVL_MONIOC_BIND:
+		bind = arg;
+		bind->type = m->type;
+		bind->protocol = m->protocol;
+		bind->eids.minor = 0;
+		bind->eids.fundle = e->fundle;
+		bind->eids.state_offset = e->state_offset;
+		return 0;
+	case EVL_MONIOC_ENTER:
+		if (current == EVL_NO_HANDLE)
+			return -EPERM;
+		ret = emu_timeout(arg, &ts);
+		return gate_enter(m, current, ret ? &ts : NULL);
+	case EVL_MONIOC_TRYENTER:
+		if (current == EVL_NO_HANDLE)
+			return -EPERM;
+		return gate_tryenter(m, current);
+	case EVL_MONIOC_EXIT:
+		return gate_exit(m, current);
+	case EVL_MONIOC_WAIT:
+		return event_wait(m, arg, false);
+	case EVL_MONIOC_WAIT_EXACT:
+		return event_wait(m, arg, true);
+	case EVL_MONIOC_UNWAIT:
+		return event_unwait(arg);
+	case EVL_MONIOC_TRYWAIT:
+		return trywait_mask(m, arg, false);
+	case EVL_MONIOC_TRYWAIT_EXACT:
+		return trywait_mask(m, arg, true);
+	case EVL_MONIOC_SIGNAL:
+		return event_post(m, arg, false);
+	case EVL_MONIOC_BROADCAST:
+		return event_post(m, arg, true);
+	default:
+		return -ENOTTY;
+	}
+}
+
+const struct emu_class emu_monitor_class = {
+	.name = EVL_MONITOR_DEV,
+	.type = EMU_MONITOR,
+	.create = monitor_create,
+	.release = monitor_release,
+	.destroy = monitor_destroy,
+	.ioctl = monitor_ioctl,
+	.poll = monitor_poll,
+	.watch = monitor_watch,
+};
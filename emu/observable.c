@@ -0,0 +1,296 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <evl/factory.h>
+#include <evl/observable.h>
+#include "internal.h"
+
+struct emu_observer {
+	struct list_head next;
+	pid_t tid;		/* In-band threads may observe too. */
+	struct __evl_notification *backlog;
+	unsigned int depth;
+	unsigned int head;
+	unsigned int count;
+	int flags;
+	bool has_last;
+	struct evl_notice last;	/* For EVL_NOTIFY_ONCHANGE. */
+};
+
+struct emu_observable {
+	struct list_head observers;
+	bool unicast;
+	__u32 serial;
+};
+
+static int observable_create(struct emu_element *e, void *attrs)
+{
+	struct emu_observable *obs;
+
+	obs = calloc(1, sizeof(*obs));
+	if (obs == NULL)
+		return -ENOMEM;
+
+	inith(&obs->observers);
+	obs->unicast = !!(e->clone_flags & EVL_CLONE_UNICAST);
+	e->priv = obs;
+
+	return 0;
+}
+
+static void drop_observer(struct emu_observer *observer)
+{
+	list_remove(&observer->next);
+	free(observer->backlog);
+	free(observer);
+}
+
+static void observable_destroy(struct emu_element *e)
+{
+	struct emu_observable *obs = e->priv;
+	struct emu_observer *observer, *tmp;
+
+	list_for_each_entry_safe(observer, tmp, &obs->observers, next)
+		drop_observer(observer);
+
+	free(obs);
+}
+
+/* Must hold emu_lock. */
+static struct emu_observer *find_observer(struct emu_observable *obs,
+					pid_t tid)
+{
+	struct emu_observer *observer;
+
+	list_for_each_entry(observer, &obs->observers, next) {
+		if (observer->tid == tid)
+			return observer;
+	}
+
+	return NULL;
+}
+
+static int subscribe(struct emu_observable *obs,
+		struct evl_subscription *sub)
+{
+	struct emu_observer *observer;
+	pid_t tid = gettid();
+
+	if (sub->backlog_count == 0)
+		return -EINVAL;
+
+	observer = calloc(1, sizeof(*observer));
+	if (observer == NULL)
+		return -ENOMEM;
+
+	observer->backlog = calloc(sub->backlog_count,
+				sizeof(*observer->backlog));
+	if (observer->backlog == NULL) {
+		free(observer);
+		return -ENOMEM;
+	}
+
+	observer->tid = tid;
+	observer->depth = sub->backlog_count;
+	observer->flags = sub->flags;
+
+	pthread_mutex_lock(&emu_lock);
+
+	if (find_observer(obs, tid)) {
+		pthread_mutex_unlock(&emu_lock);
+		free(observer->backlog);
+		free(observer);
+		return -EBUSY;
+	}
+
+	list_append(&observer->next, &obs->observers);
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return 0;
+}
+
+static int unsubscribe(struct emu_observable *obs)
+{
+	struct emu_observer *observer;
+	int ret = 0;
+
+	pthread_mutex_lock(&emu_lock);
+
+	observer = find_observer(obs, gettid());
+	if (observer)
+		drop_observer(observer);
+	else
+		ret = -ENOENT;
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return ret;
+}
+
+static int observable_ioctl(struct emu_element *e,
+			unsigned long request, void *arg)
+{
+	struct emu_observable *obs = e->priv;
+
+	switch (request) {
+	case EVL_OBSIOC_SUBSCRIBE:
+		return subscribe(obs, arg);
+	case EVL_OBSIOC_UNSUBSCRIBE:
+		return unsubscribe(obs);
+	default:
+		return -ENOTTY;
+	}
+}
+
+/* Must hold emu_lock. */
+static bool push_notice(struct emu_observable *obs,
+			struct emu_observer *observer,
+			const struct evl_notice *ntc,
+			const struct timespec *now)
+{
+	struct __evl_notification *nf;
+
+	if ((observer->flags & EVL_NOTIFY_ONCHANGE) && observer->has_last &&
+		observer->last.tag == ntc->tag &&
+		observer->last.event.lval == ntc->event.lval)
+		return true;
+
+	if (observer->count == observer->depth)
+		return false;
+
+	nf = observer->backlog +
+		(observer->head + observer->count) % observer->depth;
+	nf->tag = ntc->tag;
+	nf->serial = obs->serial;
+	nf->issuer = gettid();
+	nf->event = ntc->event;
+	nf->date.tv_sec = now->tv_sec;
+	nf->date.tv_nsec = now->tv_nsec;
+	observer->count++;
+	observer->last = *ntc;
+	observer->has_last = true;
+
+	return true;
+}
+
+static ssize_t observable_write(struct emu_element *e, const void *buf,
+				size_t count, int flags)
+{
+	struct emu_observable *obs = e->priv;
+	const struct evl_notice *ntc = buf;
+	struct emu_observer *observer;
+	struct timespec now;
+	size_t n, nr;
+
+	nr = count / sizeof(*ntc);
+	if (nr == 0 || count % sizeof(*ntc))
+		return -EINVAL;
+
+	for (n = 0; n < nr; n++) {
+		if (ntc[n].tag < EVL_NOTICE_USER)
+			return -EINVAL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&emu_lock);
+
+	for (n = 0; n < nr; n++, ntc++) {
+		obs->serial++;
+		list_for_each_entry(observer, &obs->observers, next) {
+			if (!push_notice(obs, observer, ntc, &now))
+				continue;
+			/*
+			 * Unicast mode: hand over to the first observer
+			 * which accepts the notice, which then goes to
+			 * the back of the line.
+			 */
+			if (obs->unicast) {
+				list_remove(&observer->next);
+				list_append(&observer->next, &obs->observers);
+				break;
+			}
+		}
+	}
+
+	emu_notify();
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return nr * sizeof(*ntc);
+}
+
+static ssize_t observable_read(struct emu_element *e, void *buf,
+			size_t count, int flags)
+{
+	struct __evl_notification *nf = buf;
+	struct emu_observable *obs = e->priv;
+	struct emu_observer *observer;
+	size_t n, nr;
+
+	nr = count / sizeof(*nf);
+	if (nr == 0)
+		return -EINVAL;
+
+	pthread_mutex_lock(&emu_lock);
+
+	for (;;) {
+		if (e->closed) {
+			pthread_mutex_unlock(&emu_lock);
+			return -EBADF;
+		}
+		observer = find_observer(obs, gettid());
+		if (observer == NULL) {
+			pthread_mutex_unlock(&emu_lock);
+			return -ENXIO;
+		}
+		if (observer->count)
+			break;
+		if (flags & EMU_IO_NONBLOCK) {
+			pthread_mutex_unlock(&emu_lock);
+			return -EAGAIN;
+		}
+		emu_wait_event(NULL);
+	}
+
+	for (n = 0; n < nr && observer->count; n++) {
+		nf[n] = observer->backlog[observer->head];
+		observer->head = (observer->head + 1) % observer->depth;
+		observer->count--;
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return n * sizeof(*nf);
+}
+
+static int observable_poll(struct emu_element *e)
+{
+	struct emu_observer *observer;
+	int events = POLLOUT|POLLWRNORM;
+
+	observer = find_observer(e->priv, gettid());
+	if (observer && observer->count)
+		events |= POLLIN|POLLRDNORM;
+
+	return events;
+}
+
+const struct emu_class emu_observable_class = {
+	.name = EVL_OBSERVABLE_DEV,
+	.type = EMU_OBSERVABLE,
+	.create = observable_create,
+	.destroy = observable_destroy,
+	.ioctl = observable_ioctl,
+	.read = observable_read,
+	.write = observable_write,
+	.poll = observable_poll,
+};
@@ -0,0 +1,330 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <evl/poll.h>
+#include "internal.h"
+
+/* Rescan period when the set has no way to notify us of changes. */
+#define EMU_POLL_RESCAN_NS	1000000
+
+struct emu_pollfd {
+	struct list_head next;
+	int fd;
+	struct emu_element *element;
+	unsigned int events;
+	union evl_value pollval;
+};
+
+struct emu_pollset {
+	struct list_head items;
+};
+
+static int poll_create(struct emu_element *e, void *attrs)
+{
+	struct emu_pollset *set;
+
+	set = calloc(1, sizeof(*set));
+	if (set == NULL)
+		return -ENOMEM;
+
+	inith(&set->items);
+	e->priv = set;
+
+	return 0;
+}
+
+/* Must hold emu_lock. */
+static void drop_item(struct emu_pollfd *item)
+{
+	struct emu_element *e = item->element;
+
+	list_remove(&item->next);
+	if (e->class->watch)
+		e->class->watch(e, false);
+	free(item);
+}
+
+static void poll_destroy(struct emu_element *e)
+{
+	struct emu_pollset *set = e->priv;
+	struct emu_pollfd *item, *tmp;
+	struct emu_element *target;
+
+	list_for_each_entry_safe(item, tmp, &set->items, next) {
+		target = item->element;
+		drop_item(item);
+		__emu_put_element(target);
+	}
+
+	free(set);
+}
+
+/* Must hold emu_lock. */
+static bool reaches(struct emu_element *from, struct emu_element *to)
+{
+	struct emu_pollset *set = from->priv;
+	struct emu_pollfd *item;
+
+	if (from == to)
+		return true;
+
+	list_for_each_entry(item, &set->items, next) {
+		if (item->element->class == &emu_poll_class &&
+			reaches(item->element, to))
+			return true;
+	}
+
+	return false;
+}
+
+/* Must hold emu_lock. */
+static struct emu_pollfd *find_item(struct emu_pollset *set, int fd)
+{
+	struct emu_pollfd *item;
+
+	list_for_each_entry(item, &set->items, next) {
+		if (item->fd == fd)
+			return item;
+	}
+
+	return NULL;
+}
+
+static int add_item(struct emu_element *e, struct evl_poll_ctlreq *creq)
+{
+	struct emu_pollset *set = e->priv;
+	struct emu_element *target;
+	struct emu_pollfd *item;
+
+	target = emu_lookup_fd(creq->fd);
+	if (target == NULL)
+		return -EBADF;
+
+	if (target->class->poll == NULL)
+		return -EINVAL;
+
+	if (target->class == &emu_poll_class && reaches(target, e))
+		return -ELOOP;
+
+	if (find_item(set, creq->fd))
+		return -EEXIST;
+
+	item = malloc(sizeof(*item));
+	if (item == NULL)
+		return -ENOMEM;
+
+	item->fd = creq->fd;
+	item->element = target;
+	item->events = creq->events;
+	item->pollval = creq->pollval;
+	target->refs++;
+	if (target->class->watch)
+		target->class->watch(target, true);
+	list_append(&item->next, &set->items);
+	emu_notify();
+
+	return 0;
+}
+
+static int poll_ctl(struct emu_element *e, struct evl_poll_ctlreq *creq)
+{
+	struct emu_pollset *set = e->priv;
+	struct emu_element *target;
+	struct emu_pollfd *item;
+	int ret = 0;
+
+	pthread_mutex_lock(&emu_lock);
+
+	switch (creq->action) {
+	case EVL_POLL_CTLADD:
+		ret = add_item(e, creq);
+		break;
+	case EVL_POLL_CTLDEL:
+		item = find_item(set, creq->fd);
+		if (item == NULL) {
+			ret = -ENOENT;
+			break;
+		}
+		target = item->element;
+		drop_item(item);
+		__emu_put_element(target);
+		break;
+	case EVL_POLL_CTLMOD:
+		item = find_item(set, creq->fd);
+		if (item == NULL) {
+			ret = -ENOENT;
+			break;
+		}
+		item->events = creq->events;
+		item->pollval = creq->pollval;
+		emu_notify();
+		break;
+	default:
+		ret = -EINVAL;
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return ret;
+}
+
+static int poll_poll(struct emu_element *e);
+
+/* Must hold emu_lock. */
+static int item_events(struct emu_pollfd *item)
+{
+	struct emu_element *target = item->element;
+	int events;
+
+	if (target->closed)
+		return POLLNVAL;
+
+	events = target->class->poll(target);
+
+	return events & (item->events|POLLERR|POLLHUP);
+}
+
+static int poll_poll(struct emu_element *e)
+{
+	struct emu_pollset *set = e->priv;
+	struct emu_pollfd *item;
+
+	list_for_each_entry(item, &set->items, next) {
+		if (item_events(item))
+			return POLLIN|POLLRDNORM;
+	}
+
+	return 0;
+}
+
+static inline bool ts_before(const struct timespec *a,
+			const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec ||
+		(a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+ * Figure out when to scan the set again if nothing notifies us
+ * before: on the next timer shot, or soon if some element cannot
+ * tell us about changes. Must hold emu_lock.
+ */
+static bool next_scan(struct emu_pollset *set, struct timespec *mono)
+{
+	struct timespec date, now;
+	struct emu_pollfd *item;
+	bool timed = false;
+
+	list_for_each_entry(item, &set->items, next) {
+		switch (item->element->class->type) {
+		case EMU_TIMER:
+			if (!emu_timer_deadline(item->element, &date))
+				continue;
+			break;
+		case EMU_PROXY:
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			date.tv_sec = now.tv_sec;
+			date.tv_nsec = now.tv_nsec + EMU_POLL_RESCAN_NS;
+			if (date.tv_nsec >= 1000000000) {
+				date.tv_sec++;
+				date.tv_nsec -= 1000000000;
+			}
+			break;
+		default:
+			continue;
+		}
+		if (!timed || ts_before(&date, mono))
+			*mono = date;
+		timed = true;
+	}
+
+	return timed;
+}
+
+static int poll_wait(struct emu_element *e, struct evl_poll_waitreq *wreq)
+{
+	struct evl_poll_event *pollset, *ev;
+	struct emu_pollset *set = e->priv;
+	struct timespec ts, deadline, scan;
+	struct emu_pollfd *item;
+	int events, nr, ret;
+	bool timed;
+
+	if (wreq->nrset < 0)
+		return -EINVAL;
+
+	pollset = (struct evl_poll_event *)(long)wreq->pollset_ptr;
+	timed = emu_timeout((const struct __evl_timespec *)(long)
+			wreq->timeout_ptr, &ts);
+	if (timed)
+		emu_abs_timeout(CLOCK_MONOTONIC, &ts, &deadline);
+
+	pthread_mutex_lock(&emu_lock);
+
+	for (;;) {
+		nr = 0;
+		list_for_each_entry(item, &set->items, next) {
+			if (nr >= wreq->nrset)
+				break;
+			events = item_events(item);
+			if (events == 0)
+				continue;
+			ev = pollset + nr++;
+			ev->fd = item->fd;
+			ev->events = events;
+			ev->pollval = item->pollval;
+		}
+
+		if (nr > 0 || wreq->nrset == 0)
+			break;
+
+		if (next_scan(set, &scan)) {
+			if (timed && ts_before(&deadline, &scan))
+				scan = deadline;
+			ret = emu_wait_event(&scan);
+			if (ret && timed && !ts_before(&scan, &deadline))
+				break;
+		} else {
+			ret = emu_wait_event(timed ? &deadline : NULL);
+			if (ret)
+				break;
+		}
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	if (nr == 0 && wreq->nrset > 0)
+		return -ETIMEDOUT;
+
+	wreq->nrset = nr;
+
+	return 0;
+}
+
+static int poll_ioctl(struct emu_element *e,
+		unsigned long request, void *arg)
+{
+	switch (request) {
+	case EVL_POLIOC_CTL:
+		return poll_ctl(e, arg);
+	case EVL_POLIOC_WAIT:
+		return poll_wait(e, arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+const struct emu_class emu_poll_class = {
+	.name = EVL_POLL_DEV,
+	.type = EMU_POLL,
+	.raw = true,
+	.create = poll_create,
+	.destroy = poll_destroy,
+	.ioctl = poll_ioctl,
+	.poll = poll_poll,
+};
@@ -0,0 +1,61 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <evl/proxy.h>
+#include "internal.h"
+
+/*
+ * The proxy is unbuffered: the I/O requests go straight to the
+ * target file, which is good enough for a stand-in.
+ */
+static int proxy_create(struct emu_element *e, void *attrs)
+{
+	struct evl_proxy_attrs *pattrs = attrs;
+
+	if (pattrs == NULL)
+		return -EINVAL;
+
+	e->priv = (void *)(long)pattrs->fd;
+
+	return 0;
+}
+
+static ssize_t proxy_read(struct emu_element *e, void *buf,
+			size_t count, int flags)
+{
+	ssize_t ret = read((int)(long)e->priv, buf, count);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static ssize_t proxy_write(struct emu_element *e, const void *buf,
+			size_t count, int flags)
+{
+	ssize_t ret = write((int)(long)e->priv, buf, count);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static int proxy_poll(struct emu_element *e)
+{
+	struct pollfd pfd = {
+		.fd = (int)(long)e->priv,
+		.events = POLLIN|POLLOUT,
+	};
+
+	return poll(&pfd, 1, 0) > 0 ? pfd.revents : 0;
+}
+
+const struct emu_class emu_proxy_class = {
+	.name = EVL_PROXY_DEV,
+	.type = EMU_PROXY,
+	.create = proxy_create,
+	.read = proxy_read,
+	.write = proxy_write,
+	.poll = proxy_poll,
+};
@@ -0,0 +1,228 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include "internal.h"
+
+__thread struct emu_thread *emu_current;
+
+static DEFINE_LIST_HEAD(thread_list);
+
+static pthread_key_t detach_key;
+
+static pthread_once_t detach_once = PTHREAD_ONCE_INIT;
+
+/* Must hold emu_lock. */
+struct emu_thread *emu_find_thread(fundle_t fundle)
+{
+	struct emu_thread *t;
+
+	list_for_each_entry(t, &thread_list, next) {
+		if (t->element->fundle == fundle)
+			return t;
+	}
+
+	return NULL;
+}
+
+/*
+ * Like with the core, an attached thread holds a reference on its
+ * element until it detaches or exits.
+ */
+static void detach_current(void *arg)
+{
+	struct emu_thread *t = emu_current;
+
+	if (t) {
+		emu_current = NULL;
+		emu_put_element(t->element);
+	}
+}
+
+static void init_detach_key(void)
+{
+	pthread_key_create(&detach_key, detach_current);
+}
+
+/* Must hold emu_lock. */
+int emu_wait_for(struct emu_thread *t, bool *cond,
+		clockid_t clock_id, const struct timespec *deadline)
+{
+	struct timespec mono;
+	int ret;
+
+	/* The sleep conditions run on the monotonic clock. */
+	if (emu_abs_timeout(clock_id, deadline, &mono))
+		deadline = &mono;
+
+	t->unblocked = false;
+
+	while (!*cond) {
+		if (t->unblocked)
+			return -EINTR;
+		if (deadline == NULL) {
+			pthread_cond_wait(&t->cond, &emu_lock);
+			continue;
+		}
+		ret = pthread_cond_timedwait(&t->cond, &emu_lock, deadline);
+		if (ret == ETIMEDOUT)
+			return *cond ? 0 : -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+/* Must hold emu_lock. */
+void emu_wake(struct emu_thread *t)
+{
+	pthread_cond_signal(&t->cond);
+}
+
+static int thread_create(struct emu_element *e, void *attrs)
+{
+	struct emu_thread *t;
+	pthread_condattr_t cattr;
+	int ret;
+
+	/* A thread may attach once. */
+	if (emu_current)
+		return -EBUSY;
+
+	pthread_once(&detach_once, init_detach_key);
+
+	t = calloc(1, sizeof(*t));
+	if (t == NULL)
+		return -ENOMEM;
+
+	ret = emu_alloc_state(sizeof(*t->u_window), &e->state_offset);
+	if (ret) {
+		free(t);
+		return ret;
+	}
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&t->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	t->element = e;
+	t->u_window = emu_shared_memory + e->state_offset;
+	t->u_window->state = 0;	/* Running out-of-band. */
+	e->state = t->u_window;
+	e->fundle = emu_alloc_fundle();
+	e->priv = t;
+	e->refs++;
+	list_append(&t->next, &thread_list);
+	emu_current = t;
+	pthread_setspecific(detach_key, t);
+
+	return 0;
+}
+
+static void thread_destroy(struct emu_element *e)
+{
+	struct emu_thread *t = e->priv;
+
+	list_remove(&t->next);
+	pthread_cond_destroy(&t->cond);
+	free(t);
+}
+
+#define EMU_MODE_BITS	(EVL_T_WOSS|EVL_T_WOLI|EVL_T_WOSX|EVL_T_WOSO|\
+			 EVL_T_HMSIG|EVL_T_HMOBS)
+#define EMU_WARN_BITS	(EVL_T_WOSS|EVL_T_WOLI|EVL_T_WOSX|EVL_T_WOSO)
+
+static int set_mode(struct emu_thread *t, __u32 *arg, bool set)
+{
+	__u32 oldmode;
+
+	/* No observable for threads here, HM notices go to SIGDEBUG. */
+	if ((*arg & ~EMU_MODE_BITS) || (set && (*arg & EVL_T_HMOBS)))
+		return -EINVAL;
+
+	pthread_mutex_lock(&emu_lock);
+
+	oldmode = t->mode;
+	if (set) {
+		t->mode |= *arg;
+		if (t->mode & EMU_WARN_BITS)
+			t->mode |= EVL_T_HMSIG;
+	} else {
+		t->mode &= ~*arg;
+		if (!(t->mode & EMU_WARN_BITS))
+			t->mode &= ~EVL_T_HMSIG;
+	}
+
+	t->u_window->state = (t->u_window->state & ~oldmode) | t->mode;
+	*arg = oldmode;
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return 0;
+}
+
+static int thread_ioctl(struct emu_element *e,
+			unsigned long request, void *arg)
+{
+	struct emu_thread *t = e->priv;
+	struct evl_thread_state *statebuf;
+
+	switch (request) {
+	case EVL_THRIOC_SET_SCHEDPARAM:
+		t->attrs = *(struct evl_sched_attrs *)arg;
+		return 0;
+	case EVL_THRIOC_GET_SCHEDPARAM:
+		*(struct evl_sched_attrs *)arg = t->attrs;
+		return 0;
+	case EVL_THRIOC_GET_STATE:
+		statebuf = arg;
+		memset(statebuf, 0, sizeof(*statebuf));
+		statebuf->eattrs = t->attrs;
+		statebuf->cpu = sched_getcpu();
+		return 0;
+	case EVL_THRIOC_SWITCH_OOB:
+		t->u_window->state &= ~EVL_T_INBAND;
+		return 0;
+	case EVL_THRIOC_SWITCH_INBAND:
+		t->u_window->state |= EVL_T_INBAND;
+		return 0;
+	case EVL_THRIOC_SET_MODE:
+		return set_mode(t, arg, true);
+	case EVL_THRIOC_CLEAR_MODE:
+		return set_mode(t, arg, false);
+	case EVL_THRIOC_DETACH_SELF:
+		if (emu_current != t)
+			return -EPERM;
+		pthread_setspecific(detach_key, NULL);
+		detach_current(NULL);
+		return 0;
+	case EVL_THRIOC_UNBLOCK:
+	case EVL_THRIOC_DEMOTE:
+		pthread_mutex_lock(&emu_lock);
+		t->unblocked = true;
+		pthread_cond_signal(&t->cond);
+		pthread_mutex_unlock(&emu_lock);
+		return 0;
+	case EVL_THRIOC_YIELD:
+		sched_yield();
+		return 0;
+	case EVL_THRIOC_SIGNAL:
+		return emu_signal_thread(t, *(__u32 *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+const struct emu_class emu_thread_class = {
+	.name = EVL_THREAD_DEV,
+	.type = EMU_THREAD,
+	.create = thread_create,
+	.destroy = thread_destroy,
+	.ioctl = thread_ioctl,
+};
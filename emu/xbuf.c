@@ -0,0 +1,194 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <evl/xbuf.h>
+#include "internal.h"
+
+struct emu_ring {
+	char *data;
+	size_t size;
+	size_t rdoff;
+	size_t fillsz;
+};
+
+/*
+ * The inbound ring carries the data from in-band writers to oob
+ * readers, the outbound ring flows the other way.
+ */
+struct emu_xbuf {
+	struct emu_ring ibnd;
+	struct emu_ring obnd;
+};
+
+static int init_ring(struct emu_ring *ring, size_t size)
+{
+	ring->size = size;
+	if (size == 0)
+		return 0;
+
+	ring->data = malloc(size);
+
+	return ring->data ? 0 : -ENOMEM;
+}
+
+static int xbuf_create(struct emu_element *e, void *attrs)
+{
+	struct evl_xbuf_attrs *xattrs = attrs;
+	struct emu_xbuf *xbuf;
+
+	if (xattrs == NULL || (!xattrs->i_bufsz && !xattrs->o_bufsz))
+		return -EINVAL;
+
+	xbuf = calloc(1, sizeof(*xbuf));
+	if (xbuf == NULL)
+		return -ENOMEM;
+
+	if (init_ring(&xbuf->ibnd, xattrs->i_bufsz) ||
+		init_ring(&xbuf->obnd, xattrs->o_bufsz)) {
+		free(xbuf->ibnd.data);
+		free(xbuf);
+		return -ENOMEM;
+	}
+
+	e->priv = xbuf;
+
+	return 0;
+}
+
+static void xbuf_destroy(struct emu_element *e)
+{
+	struct emu_xbuf *xbuf = e->priv;
+
+	free(xbuf->ibnd.data);
+	free(xbuf->obnd.data);
+	free(xbuf);
+}
+
+static ssize_t ring_read(struct emu_ring *ring, void *buf,
+			size_t count, int flags)
+{
+	size_t len, n, chunk;
+
+	if (ring->size == 0)
+		return -ENXIO;
+
+	if (count == 0)
+		return 0;
+
+	pthread_mutex_lock(&emu_lock);
+
+	while (ring->fillsz == 0) {
+		if (flags & EMU_IO_NONBLOCK) {
+			pthread_mutex_unlock(&emu_lock);
+			return -EAGAIN;
+		}
+		emu_wait_event(NULL);
+	}
+
+	len = count < ring->fillsz ? count : ring->fillsz;
+	for (n = 0; n < len; n += chunk) {
+		chunk = ring->size - ring->rdoff;
+		if (chunk > len - n)
+			chunk = len - n;
+		memcpy(buf + n, ring->data + ring->rdoff, chunk);
+		ring->rdoff = (ring->rdoff + chunk) % ring->size;
+	}
+
+	ring->fillsz -= len;
+	emu_notify();
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return len;
+}
+
+/* Messages are written atomically, or not at all. */
+static ssize_t ring_write(struct emu_ring *ring, const void *buf,
+			size_t count, int flags)
+{
+	size_t n, chunk, wroff;
+
+	if (ring->size == 0)
+		return -ENXIO;
+
+	if (count > ring->size)
+		return -EFBIG;
+
+	if (count == 0)
+		return 0;
+
+	pthread_mutex_lock(&emu_lock);
+
+	while (ring->size - ring->fillsz < count) {
+		if (flags & EMU_IO_NONBLOCK) {
+			pthread_mutex_unlock(&emu_lock);
+			return -EAGAIN;
+		}
+		emu_wait_event(NULL);
+	}
+
+	wroff = (ring->rdoff + ring->fillsz) % ring->size;
+	for (n = 0; n < count; n += chunk) {
+		chunk = ring->size - wroff;
+		if (chunk > count - n)
+			chunk = count - n;
+		memcpy(ring->data + wroff, buf + n, chunk);
+		wroff = (wroff + chunk) % ring->size;
+	}
+
+	ring->fillsz += count;
+	emu_notify();
+
+	pthread_mutex_unlock(&emu_lock);
+
+	return count;
+}
+
+static ssize_t xbuf_read(struct emu_element *e, void *buf,
+			size_t count, int flags)
+{
+	struct emu_xbuf *xbuf = e->priv;
+
+	return ring_read(flags & EMU_IO_OOB ? &xbuf->ibnd : &xbuf->obnd,
+			buf, count, flags);
+}
+
+static ssize_t xbuf_write(struct emu_element *e, const void *buf,
+			size_t count, int flags)
+{
+	struct emu_xbuf *xbuf = e->priv;
+
+	return ring_write(flags & EMU_IO_OOB ? &xbuf->obnd : &xbuf->ibnd,
+			buf, count, flags);
+}
+
+/* evl_poll() is for oob callers, which read inbound data. */
+static int xbuf_poll(struct emu_element *e)
+{
+	struct emu_xbuf *xbuf = e->priv;
+	int events = 0;
+
+	if (xbuf->ibnd.fillsz)
+		events |= POLLIN|POLLRDNORM;
+
+	if (xbuf->obnd.size && xbuf->obnd.fillsz < xbuf->obnd.size)
+		events |= POLLOUT|POLLWRNORM;
+
+	return events;
+}
+
+const struct emu_class emu_xbuf_class = {
+	.name = EVL_XBUF_DEV,
+	.type = EMU_XBUF,
+	.create = xbuf_create,
+	.destroy = xbuf_destroy,
+	.read = xbuf_read,
+	.write = xbuf_write,
+	.poll = xbuf_poll,
+};
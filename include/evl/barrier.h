@@ -0,0 +1,62 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _EVL_BARRIER_H
+#define _EVL_BARRIER_H
+
+#include <evl/atomic.h>
+#include <evl/mutex-evl.h>
+#include <evl/event.h>
+
+/*
+ * A reusable barrier for a fixed group of threads. Arrivals are
+ * counted in user space. Waiters sleep on an event until the
+ * generation moves on, the last thread to arrive bumps it then
+ * releases all of them with a single broadcast. The generation only
+ * changes under the lock gating the event, so that no sleeper can
+ * miss the broadcast of its round.
+ */
+struct evl_barrier {
+	unsigned int magic;
+	unsigned int count;
+	atomic_t arrived;
+	atomic_t generation;
+	struct evl_mutex lock;
+	struct evl_event released;
+};
+
+#define __BARRIER_UNINIT_MAGIC	0x8a3e8a3e
+
+#define EVL_BARRIER_SERIAL	1
+
+#define EVL_BARRIER_INITIALIZER(__count)				\
+	(struct evl_barrier) {						\
+		.magic = __BARRIER_UNINIT_MAGIC,			\
+		.count = (__count),					\
+		.arrived = 0,						\
+		.generation = 0,					\
+	}
+
+#define DEFINE_EVL_BARRIER(__name, __count)	\
+	struct evl_barrier __name = EVL_BARRIER_INITIALIZER(__count)
+
+#define evl_new_barrier(__barrier, __count)	\
+	evl_create_barrier(__barrier, __count)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int evl_create_barrier(struct evl_barrier *barrier,
+		unsigned int count);
+
+int evl_destroy_barrier(struct evl_barrier *barrier);
+
+int evl_wait_barrier(struct evl_barrier *barrier);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EVL_BARRIER_H */
@@ -7,6 +7,7 @@
 #ifndef _EVL_EVL_H
 #define _EVL_EVL_H
 
+#include <sys/types.h>
 #include <signal.h>
 #include <evl/clock.h>
 #include <evl/mutex.h>
@@ -20,9 +21,14 @@
 #include <evl/poll.h>
 #include <evl/proxy.h>
 #include <evl/rwlock.h>
+#include <evl/barrier.h>
+#include <evl/latch.h>
+#include <evl/lockstat.h>
+#include <evl/fpstats.h>
+#include <evl/log.h>
 #include <evl/control.h>
 
-#define __EVL__  26	/* API version */
+#define __EVL__  27	/* API version */
 
 #define EVL_ABI_PREREQ  32
 
@@ -36,6 +42,20 @@ struct evl_version {
 	const char *version_string;
 };
 
+/*
+ * What evl_prepare_rt() did to bring the process to steady state.
+ * Sizes are in bytes, locked_bytes is the amount of memory the
+ * kernel reports as locked for the process (VmLck), or -1 if
+ * unknown.
+ */
+struct evl_rt_report {
+	int mlock_status;	/* 0 or -errno from mlockall() */
+	size_t stack_bytes;
+	size_t heap_bytes;
+	size_t shm_bytes;
+	ssize_t locked_bytes;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -46,6 +66,11 @@ void evl_sigdebug_handler(int sig, siginfo_t *si, void *ctxt);
 
 struct evl_version evl_get_version(void);
 
+int evl_prepare_rt(size_t stack_size, size_t heap_size,
+		struct evl_rt_report *report);
+
+ssize_t evl_prefault_stack(size_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,31 @@ struct evl_flags {
 		}							\
 	}
 
+/*
+ * A set of flag groups a thread may wait on at once, each group with
+ * its own wait mask. The underlying poll descriptor is set up once
+ * by evl_create_flags_waitset(), so that waiting costs no setup.
+ * While a thread blocks on a waitset, the bits posted to a group
+ * outside of its mask are set aside, then posted back to the group
+ * when the wait returns. Other waiters of the group only get them
+ * at that point.
+ */
+struct evl_flags_group {
+	struct evl_flags *flags;
+	int bits;
+};
+
+struct evl_poll_event;
+
+struct evl_flags_waitset {
+	unsigned int magic;
+	int pollfd;
+	int nr;
+	struct evl_flags_group *groups;
+	struct evl_poll_event *pollset;
+	int *foreign;
+};
+
 #define DEFINE_EVL_FLAGS(__name)				\
   	struct evl_flags __name =				\
 	  EVL_FLAGS_INITIALIZER(#__name, EVL_CLOCK_MONOTONIC,	\
@@ -66,6 +91,9 @@ int evl_create_flags(struct evl_flags *flg,
 int evl_open_flags(struct evl_flags *flg,
 		const char *fmt, ...);
 
+int evl_create_flags_array(struct evl_flags *flgs, int nr,
+			int clockfd, int initval, int flags);
+
 int evl_close_flags(struct evl_flags *flg);
 
 int evl_timedwait_some_flags(struct evl_flags *flg, int bits,
@@ -106,6 +134,21 @@ int evl_broadcast_flags(struct evl_flags *flg,
 int evl_peek_flags(struct evl_flags *flg,
 		int *r_bits);
 
+int evl_create_flags_waitset(struct evl_flags_waitset *ws,
+			struct evl_flags_group *groups, int nr);
+
+int evl_destroy_flags_waitset(struct evl_flags_waitset *ws);
+
+int evl_timedwait_any_flags(struct evl_flags_waitset *ws,
+			const struct timespec *timeout,
+			int *r_bits);
+
+int evl_wait_any_flags(struct evl_flags_waitset *ws,
+		int *r_bits);
+
+int evl_trywait_any_flags(struct evl_flags_waitset *ws,
+			int *r_bits);
+
 #ifdef __cplusplus
 }
 #endif
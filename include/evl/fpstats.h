@@ -0,0 +1,54 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _EVL_FPSTATS_H
+#define _EVL_FPSTATS_H
+
+#include <sys/types.h>
+#include <evl/instr.h>
+
+/*
+ * Fast path statistics, collected by the EVL_INSTR_FPSTATS
+ * instrumentation set. For each instrumented entry point, an
+ * attached thread counts the calls which completed from user space
+ * (fast), those which had to issue a request to the core (slow), and
+ * among the latter, how many ended up with the caller running on a
+ * different stage than it started from (switches).
+ */
+enum evl_fpstat_entry {
+	EVL_FPSTAT_LOCK_MUTEX,
+	EVL_FPSTAT_TRYLOCK_MUTEX,
+	EVL_FPSTAT_UNLOCK_MUTEX,
+	EVL_FPSTAT_GET_SEM,
+	EVL_FPSTAT_PUT_SEM,
+	EVL_FPSTAT_WAIT_FLAGS,
+	EVL_FPSTAT_POST_FLAGS,
+	EVL_FPSTAT_NR_ENTRIES,
+};
+
+struct evl_fpstat {
+	unsigned long fast;
+	unsigned long slow;
+	unsigned long switches;
+};
+
+struct evl_fpstats {
+	struct evl_fpstat entries[EVL_FPSTAT_NR_ENTRIES];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int evl_get_thread_fpstats(struct evl_fpstats *stats);
+
+int evl_get_fpstats(struct evl_fpstats *stats);
+
+const char *evl_fpstat_name(enum evl_fpstat_entry entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EVL_FPSTATS_H */
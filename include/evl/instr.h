@@ -0,0 +1,43 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _EVL_INSTR_H
+#define _EVL_INSTR_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Instrumentation counter sets. Each set is off by default, it is
+ * enabled at init time if its environment variable is set to
+ * anything but "0", or by calling evl_enable_instr(). Setting the
+ * variable to "1" dumps the figures to stderr on exit, any other
+ * value names the file which should receive them instead. Each
+ * thread counts into private blocks, so that no lock or shared
+ * cache line is involved on the hot path.
+ *
+ * See evl/lockstat.h and evl/fpstats.h for the figures each set
+ * collects.
+ */
+enum evl_instr_id {
+	EVL_INSTR_LOCKSTAT,	/* EVL_LOCKSTAT */
+	EVL_INSTR_FPSTATS,	/* EVL_FPSTATS */
+	EVL_INSTR_NR_SETS,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int evl_enable_instr(enum evl_instr_id id, bool enabled);
+
+bool evl_instr_enabled(enum evl_instr_id id);
+
+int evl_dump_instr(enum evl_instr_id id, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EVL_INSTR_H */
@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _EVL_LATCH_H
+#define _EVL_LATCH_H
+
+#include <time.h>
+#include <evl/atomic.h>
+#include <evl/sem.h>
+
+/*
+ * A one-shot countdown latch. Counting down is a plain atomic
+ * operation in user space until the count drops to zero, at which
+ * point the thread which opened the latch releases all registered
+ * waiters at once.
+ */
+struct evl_latch {
+	unsigned int magic;
+	atomic_t count;
+	atomic_t waiters;
+	struct evl_sem gate;
+};
+
+#define __LATCH_UNINIT_MAGIC	0x3c6d3c6d
+
+#define EVL_LATCH_INITIALIZER(__count)					\
+	(struct evl_latch) {						\
+		.magic = __LATCH_UNINIT_MAGIC,				\
+		.count = (__count),					\
+		.waiters = 0,						\
+	}
+
+#define DEFINE_EVL_LATCH(__name, __count)	\
+	struct evl_latch __name = EVL_LATCH_INITIALIZER(__count)
+
+#define evl_new_latch(__latch, __count)	\
+	evl_create_latch(__latch, __count)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int evl_create_latch(struct evl_latch *latch,
+		int count);
+
+int evl_destroy_latch(struct evl_latch *latch);
+
+int evl_count_down_latch(struct evl_latch *latch,
+			int count);
+
+int evl_wait_latch(struct evl_latch *latch);
+
+int evl_timedwait_latch(struct evl_latch *latch,
+			const struct timespec *timeout);
+
+int evl_trywait_latch(struct evl_latch *latch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EVL_LATCH_H */
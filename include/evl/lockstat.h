@@ -0,0 +1,50 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _EVL_LOCKSTAT_H
+#define _EVL_LOCKSTAT_H
+
+#include <sys/types.h>
+#include <linux/types.h>
+#include <evl/instr.h>
+
+/*
+ * Lock contention statistics, collected by the EVL_INSTR_LOCKSTAT
+ * instrumentation set. Each attached thread records events into a
+ * private table. The per-thread tables are merged on request by
+ * evl_get_lockstat().
+ *
+ * All durations are expressed in nanoseconds, based on
+ * EVL_CLOCK_MONOTONIC.
+ */
+enum evl_lockstat_type {
+	EVL_LOCKSTAT_MUTEX,
+	EVL_LOCKSTAT_EVENT,
+	EVL_LOCKSTAT_RWLOCK_RD,
+	EVL_LOCKSTAT_RWLOCK_WR,
+};
+
+struct evl_lockstat {
+	const void *lock;
+	enum evl_lockstat_type type;
+	unsigned long acquired;	/* successful acquisitions or waits */
+	unsigned long contended; /* requests which went the slow path */
+	__u64 wait_total;
+	__u64 wait_max;
+	__u64 hold_total;
+	__u64 hold_max;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ssize_t evl_get_lockstat(struct evl_lockstat *stats,
+			size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EVL_LOCKSTAT_H */
@@ -0,0 +1,147 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _EVL_LOG_H
+#define _EVL_LOG_H
+
+#include <sys/types.h>
+#include <linux/types.h>
+
+/*
+ * Deferred formatting logger. evl_log() only records the format
+ * string pointer, a timestamp and the raw arguments into a ring
+ * owned by the calling thread, an in-band logger thread formats the
+ * records later on and writes them out. Therefore the format string
+ * must be a literal or live for the whole process lifetime. String
+ * arguments are copied into the record, up to EVL_LOG_MAX_STRING
+ * bytes, %p still prints their address. Long doubles are stored as
+ * doubles. evl_log() accepts up to
+ * EVL_LOG_MAX_ARGS arguments, which are type-checked against the
+ * format at build time. The record is dropped if the ring is full,
+ * the call never blocks.
+ */
+#define EVL_LOG_MAX_ARGS	8
+#define EVL_LOG_MAX_STRING	256
+
+enum evl_log_type {
+	EVL_LOG_INT,
+	EVL_LOG_UINT,
+	EVL_LOG_DOUBLE,
+	EVL_LOG_STRING,
+	EVL_LOG_POINTER,
+};
+
+struct evl_log_arg {
+	enum evl_log_type type;
+	union {
+		long long i;
+		unsigned long long u;
+		double d;
+		const void *p;
+	} v;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int evl_start_logger(int fd, size_t ring_size, __u64 period_ns);
+
+int evl_stop_logger(void);
+
+int evl_flush_log(void);
+
+unsigned long evl_log_drops(void);
+
+int __evl_log(const char *fmt, int nargs,
+	const struct evl_log_arg *args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifndef __cplusplus
+
+static inline __attribute__ ((format (printf, 1, 2)))
+void __evl_log_check(const char *fmt, ...)
+{ }
+
+static inline struct evl_log_arg __evl_log_int(long long v)
+{
+	return (struct evl_log_arg){ .type = EVL_LOG_INT, .v.i = v };
+}
+
+static inline struct evl_log_arg __evl_log_uint(unsigned long long v)
+{
+	return (struct evl_log_arg){ .type = EVL_LOG_UINT, .v.u = v };
+}
+
+static inline struct evl_log_arg __evl_log_double(double v)
+{
+	return (struct evl_log_arg){ .type = EVL_LOG_DOUBLE, .v.d = v };
+}
+
+static inline struct evl_log_arg __evl_log_string(const char *v)
+{
+	return (struct evl_log_arg){ .type = EVL_LOG_STRING, .v.p = v };
+}
+
+static inline struct evl_log_arg __evl_log_pointer(const void *v)
+{
+	return (struct evl_log_arg){ .type = EVL_LOG_POINTER, .v.p = v };
+}
+
+#define __evl_log_arg(__x)						\
+	_Generic((__x),							\
+		_Bool: __evl_log_uint,					\
+		char: __evl_log_int,					\
+		signed char: __evl_log_int,				\
+		unsigned char: __evl_log_uint,				\
+		short: __evl_log_int,					\
+		unsigned short: __evl_log_uint,				\
+		int: __evl_log_int,					\
+		unsigned int: __evl_log_uint,				\
+		long: __evl_log_int,					\
+		unsigned long: __evl_log_uint,				\
+		long long: __evl_log_int,				\
+		unsigned long long: __evl_log_uint,			\
+		float: __evl_log_double,				\
+		double: __evl_log_double,				\
+		long double: __evl_log_double,				\
+		char *: __evl_log_string,				\
+		const char *: __evl_log_string,				\
+		default: __evl_log_pointer)(__x)
+
+#define __evl_log_nargs(__args...)					\
+	__evl_log_nargs_(0, ##__args, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define __evl_log_nargs_(__0, __1, __2, __3, __4, __5, __6, __7, __8,	\
+			__n, __rest...)	__n
+
+#define __evl_log_args_0()
+#define __evl_log_args_1(__a)		__evl_log_arg(__a)
+#define __evl_log_args_2(__a, __r...)	__evl_log_arg(__a), __evl_log_args_1(__r)
+#define __evl_log_args_3(__a, __r...)	__evl_log_arg(__a), __evl_log_args_2(__r)
+#define __evl_log_args_4(__a, __r...)	__evl_log_arg(__a), __evl_log_args_3(__r)
+#define __evl_log_args_5(__a, __r...)	__evl_log_arg(__a), __evl_log_args_4(__r)
+#define __evl_log_args_6(__a, __r...)	__evl_log_arg(__a), __evl_log_args_5(__r)
+#define __evl_log_args_7(__a, __r...)	__evl_log_arg(__a), __evl_log_args_6(__r)
+#define __evl_log_args_8(__a, __r...)	__evl_log_arg(__a), __evl_log_args_7(__r)
+
+#define __evl_log_paste(__a, __b)	__evl_log_paste_(__a, __b)
+#define __evl_log_paste_(__a, __b)	__a ## __b
+
+#define evl_log(__fmt, __args...)					\
+	({								\
+		if (0)							\
+			__evl_log_check(__fmt, ##__args);		\
+		__evl_log(__fmt, __evl_log_nargs(__args),		\
+			(const struct evl_log_arg []){			\
+				__evl_log_paste(__evl_log_args_,	\
+					__evl_log_nargs(__args))(__args) \
+			});						\
+	})
+
+#endif /* !__cplusplus */
+
+#endif /* _EVL_LOG_H */
@@ -15,12 +15,28 @@
 
 #define EVL_MUTEX_NORMAL     (0 << 0)
 #define EVL_MUTEX_RECURSIVE  (1 << 0)
+#define EVL_MUTEX_LAZY       (1 << 1)
 
 #define __MUTEX_UNINIT_MAGIC	0xfe11fe11
 #define __MUTEX_ACTIVE_MAGIC	0xab12ab12
 
+/*
+ * A statically initialized, non-recursive PI mutex with
+ * EVL_MUTEX_LAZY set lives on the lazy_owner word until some thread
+ * contends for it, at which point the core element is created and
+ * ownership is passed to it.
+ */
+#define __MUTEX_LAZY_MARK	0x40000000U
+#define __MUTEX_LAZY_INFLATE	0x80000000U
+
+#define __MUTEX_LAZY_INIT(__ceiling, __flags)				\
+	(((__flags) & (EVL_MUTEX_LAZY|EVL_MUTEX_RECURSIVE)) ==		\
+		EVL_MUTEX_LAZY && (__ceiling) == 0 ?			\
+		__MUTEX_LAZY_MARK : 0)
+
 struct evl_mutex {
 	unsigned int magic;
+	uatomic_t lazy_owner;
 	union {
 		struct {
 			fundle_t fundle;
@@ -42,6 +58,7 @@ struct evl_mutex {
 #define EVL_MUTEX_INITIALIZER(__name, __clockfd, __ceiling, __flags)	\
 	(struct evl_mutex) {						\
 		.magic = __MUTEX_UNINIT_MAGIC,				\
+		.lazy_owner = __MUTEX_LAZY_INIT(__ceiling, __flags),	\
 		.u = {							\
 			.uninit = {					\
 				.name = (__name),			\
@@ -58,6 +75,11 @@ struct evl_mutex {
 	  EVL_MUTEX_INITIALIZER(#__name, EVL_CLOCK_MONOTONIC,		\
 				0, EVL_MUTEX_NORMAL|EVL_CLONE_PRIVATE)
 
+#define DEFINE_EVL_LAZY_MUTEX(__name)					\
+  	struct evl_mutex __name =					\
+	  EVL_MUTEX_INITIALIZER(#__name, EVL_CLOCK_MONOTONIC,		\
+				0, EVL_MUTEX_LAZY|EVL_CLONE_PRIVATE)
+
 #define evl_new_mutex(__mutex, __fmt, __args...)		\
 	evl_create_mutex(__mutex, EVL_CLOCK_MONOTONIC,		\
 			0, EVL_MUTEX_NORMAL|EVL_CLONE_PRIVATE,	\
@@ -74,6 +96,9 @@ int evl_create_mutex(struct evl_mutex *mutex,
 int evl_open_mutex(struct evl_mutex *mutex,
 		const char *fmt, ...);
 
+int evl_create_mutex_array(struct evl_mutex *mutexes, int nr,
+			int clockfd, unsigned int ceiling, int flags);
+
 int evl_lock_mutex(struct evl_mutex *mutex);
 
 int evl_timedlock_mutex(struct evl_mutex *mutex,
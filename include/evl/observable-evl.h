@@ -7,8 +7,11 @@
 #ifndef _EVL_OBSERVABLE_EVL_H
 #define _EVL_OBSERVABLE_EVL_H
 
+#include <sys/types.h>
 #include <time.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <linux/types.h>
 #include <evl/syscall.h>
 #include <evl/observable.h>
 #include <evl/factory.h>
@@ -21,6 +24,70 @@ struct evl_notification {
 	struct timespec date;
 };
 
+/*
+ * Delivery latency of notifications, i.e. the time elapsed between
+ * the update of the observable and the read request which returned
+ * the notification. Bucket n counts latencies in the [2^n, 2^(n+1))
+ * nanosecond range, the last bucket collects all larger values.
+ */
+#define EVL_LATENCY_BUCKETS	32
+
+struct evl_notify_latency {
+	unsigned long buckets[EVL_LATENCY_BUCKETS];
+	unsigned long count;
+	__u64 min_ns;
+	__u64 max_ns;
+	__u64 sum_ns;
+};
+
+/*
+ * A publisher accumulates notices on behalf of an observable, then
+ * posts them in a single update once max_count notices are pending,
+ * or max_delay_ns nanoseconds after the oldest pending one. The
+ * deadline is tracked by an EVL timer, which the caller should poll
+ * for readability via tfd, calling evl_expire_publisher() upon
+ * wakeup. Only the latest value is kept for coalescable tags, the
+ * pending notice is moved to the end of the queue on each update.
+ */
+struct evl_publisher_stats {
+	unsigned long published;
+	unsigned long coalesced;
+	unsigned long sent;
+	unsigned long flushes;
+	unsigned long dropped;	/* Not accepted by the observable. */
+};
+
+struct evl_publisher {
+	int ofd;
+	int tfd;	/* -1 without deadline. */
+	int max_count;
+	__u64 max_delay_ns;
+	int nr_pending;
+	__u64 first_stamp;
+	struct evl_notice *pending;
+	int nr_coalescable;
+	__u32 *coalescable;
+	struct evl_publisher_stats stats;
+};
+
+/*
+ * Latest-value channel. The last notice issued for each tag is
+ * published into a seqlock-protected slot of a shared memory
+ * segment, which readers sample without issuing any system call,
+ * while the observable keeps conveying the full notification
+ * stream to its subscribers. There may be only a single publisher
+ * per tag. Other processes may share the channel by calling
+ * evl_open_latest_values() on a copy of memfd.
+ */
+struct evl_latest_values {
+	int ofd;
+	int memfd;
+	void *base;
+	size_t len;
+	int nr_slots;
+	pid_t issuer;
+};
+
 #define evl_new_observable(__fmt, __args...)	\
 	evl_create_observable(EVL_CLONE_PRIVATE, __fmt, ##__args)
 
@@ -36,6 +103,44 @@ int evl_update_observable(int ofd, const struct evl_notice *ntc,
 int evl_read_observable(int ofd, struct evl_notification *nf,
 			int nr);
 
+int evl_read_observable_stamped(int ofd, struct evl_notification *nf,
+				int nr, struct timespec *delivered,
+				struct evl_notify_latency *lat);
+
+void evl_reset_notify_latency(struct evl_notify_latency *lat);
+
+__u64 evl_get_latency_percentile(const struct evl_notify_latency *lat,
+				unsigned int percent);
+
+int evl_create_latest_values(struct evl_latest_values *lv,
+			int ofd, int nr_tags);
+
+int evl_open_latest_values(struct evl_latest_values *lv,
+			int ofd, int memfd);
+
+int evl_close_latest_values(struct evl_latest_values *lv);
+
+int evl_update_latest(struct evl_latest_values *lv,
+		const struct evl_notice *ntc, int nr);
+
+int evl_read_latest(struct evl_latest_values *lv, __u32 tag,
+		struct evl_notification *nf);
+
+int evl_init_publisher(struct evl_publisher *pub, int ofd,
+		int max_count, __u64 max_delay_ns);
+
+int evl_set_coalescing(struct evl_publisher *pub,
+		__u32 tag, bool enabled);
+
+int evl_publish(struct evl_publisher *pub,
+		__u32 tag, union evl_value event);
+
+int evl_flush_publisher(struct evl_publisher *pub);
+
+int evl_expire_publisher(struct evl_publisher *pub);
+
+int evl_destroy_publisher(struct evl_publisher *pub);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,9 +8,11 @@
 #define _EVL_PROXY_EVL_H
 
 #include <stdarg.h>
+#include <stdbool.h>
 #include <sys/types.h>
 #include <linux/types.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <evl/proxy.h>
 #include <evl/factory.h>
 
@@ -18,6 +20,46 @@
 	evl_create_proxy(__targetfd, __bufsz, 0, EVL_CLONE_PRIVATE,	\
 			__fmt, ##__args)
 
+/*
+ * Rotation policy of a file proxy. The current file is rotated once
+ * it grows past max_size bytes or has been open for max_age_ns
+ * nanoseconds, whichever comes first (zero disables either
+ * limit). Up to keep rotated files are retained as <path>.1 (most
+ * recent) to <path>.<keep>, which are gzipped if compress is set.
+ */
+struct evl_rotation {
+	size_t max_size;
+	__u64 max_age_ns;
+	int keep;
+	bool compress;
+};
+
+struct evl_file_proxy_stats {
+	unsigned long long written;	/* Bytes written to files. */
+	unsigned long rotations;
+	unsigned long overflows;	/* Writes which did not fit. */
+	unsigned long long lost;	/* Bytes dropped on overflow. */
+	unsigned long errors;		/* Failed file operations. */
+};
+
+struct evl_file_proxy {
+	int efd;
+	int pipefd[2];
+	int filefd;
+	char *path;
+	struct evl_rotation rotation;
+	pthread_t drainer;
+	pthread_mutex_t lock;
+	pid_t compressor;
+	size_t filesz;
+	__u64 opened_at;
+	struct evl_file_proxy_stats stats;
+};
+
+#define evl_new_file_proxy(__fp, __path, __bufsz, __rotation, __fmt, __args...) \
+	evl_create_file_proxy(__fp, __path, __bufsz, __rotation,	\
+			EVL_CLONE_PRIVATE, __fmt, ##__args)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -42,6 +84,28 @@ ssize_t evl_printf(const char *fmt, ...);
 
 ssize_t evl_eprintf(const char *fmt, ...);
 
+int evl_set_print_batching(size_t bufsz, __u64 max_delay_ns);
+
+int evl_flush_print(void);
+
+int evl_create_file_proxy(struct evl_file_proxy *fp,
+			const char *path, size_t bufsz,
+			const struct evl_rotation *rotation,
+			int flags, const char *fmt, ...);
+
+ssize_t evl_write_file_proxy(struct evl_file_proxy *fp,
+			const void *buf, size_t count);
+
+ssize_t evl_print_file_proxy(struct evl_file_proxy *fp,
+			const char *fmt, ...);
+
+int evl_rotate_file_proxy(struct evl_file_proxy *fp);
+
+int evl_get_file_proxy_stats(struct evl_file_proxy *fp,
+			struct evl_file_proxy_stats *stats);
+
+int evl_close_file_proxy(struct evl_file_proxy *fp);
+
 int evl_stdout(void);
 
 int evl_stderr(void);
@@ -14,13 +14,18 @@
 #include <evl/clock.h>
 #include <evl/factory.h>
 
+struct evl_sem_bulk;
+
 struct evl_sem {
 	unsigned int magic;
 	union {
 		struct {
 			fundle_t fundle;
+			int clockfd;
 			struct evl_monitor_state *state;
 			int efd;
+			int flags;
+			struct evl_sem_bulk *bulk;
 		} active;
 		struct {
 			const char *name;
@@ -66,19 +71,41 @@ int evl_create_sem(struct evl_sem *sem,
 int evl_open_sem(struct evl_sem *sem,
 		 const char *fmt, ...);
 
+int evl_create_sem_array(struct evl_sem *sems, int nr,
+			int clockfd, int initval, int flags);
+
 int evl_close_sem(struct evl_sem *sem);
 
 int evl_get_sem(struct evl_sem *sem);
 
+/*
+ * Multi-unit getters only take units when all of them are available
+ * at once. Since posts issued by other processes cannot wake them up,
+ * public semaphores only accept single-unit blocking gets, count > 1
+ * is rejected with -EINVAL. evl_tryget_sem_n() does not have such
+ * restriction.
+ */
+int evl_get_sem_n(struct evl_sem *sem,
+		int count);
+
 int evl_timedget_sem(struct evl_sem *sem,
 		const struct timespec *timeout);
 
+int evl_timedget_sem_n(struct evl_sem *sem, int count,
+		const struct timespec *timeout);
+
 int evl_put_sem(struct evl_sem *sem);
 
+int evl_put_sem_n(struct evl_sem *sem,
+		int count);
+
 int evl_flush_sem(struct evl_sem *sem);
 
 int evl_tryget_sem(struct evl_sem *sem);
 
+int evl_tryget_sem_n(struct evl_sem *sem,
+		int count);
+
 int evl_peek_sem(struct evl_sem *sem,
 		int *r_val);
 
@@ -10,6 +10,21 @@
 #include <stdarg.h>
 #include <evl/factory.h>
 
+/* Bulk creation request, see evl_create_element_array(). */
+struct evl_element_req {
+	const char *name;
+	void *attrs;
+	int clone_flags;
+	/* On return: */
+	int efd;
+	struct evl_element_ids eids;
+};
+
+/* Modes of the element descriptor cache, see evl_set_open_cache(). */
+#define EVL_OPEN_CACHE_OFF	0
+#define EVL_OPEN_CACHE_DUP	1
+#define EVL_OPEN_CACHE_SHARE	2
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -20,6 +35,10 @@ int evl_create_element(const char *type,
 		       int clone_flags,
 		       struct evl_element_ids *eids);
 
+int evl_create_element_array(const char *type,
+			struct evl_element_req *reqs,
+			int nr);
+
 int evl_open_element_vargs(const char *type,
 			const char *fmt, va_list ap);
 
@@ -28,6 +47,12 @@ int evl_open_element(const char *type,
 
 int evl_open_raw(const char *type);
 
+int evl_set_open_cache(int mode);
+
+void evl_flush_open_cache(void);
+
+int evl_close_element(int efd);
+
 int evl_get_current_mode(void);
 
 unsigned int evl_detect_fpu(void);
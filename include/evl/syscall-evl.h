@@ -10,6 +10,34 @@
 #include <sys/types.h>
 #include <evl/syscall.h>
 
+/*
+ * Cancellation behavior of oob_read(), oob_write() and oob_ioctl().
+ * By default, these calls switch the caller to asynchronous
+ * cancellation for the duration of the syscall.
+ */
+#define EVL_OOB_CANCEL_DEFAULT	0  /* Follow the process-wide setting. */
+#define EVL_OOB_CANCEL_ASYNC	1  /* Cancellable during the syscall. */
+#define EVL_OOB_CANCEL_NONE	2  /* Never switch the cancellation type. */
+
+/*
+ * A batch of independent out-of-band requests, see
+ * evl_submit_batch().
+ */
+#define EVL_BATCH_IOCTL		0
+#define EVL_BATCH_READ		1
+#define EVL_BATCH_WRITE		2
+
+#define EVL_BATCH_STOP_ON_ERROR	0x1
+
+struct evl_batch_op {
+	int type;
+	int fd;
+	unsigned long request;	/* EVL_BATCH_IOCTL */
+	void *arg;		/* ioctl argument or I/O buffer */
+	size_t count;		/* EVL_BATCH_READ, EVL_BATCH_WRITE */
+	ssize_t result;		/* Request status on return. */
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -20,6 +48,19 @@ ssize_t oob_write(int efd, const void *buf, size_t count);
 
 int oob_ioctl(int efd, unsigned long request, ...);
 
+ssize_t oob_read_nocancel(int efd, void *buf, size_t count);
+
+ssize_t oob_write_nocancel(int efd, const void *buf, size_t count);
+
+int oob_ioctl_nocancel(int efd, unsigned long request, ...);
+
+int evl_set_oob_cancel(int mode);
+
+int evl_set_oob_cancel_default(int mode);
+
+int evl_submit_batch(struct evl_batch_op *ops,
+		int nr, int flags);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,8 @@
 #define _EVL_XBUF_EVL_H
 
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <stdbool.h>
 #include <evl/syscall.h>
 #include <evl/syscall-evl.h>
 #include <evl/xbuf.h>
@@ -17,6 +19,80 @@
 	evl_create_xbuf(__bufsz, __bufsz, EVL_CLONE_PRIVATE, \
 			__fmt, ##__args)
 
+/*
+ * A mapped xbuf moves the data through a pair of single-producer,
+ * single-consumer rings shared with the application, the underlying
+ * xbuf only carries the wakeup notifications between the
+ * stages. Like with a regular xbuf, the inbound ring conveys data
+ * from the in-band stage to the out-of-band stage, the outbound ring
+ * goes the other way. Each ring is mapped twice back-to-back, so
+ * that every reservation or readable span is contiguous in memory.
+ * A zero buffer size leaves the corresponding ring out, accessing it
+ * fails with -ENXIO. The rings are private to the creating process,
+ * mapped xbufs cannot be EVL_CLONE_PUBLIC.
+ */
+struct evl_xbuf_ring_state;
+
+struct evl_xbuf_ring {
+	struct evl_xbuf_ring_state *state;
+	void *data;
+	size_t size;
+	int efd;
+	bool oob_producer;
+	unsigned int cpos;	/* Consumer position at last peek. */
+};
+
+/* What a producer gets when reserving space in a full ring. */
+enum evl_xbuf_policy {
+	EVL_XBUF_REJECT,	/* -EAGAIN (default) */
+	EVL_XBUF_OVERWRITE,	/* Drop the oldest records. */
+};
+
+struct evl_xbuf_stats {
+	size_t size;		/* Ring size */
+	size_t pending;		/* Bytes the reader lags behind */
+	size_t high_water;	/* Highest fill level, in bytes */
+	unsigned long long dropped;	/* Bytes overwritten */
+	unsigned long long would_block;	/* Reservations hitting a full ring */
+};
+
+struct evl_mapped_xbuf {
+	int efd;
+	int memfd;
+	void *base;
+	size_t len;
+	struct evl_xbuf_ring inbound;	/* in-band -> oob */
+	struct evl_xbuf_ring outbound;	/* oob -> in-band */
+};
+
+#define evl_new_mapped_xbuf(__xm, __bufsz, __fmt, __args...)	\
+	evl_create_mapped_xbuf(__xm, __bufsz, __bufsz,		\
+			EVL_CLONE_PRIVATE, __fmt, ##__args)
+
+/*
+ * A framed xbuf preserves record boundaries over a regular xbuf:
+ * each record travels with a length header, and the reader side
+ * buffers whatever follows the last complete record it returned.
+ * A framed xbuf supports one reader and one writer at a time. The
+ * staging buffers are bounded by the size of the ring each side
+ * uses: in-band writers and out-of-band readers go through the
+ * inbound ring, out-of-band writers and in-band readers through the
+ * outbound one.
+ */
+struct evl_framed_xbuf {
+	int efd;
+	size_t i_bufsz;
+	size_t o_bufsz;
+	void *wbuf;
+	void *rbuf;
+	size_t rhead;		/* Next pending byte in rbuf. */
+	size_t rtail;		/* End of pending bytes in rbuf. */
+};
+
+#define evl_new_framed_xbuf(__xf, __bufsz, __fmt, __args...)	\
+	evl_create_framed_xbuf(__xf, __bufsz, __bufsz,		\
+			EVL_CLONE_PRIVATE, __fmt, ##__args)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -24,6 +100,47 @@ extern "C" {
 int evl_create_xbuf(size_t i_bufsz, size_t o_bufsz,
 		int flags, const char *fmt, ...);
 
+int evl_create_mapped_xbuf(struct evl_mapped_xbuf *xm,
+			size_t i_bufsz, size_t o_bufsz,
+			int flags, const char *fmt, ...);
+
+int evl_close_mapped_xbuf(struct evl_mapped_xbuf *xm);
+
+int evl_reserve_xbuf(struct evl_xbuf_ring *ring,
+		size_t size, void **bufp);
+
+int evl_commit_xbuf(struct evl_xbuf_ring *ring, size_t size);
+
+ssize_t evl_peek_xbuf(struct evl_xbuf_ring *ring, void **bufp);
+
+ssize_t evl_wait_xbuf(struct evl_xbuf_ring *ring, void **bufp);
+
+int evl_release_xbuf(struct evl_xbuf_ring *ring, size_t size);
+
+ssize_t evl_drain_xbuf(struct evl_xbuf_ring *ring,
+		void *buf, size_t len);
+
+int evl_set_xbuf_policy(struct evl_xbuf_ring *ring,
+			enum evl_xbuf_policy policy, size_t recsz);
+
+int evl_get_xbuf_stats(struct evl_xbuf_ring *ring,
+		struct evl_xbuf_stats *stats);
+
+int evl_create_framed_xbuf(struct evl_framed_xbuf *xf,
+			size_t i_bufsz, size_t o_bufsz,
+			int flags, const char *fmt, ...);
+
+int evl_open_framed_xbuf(struct evl_framed_xbuf *xf, int efd,
+			size_t i_bufsz, size_t o_bufsz);
+
+int evl_close_framed_xbuf(struct evl_framed_xbuf *xf);
+
+ssize_t evl_writev_xbuf(struct evl_framed_xbuf *xf,
+			const struct iovec *iov, int iovcnt);
+
+ssize_t evl_readv_xbuf(struct evl_framed_xbuf *xf,
+		struct iovec *iov, int iovcnt);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,40 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _LIB_EVL_ARM_SYSCALL_H
+#define _LIB_EVL_ARM_SYSCALL_H
+
+/*
+ * Raw syscall stub, bypassing libc. The return value is the one
+ * received from the kernel, i.e. -errno on error.
+ *
+ * EABI only. In Thumb mode, r7 may serve as the frame pointer which
+ * we cannot clobber from inline assembly, let libc deal with this
+ * case.
+ */
+#if defined(__ARM_EABI__) && !defined(__thumb__)
+
+#define __EVL_HAVE_RAW_SYSCALL
+
+static inline long __evl_raw_syscall5(long nr, long a0, long a1,
+				long a2, long a3, long a4)
+{
+	register long r7 __asm__ ("r7") = nr;
+	register long r0 __asm__ ("r0") = a0;
+	register long r1 __asm__ ("r1") = a1;
+	register long r2 __asm__ ("r2") = a2;
+	register long r3 __asm__ ("r3") = a3;
+	register long r4 __asm__ ("r4") = a4;
+
+	__asm__ __volatile__ ("swi #0"
+			: "+r" (r0)
+			: "r" (r7), "r" (r1), "r" (r2), "r" (r3), "r" (r4)
+			: "memory");
+
+	return r0;
+}
+
+#endif	/* __ARM_EABI__ && !__thumb__ */
+
+#endif /* !_LIB_EVL_ARM_SYSCALL_H */
@@ -0,0 +1,32 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _LIB_EVL_ARM64_SYSCALL_H
+#define _LIB_EVL_ARM64_SYSCALL_H
+
+/*
+ * Raw syscall stub, bypassing libc. The return value is the one
+ * received from the kernel, i.e. -errno on error.
+ */
+#define __EVL_HAVE_RAW_SYSCALL
+
+static inline long __evl_raw_syscall5(long nr, long a0, long a1,
+				long a2, long a3, long a4)
+{
+	register long x8 __asm__ ("x8") = nr;
+	register long x0 __asm__ ("x0") = a0;
+	register long x1 __asm__ ("x1") = a1;
+	register long x2 __asm__ ("x2") = a2;
+	register long x3 __asm__ ("x3") = a3;
+	register long x4 __asm__ ("x4") = a4;
+
+	__asm__ __volatile__ ("svc #0"
+			: "+r" (x0)
+			: "r" (x8), "r" (x1), "r" (x2), "r" (x3), "r" (x4)
+			: "memory");
+
+	return x0;
+}
+
+#endif /* !_LIB_EVL_ARM64_SYSCALL_H */
@@ -0,0 +1,34 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _LIB_EVL_X86_SYSCALL_H
+#define _LIB_EVL_X86_SYSCALL_H
+
+/*
+ * Raw syscall stub, bypassing libc. The return value is the one
+ * received from the kernel, i.e. -errno on error.
+ */
+#ifdef __x86_64__
+
+#define __EVL_HAVE_RAW_SYSCALL
+
+static inline long __evl_raw_syscall5(long nr, long a0, long a1,
+				long a2, long a3, long a4)
+{
+	register long r10 __asm__ ("r10") = a3;
+	register long r8 __asm__ ("r8") = a4;
+	long ret;
+
+	__asm__ __volatile__ ("syscall"
+			: "=a" (ret)
+			: "0" (nr), "D" (a0), "S" (a1), "d" (a2),
+			  "r" (r10), "r" (r8)
+			: "rcx", "r11", "memory");
+
+	return ret;
+}
+
+#endif	/* __x86_64__ */
+
+#endif /* !_LIB_EVL_X86_SYSCALL_H */
@@ -0,0 +1,150 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <evl/barrier.h>
+
+#define __BARRIER_ACTIVE_MAGIC	0x9b4f9b4f
+#define __BARRIER_DEAD_MAGIC	0
+
+/* Serializes the lazy init of statically initialized barriers. */
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int init_barrier(struct evl_barrier *barrier)
+{
+	int ret;
+
+	ret = evl_new_mutex(&barrier->lock, NULL); /* Unnamed private lock. */
+	if (ret < 0)
+		return ret;
+
+	ret = evl_new_event(&barrier->released, NULL);
+	if (ret < 0) {
+		evl_close_mutex(&barrier->lock);
+		return ret;
+	}
+
+	__atomic_store_n(&barrier->magic, __BARRIER_ACTIVE_MAGIC,
+			__ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int evl_create_barrier(struct evl_barrier *barrier, unsigned int count)
+{
+	if (count == 0 || count > INT_MAX)
+		return -EINVAL;
+
+	*barrier = EVL_BARRIER_INITIALIZER(count);
+
+	return init_barrier(barrier);
+}
+
+int evl_destroy_barrier(struct evl_barrier *barrier)
+{
+	int ret;
+
+	if (barrier->magic == __BARRIER_UNINIT_MAGIC)
+		return 0;
+
+	if (barrier->magic != __BARRIER_ACTIVE_MAGIC)
+		return -EINVAL;
+
+	barrier->magic = __BARRIER_DEAD_MAGIC;
+
+	ret = evl_close_event(&barrier->released);
+	if (ret)
+		return ret;
+
+	return evl_close_mutex(&barrier->lock);
+}
+
+static int check_sanity(struct evl_barrier *barrier)
+{
+	unsigned int magic;
+	int ret = 0;
+
+	magic = __atomic_load_n(&barrier->magic, __ATOMIC_ACQUIRE);
+	if (magic == __BARRIER_ACTIVE_MAGIC)
+		return 0;
+
+	if (magic != __BARRIER_UNINIT_MAGIC)
+		return -EINVAL;
+
+	/*
+	 * Proceed with lazy init of a statically initialized barrier,
+	 * which all threads of the group may attempt at once. This
+	 * creates elements, which is in-band stuff anyway.
+	 */
+	if (barrier->count == 0 || barrier->count > INT_MAX)
+		return -EINVAL;
+
+	pthread_mutex_lock(&init_lock);
+	if (barrier->magic == __BARRIER_UNINIT_MAGIC)
+		ret = init_barrier(barrier);
+	pthread_mutex_unlock(&init_lock);
+
+	return ret;
+}
+
+int evl_wait_barrier(struct evl_barrier *barrier)
+{
+	int gen, arrived, ret;
+
+	ret = check_sanity(barrier);
+	if (ret)
+		return ret;
+
+	/*
+	 * Sample the generation before registering: it cannot move
+	 * until we are accounted for, since the round we belong to
+	 * would lack our arrival to complete.
+	 */
+	gen = atomic_load_explicit(&barrier->generation, __ATOMIC_ACQUIRE);
+	arrived = atomic_fetch_add(&barrier->arrived, 1) + 1;
+	if (arrived < (int)barrier->count) {
+		ret = evl_lock_mutex(&barrier->lock);
+		if (ret)
+			return ret;
+		/*
+		 * Waiting for a barrier is not interruptible, resume
+		 * sleeping if unblocked.
+		 */
+		while (atomic_load_explicit(&barrier->generation,
+						__ATOMIC_ACQUIRE) == gen) {
+			ret = evl_wait_event(&barrier->released, &barrier->lock);
+			if (ret && ret != -EINTR)
+				break;
+			ret = 0;
+		}
+		evl_unlock_mutex(&barrier->lock);
+		return ret;
+	}
+
+	/*
+	 * Last one in. Reset the arrival count before opening the
+	 * next round, then release the sleepers of the current one
+	 * in a single call.
+	 */
+	atomic_store(&barrier->arrived, 0);
+	if (barrier->count > 1) {
+		ret = evl_lock_mutex(&barrier->lock);
+		if (ret)
+			return ret;
+		atomic_store_explicit(&barrier->generation, gen + 1,
+				__ATOMIC_RELEASE);
+		ret = evl_broadcast_event(&barrier->released);
+		evl_unlock_mutex(&barrier->lock);
+		if (ret)
+			return ret;
+	} else {
+		atomic_store_explicit(&barrier->generation, gen + 1,
+				__ATOMIC_RELEASE);
+	}
+
+	return EVL_BARRIER_SERIAL;
+}
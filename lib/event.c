@@ -86,7 +86,7 @@ static int open_event_vargs(struct evl_event *evt,
 	struct evl_monitor_binding bind;
 	int ret, efd;
 
-	efd = evl_open_element_vargs(EVL_MONITOR_DEV, fmt, ap);
+	efd = __evl_open_shared_element_vargs(EVL_MONITOR_DEV, fmt, ap);
 	if (efd < 0)
 		return efd;
 
@@ -110,7 +110,7 @@ static int open_event_vargs(struct evl_event *evt,
 
 	return 0;
 fail:
-	close(efd);
+	evl_close_element(efd);
 
 	return ret;
 }
@@ -153,7 +153,7 @@ int evl_close_event(struct evl_event *evt)
 	efd = evt->u.active.efd;
 	evt->u.active.efd = -1;
 	compiler_barrier();
-	close(efd);
+	evl_close_element(efd);
 
 	evt->u.active.fundle = EVL_NO_HANDLE;
 	evt->u.active.state = NULL;
@@ -204,22 +204,15 @@ static void unwait_event(void *data)
 	while (ret && errno == EINTR);
 }
 
-int evl_timedwait_event(struct evl_event *evt,
-			struct evl_mutex *mutex,
-			const struct timespec *timeout)
+static int wait_event(struct evl_event *evt,
+		struct evl_mutex *mutex,
+		const struct timespec *timeout)
 {
 	struct evl_monitor_waitreq req;
 	struct unwait_data unwait;
 	struct __evl_timespec kts;
 	int ret;
 
-	if (mutex->magic != __MUTEX_ACTIVE_MAGIC)
-		return -EINVAL;
-
-	ret = check_event_sanity(evt);
-	if (ret)
-		return ret;
-
 	req.gatefd = mutex->u.active.efd;
 	req.timeout_ptr = __evl_ktimespec_ptr64(timeout, kts);
 	unwait.ureq.gatefd = req.gatefd;
@@ -272,6 +265,38 @@ int evl_timedwait_event(struct evl_event *evt,
 	}
 }
 
+int evl_timedwait_event(struct evl_event *evt,
+			struct evl_mutex *mutex,
+			const struct timespec *timeout)
+{
+	__u64 t0;
+	int ret;
+
+	/* A lazy mutex needs a core element to gate the event. */
+	ret = __evl_inflate_mutex(mutex);
+	if (ret)
+		return ret;
+
+	if (mutex->magic != __MUTEX_ACTIVE_MAGIC)
+		return -EINVAL;
+
+	ret = check_event_sanity(evt);
+	if (ret)
+		return ret;
+
+	/*
+	 * The gate lock is dropped while waiting, do not account for
+	 * this time as part of the hold time.
+	 */
+	t0 = __evl_lockstat_stamp();
+	__evl_lockstat_release(mutex, EVL_LOCKSTAT_MUTEX);
+	ret = wait_event(evt, mutex, timeout);
+	__evl_lockstat_wait(evt, EVL_LOCKSTAT_EVENT, t0);
+	__evl_lockstat_rehold(mutex, EVL_LOCKSTAT_MUTEX);
+
+	return ret;
+}
+
 int evl_wait_event(struct evl_event *evt, struct evl_mutex *mutex)
 {
 	struct timespec timeout = { .tv_sec = 0, .tv_nsec = 0 };
@@ -18,6 +18,8 @@
 #include <evl/atomic.h>
 #include <evl/sys.h>
 #include <evl/flags.h>
+#include <evl/poll.h>
+#include <evl/poll-evl.h>
 #include <evl/thread.h>
 #include <evl/syscall.h>
 #include <evl/syscall-evl.h>
@@ -26,6 +28,17 @@
 
 #define __FLAGS_ACTIVE_MAGIC	0xb42bb42b
 #define __FLAGS_DEAD_MAGIC	0
+#define __FLAGS_WAITSET_ACTIVE_MAGIC	0xc53cc53c
+
+static void setup_flags(struct evl_flags *flg, int initval, int efd,
+			struct evl_element_ids *eids)
+{
+	flg->u.active.state = __evl_shared_memory + eids->state_offset;
+	atomic_store(&flg->u.active.state->u.event.value, initval);
+	flg->u.active.fundle = eids->fundle;
+	flg->u.active.efd = efd;
+	flg->magic = __FLAGS_ACTIVE_MAGIC;
+}
 
 int evl_create_flags(struct evl_flags *flg, int clockfd,
 		int initval, int flags,
@@ -58,15 +71,38 @@ int evl_create_flags(struct evl_flags *flg, int clockfd,
 	if (efd < 0)
 		return efd;
 
-	flg->u.active.state = __evl_shared_memory + eids.state_offset;
-	atomic_store(&flg->u.active.state->u.event.value, initval);
-	flg->u.active.fundle = eids.fundle;
-	flg->u.active.efd = efd;
-	flg->magic = __FLAGS_ACTIVE_MAGIC;
+	setup_flags(flg, initval, efd, &eids);
 
 	return efd;
 }
 
+int evl_create_flags_array(struct evl_flags *flgs, int nr,
+			int clockfd, int initval, int flags)
+{
+	struct evl_monitor_attrs attrs;
+	struct evl_element_req *reqs;
+	int ret, n;
+
+	if (__evl_shared_memory == NULL)
+		return -ENXIO;
+
+	attrs.type = EVL_MONITOR_EVENT;
+	attrs.protocol = EVL_EVENT_MASK;
+	attrs.clockfd = clockfd;
+	attrs.initval = initval;
+	ret = __evl_create_anon_elements(EVL_MONITOR_DEV, &attrs,
+					flags, nr, &reqs);
+	if (ret)
+		return ret;
+
+	for (n = 0; n < nr; n++)
+		setup_flags(flgs + n, initval, reqs[n].efd, &reqs[n].eids);
+
+	free(reqs);
+
+	return 0;
+}
+
 int evl_open_flags(struct evl_flags *flg, const char *fmt, ...)
 {
 	struct evl_monitor_binding bind;
@@ -74,7 +110,7 @@ int evl_open_flags(struct evl_flags *flg, const char *fmt, ...)
 	va_list ap;
 
 	va_start(ap, fmt);
-	efd = evl_open_element_vargs(EVL_MONITOR_DEV, fmt, ap);
+	efd = __evl_open_shared_element_vargs(EVL_MONITOR_DEV, fmt, ap);
 	va_end(ap);
 	if (efd < 0)
 		return efd;
@@ -99,7 +135,7 @@ int evl_open_flags(struct evl_flags *flg, const char *fmt, ...)
 
 	return efd;
 fail:
-	close(efd);
+	evl_close_element(efd);
 
 	return ret;
 }
@@ -114,9 +150,9 @@ int evl_close_flags(struct evl_flags *flg)
 	if (flg->magic != __FLAGS_ACTIVE_MAGIC)
 		return -EINVAL;
 
-	ret = close(flg->u.active.efd);
+	ret = evl_close_element(flg->u.active.efd);
 	if (ret)
-		return -errno;
+		return ret;
 
 	flg->u.active.fundle = EVL_NO_HANDLE;
 	flg->u.active.state = NULL;
@@ -149,7 +185,7 @@ static int do_timedwait_flags(struct evl_flags *flg,
 	struct evl_monitor_waitreq req;
 	struct __evl_timespec kts;
 	fundle_t current;
-	int ret;
+	int ret, mode;
 
 	current = __evl_get_current();
 	if (current == EVL_NO_HANDLE)
@@ -164,11 +200,16 @@ static int do_timedwait_flags(struct evl_flags *flg,
 	req.status = -EINVAL;
 	req.value = bits;
 
+	/* There is no fast path for waiting on flags. */
+	mode = __evl_fpstat_mode();
 	ret = oob_ioctl(flg->u.active.efd,
 			exact_match ? EVL_MONIOC_WAIT_EXACT :
 			EVL_MONIOC_WAIT, &req);
 	if (ret)
-		return -errno;
+		ret = -errno;
+	__evl_fpstat_slow(EVL_FPSTAT_WAIT_FLAGS, mode);
+	if (ret)
+		return ret;
 
 	if (req.status)
 		return req.status;
@@ -272,7 +313,7 @@ int evl_trywait_flags(struct evl_flags *flg,
 static int do_post_flags(struct evl_flags *flg, int bits, bool bcast)
 {
 	__s32 mask = bits;
-	int ret, cmd;
+	int ret, cmd, mode;
 
 	ret = check_sanity(flg);
 	if (ret)
@@ -284,12 +325,16 @@ static int do_post_flags(struct evl_flags *flg, int bits, bool bcast)
 	cmd = bcast ? EVL_MONIOC_BROADCAST : EVL_MONIOC_SIGNAL;
 
 	/* See trywait(). */
+	mode = __evl_fpstat_mode();
 	if (__evl_get_current() && !__evl_is_inband())
 		ret = oob_ioctl(flg->u.active.efd, cmd, &mask);
 	else
 		ret = ioctl(flg->u.active.efd, cmd, &mask);
+	if (ret)
+		ret = -errno;
+	__evl_fpstat_slow(EVL_FPSTAT_POST_FLAGS, mode);
 
-	return ret ? -errno : 0;
+	return ret;
 }
 
 int evl_post_flags(struct evl_flags *flg, int bits)
@@ -311,3 +356,218 @@ int evl_peek_flags(struct evl_flags *flg, int *r_bits)
 
 	return 0;
 }
+
+int evl_create_flags_waitset(struct evl_flags_waitset *ws,
+			struct evl_flags_group *groups, int nr)
+{
+	int efd, ret, n;
+
+	if (nr <= 0)
+		return -EINVAL;
+
+	for (n = 0; n < nr; n++) {
+		if (groups[n].bits == 0)
+			return -EINVAL;
+		ret = check_sanity(groups[n].flags);
+		if (ret)
+			return ret;
+	}
+
+	ws->pollset = malloc(nr * sizeof(*ws->pollset));
+	if (ws->pollset == NULL)
+		return -ENOMEM;
+
+	ws->foreign = calloc(nr, sizeof(*ws->foreign));
+	if (ws->foreign == NULL) {
+		ret = -ENOMEM;
+		goto fail_foreign;
+	}
+
+	efd = evl_new_poll();
+	if (efd < 0) {
+		ret = efd;
+		goto fail_poll;
+	}
+
+	/*
+	 * Tag each poll entry with the index of its group, so that we
+	 * know where to look on wakeup.
+	 */
+	for (n = 0; n < nr; n++) {
+		ret = evl_add_pollfd(efd, groups[n].flags->u.active.efd,
+				POLLIN, evl_intval(n));
+		if (ret)
+			goto fail_add;
+	}
+
+	ws->pollfd = efd;
+	ws->nr = nr;
+	ws->groups = groups;
+	ws->magic = __FLAGS_WAITSET_ACTIVE_MAGIC;
+
+	return 0;
+fail_add:
+	close(efd);
+fail_poll:
+	free(ws->foreign);
+fail_foreign:
+	free(ws->pollset);
+
+	return ret;
+}
+
+int evl_destroy_flags_waitset(struct evl_flags_waitset *ws)
+{
+	if (ws->magic != __FLAGS_WAITSET_ACTIVE_MAGIC)
+		return -EINVAL;
+
+	ws->magic = __FLAGS_DEAD_MAGIC;
+	close(ws->pollfd);
+	free(ws->foreign);
+	free(ws->pollset);
+
+	return 0;
+}
+
+static int trywait_group(struct evl_flags_group *group, int *r_bits)
+{
+	struct evl_flags *flg = group->flags;
+	int value;
+
+	/*
+	 * Peek at the shared value first, there is no point in
+	 * issuing a syscall unless some bits we wait for are set.
+	 */
+	value = atomic_load(&flg->u.active.state->u.event.value);
+	if (!(value & group->bits))
+		return -EAGAIN;
+
+	return do_trywait_flags(flg, group->bits, false, r_bits);
+}
+
+/*
+ * Groups are scanned in array order, so that a group with a lower
+ * index takes precedence over the others when several of them are
+ * pending at the same time.
+ */
+static int trywait_any(struct evl_flags_waitset *ws, int *r_bits)
+{
+	int ret, n;
+
+	for (n = 0; n < ws->nr; n++) {
+		ret = trywait_group(ws->groups + n, r_bits);
+		if (ret == 0)
+			return n;
+		if (ret != -EAGAIN)
+			return ret;
+	}
+
+	return -EAGAIN;
+}
+
+/*
+ * Take the bits pending outside of the wait mask of every group
+ * which has no bit set inside of it, keeping them aside until the
+ * wait returns. Bits set in the mask are left untouched,
+ * trywait_any() picks them next.
+ */
+static int set_foreign_bits_aside(struct evl_flags_waitset *ws)
+{
+	struct evl_flags_group *group;
+	int value, bits, ret, n;
+
+	for (n = 0; n < ws->nr; n++) {
+		group = ws->groups + n;
+		value = atomic_load(&group->flags->u.active.state->u.event.value);
+		if (!value || (value & group->bits))
+			continue;
+		ret = do_trywait_flags(group->flags, ~group->bits, false, &bits);
+		if (ret == 0)
+			ws->foreign[n] |= bits;
+		else if (ret != -EAGAIN)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Post the foreign bits back to their group. This may only fail if
+ * the group was closed under our feet, in which case the bits have
+ * nowhere to go anyway.
+ */
+static void restore_foreign_bits(struct evl_flags_waitset *ws)
+{
+	int n;
+
+	for (n = 0; n < ws->nr; n++) {
+		if (ws->foreign[n]) {
+			evl_post_flags(ws->groups[n].flags, ws->foreign[n]);
+			ws->foreign[n] = 0;
+		}
+	}
+}
+
+int evl_timedwait_any_flags(struct evl_flags_waitset *ws,
+			const struct timespec *timeout,
+			int *r_bits)
+{
+	int ret;
+
+	if (ws->magic != __FLAGS_WAITSET_ACTIVE_MAGIC)
+		return -EINVAL;
+
+	if (__evl_get_current() == EVL_NO_HANDLE)
+		return -EPERM;
+
+	/*
+	 * A single group is better served by a direct wait, which
+	 * consumes the bits in the same round trip. Success means
+	 * group #0 fired, so the return values match.
+	 */
+	if (ws->nr == 1)
+		return evl_timedwait_some_flags(ws->groups[0].flags,
+					ws->groups[0].bits, timeout, r_bits);
+
+	/*
+	 * Readiness of a flag group only means that its value is
+	 * non-zero, which may not match the wait mask, or some other
+	 * waiter may have consumed the bits before we got
+	 * there. Since the poll readiness cannot be masked, bits
+	 * posted outside of a group mask are set aside once the poll
+	 * returns, otherwise the group would stay ready, causing the
+	 * next poll to return immediately.
+	 */
+	for (;;) {
+		ret = trywait_any(ws, r_bits);
+		if (ret != -EAGAIN)
+			break;
+
+		ret = evl_timedpoll(ws->pollfd, ws->pollset, ws->nr, timeout);
+		if (ret < 0)
+			break;
+
+		ret = set_foreign_bits_aside(ws);
+		if (ret)
+			break;
+	}
+
+	restore_foreign_bits(ws);
+
+	return ret;
+}
+
+int evl_wait_any_flags(struct evl_flags_waitset *ws, int *r_bits)
+{
+	struct timespec timeout = { .tv_sec = 0, .tv_nsec = 0 };
+
+	return evl_timedwait_any_flags(ws, &timeout, r_bits);
+}
+
+int evl_trywait_any_flags(struct evl_flags_waitset *ws, int *r_bits)
+{
+	if (ws->magic != __FLAGS_WAITSET_ACTIVE_MAGIC)
+		return -EINVAL;
+
+	return trywait_any(ws, r_bits);
+}
@@ -0,0 +1,168 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <evl/fpstats.h>
+#include "internal.h"
+
+/*
+ * Each thread which goes through an instrumented entry point gets
+ * its counters in an instrumentation block, which
+ * __evl_current_fpstats refers to.
+ */
+static int dump_fpstats(FILE *fp);
+
+struct evl_instr_set __evl_fpstats = {
+	.name = "fpstats",
+	.env = "EVL_FPSTATS",
+	.size = sizeof(struct evl_fpstats),
+	.dump = dump_fpstats,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static const char *entry_names[] = {
+	[EVL_FPSTAT_LOCK_MUTEX] = "lock_mutex",
+	[EVL_FPSTAT_TRYLOCK_MUTEX] = "trylock_mutex",
+	[EVL_FPSTAT_UNLOCK_MUTEX] = "unlock_mutex",
+	[EVL_FPSTAT_GET_SEM] = "get_sem",
+	[EVL_FPSTAT_PUT_SEM] = "put_sem",
+	[EVL_FPSTAT_WAIT_FLAGS] = "wait_flags",
+	[EVL_FPSTAT_POST_FLAGS] = "post_flags",
+};
+
+struct evl_fpstats *__evl_fpstats_attach(void)
+{
+	if (__evl_current_fpstats == NULL)
+		__evl_current_fpstats = __evl_instr_attach(&__evl_fpstats);
+
+	return __evl_current_fpstats;
+}
+
+void __evl_fpstat_note_fast(enum evl_fpstat_entry entry)
+{
+	struct evl_fpstats *stats = __evl_fpstats_attach();
+
+	if (stats)
+		stats->entries[entry].fast++;
+}
+
+void __evl_fpstat_note_slow(enum evl_fpstat_entry entry, int mode)
+{
+	struct evl_fpstats *stats = __evl_fpstats_attach();
+
+	if (stats == NULL)
+		return;
+
+	stats->entries[entry].slow++;
+	if ((mode ^ __evl_get_current_mode()) & EVL_T_INBAND)
+		stats->entries[entry].switches++;
+}
+
+const char *evl_fpstat_name(enum evl_fpstat_entry entry)
+{
+	if ((unsigned int)entry >= EVL_FPSTAT_NR_ENTRIES)
+		return NULL;
+
+	return entry_names[entry];
+}
+
+int evl_get_thread_fpstats(struct evl_fpstats *stats)
+{
+	if (__evl_current_fpstats)
+		*stats = *__evl_current_fpstats;
+	else
+		memset(stats, 0, sizeof(*stats));
+
+	return 0;
+}
+
+static void add_stats(struct evl_fpstats *sum,
+		const struct evl_fpstats *stats)
+{
+	int n;
+
+	for (n = 0; n < EVL_FPSTAT_NR_ENTRIES; n++) {
+		sum->entries[n].fast += stats->entries[n].fast;
+		sum->entries[n].slow += stats->entries[n].slow;
+		sum->entries[n].switches += stats->entries[n].switches;
+	}
+}
+
+/*
+ * Sum up the counters of all threads, returning the number of
+ * threads accounted for. Owners keep updating their counters while
+ * we read them, so the figures of busy threads may be slightly off.
+ */
+int evl_get_fpstats(struct evl_fpstats *stats)
+{
+	struct evl_instr_block *b;
+	int nr = 0;
+
+	memset(stats, 0, sizeof(*stats));
+
+	pthread_mutex_lock(&__evl_fpstats.lock);
+
+	for_each_instr_block(&__evl_fpstats, b) {
+		add_stats(stats, (struct evl_fpstats *)b->data);
+		nr++;
+	}
+
+	pthread_mutex_unlock(&__evl_fpstats.lock);
+
+	return nr;
+}
+
+static void dump_entries(FILE *fp, const char *who,
+			const struct evl_fpstats *stats)
+{
+	const struct evl_fpstat *e;
+	int n;
+
+	for (n = 0; n < EVL_FPSTAT_NR_ENTRIES; n++) {
+		e = stats->entries + n;
+		if (e->fast == 0 && e->slow == 0)
+			continue;
+		fprintf(fp, "%-8s %-14s %12lu %12lu %10lu %6.1f%%\n",
+			who, entry_names[n], e->fast, e->slow, e->switches,
+			100.0 * e->slow / (e->fast + e->slow));
+	}
+}
+
+static int dump_fpstats(FILE *fp)
+{
+	struct evl_fpstats total, stats;
+	struct evl_instr_block *b;
+	char tid[16];
+	int nr;
+
+	nr = evl_get_fpstats(&total);
+
+	fprintf(fp, "evl fpstats: pid %d, %d thread(s), %lu dropped\n",
+		getpid(), nr,
+		__atomic_load_n(&__evl_fpstats.dropped, __ATOMIC_RELAXED));
+	fprintf(fp, "%-8s %-14s %12s %12s %10s %7s\n",
+		"TID", "ENTRY", "FAST", "SLOW", "SWITCHES", "SLOW%");
+
+	pthread_mutex_lock(&__evl_fpstats.lock);
+
+	for_each_instr_block(&__evl_fpstats, b) {
+		stats = *(struct evl_fpstats *)b->data;
+		snprintf(tid, sizeof(tid), "%d", b->tid);
+		dump_entries(fp, tid, &stats);
+	}
+
+	pthread_mutex_unlock(&__evl_fpstats.lock);
+
+	if (nr > 1)
+		dump_entries(fp, "*", &total);
+
+	return 0;
+}
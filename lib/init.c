@@ -8,6 +8,9 @@
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <alloca.h>
+#include <malloc.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -17,6 +20,7 @@
 #include <linux/types.h>
 #include <valgrind/valgrind.h>
 #include <evl/atomic.h>
+#include <evl/compiler.h>
 #include <evl/evl.h>
 #include <evl/sys.h>
 #include <evl/syscall.h>
@@ -74,7 +78,7 @@ static inline int generic_init(void)
 	 * sign that we have no EVL core in there. Return with -ENOSYS
 	 * to give a clear hint about this.
 	 */
-	ctlfd = open(EVL_CONTROL_DEV, O_RDWR);
+	ctlfd = open(EVL_CONTROL_DEV, O_RDWR|O_CLOEXEC);
 	if (ctlfd < 0) {
 		if (errno == ENOENT) {
 			fprintf(stderr,	"evl: core not enabled in kernel\n");
@@ -83,18 +87,6 @@ static inline int generic_init(void)
 		return -errno;
 	}
 
-	ret = fcntl(ctlfd, F_GETFD, 0);
-	if (ret < 0) {
-		ret = -errno;
-		goto fail;
-	}
-
-	ret = fcntl(ctlfd, F_SETFD, ret | O_CLOEXEC);
-	if (ret < 0) {
-		ret = -errno;
-		goto fail;
-	}
-
 	ret = ioctl(ctlfd, EVL_CTLIOC_GET_COREINFO, &core_info);
 	if (ret) {
 		/*
@@ -213,6 +205,7 @@ static int do_init(void)
 		return ret;
 
 	__evl_setup_proxies();
+	__evl_init_instr();
 
 	return 0;
 }
@@ -236,3 +229,141 @@ unsigned int evl_detect_fpu(void)
 
 	return core_info.fpu_features;
 }
+
+/*
+ * Leave a few pages untouched above the guard area, so that probing
+ * the stack does not run the caller out of space.
+ */
+#define STACK_PROBE_MARGIN	4	/* pages */
+
+/*
+ * Pre-fault the stack of the calling thread, the whole area if size
+ * is zero. The memory is locked by evl_init() already, this is
+ * about getting the pages which are not mapped yet present. The
+ * library TLS is touched in the same move, since it might be
+ * allocated on first access when libevl is dlopen()ed.
+ */
+ssize_t evl_prefault_stack(size_t size)
+{
+	size_t pagesz = sysconf(_SC_PAGESIZE), avail, stacksize, off;
+	pthread_attr_t attr;
+	void *stackaddr;
+	volatile char *p;
+	char here;
+	int ret;
+
+	__force_read_access(__evl_current);
+
+	ret = pthread_getattr_np(pthread_self(), &attr);
+	if (ret)
+		return -ret;
+
+	ret = pthread_attr_getstack(&attr, &stackaddr, &stacksize);
+	pthread_attr_destroy(&attr);
+	if (ret)
+		return -ret;
+
+	avail = &here - (char *)stackaddr;
+	if (avail <= STACK_PROBE_MARGIN * pagesz)
+		return 0;
+
+	avail -= STACK_PROBE_MARGIN * pagesz;
+	if (size == 0 || size > avail)
+		size = avail;
+
+	/*
+	 * Move the stack pointer down before probing, so that the
+	 * kernel sees regular stack accesses. Go from the top, one
+	 * page at a time.
+	 */
+	p = alloca(size);
+	for (off = 0; off < size; off += pagesz)
+		p[size - 1 - off] = 0;
+
+	return size;
+}
+
+static ssize_t get_locked_bytes(void)
+{
+	ssize_t locked = -1;
+	char line[128];
+	long kb;
+	FILE *fp;
+
+	fp = fopen("/proc/self/status", "r");
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "VmLck: %ld kB", &kb) == 1) {
+			locked = kb * 1024;
+			break;
+		}
+	}
+
+	fclose(fp);
+
+	return locked;
+}
+
+/*
+ * Bring the calling process to steady state before it runs
+ * out-of-band: lock memory, then pre-fault the caller's stack, a
+ * heap reserve and the core shared memory. Page faults after this
+ * point are not supposed to happen, unless new memory is mapped or
+ * some other thread's stack is involved (see evl_prefault_stack()).
+ */
+int evl_prepare_rt(size_t stack_size, size_t heap_size,
+		struct evl_rt_report *report)
+{
+	size_t pagesz = sysconf(_SC_PAGESIZE), off;
+	struct evl_rt_report r;
+	volatile char *p;
+	ssize_t ret;
+
+	ret = evl_init();
+	if (ret)
+		return ret;
+
+	memset(&r, 0, sizeof(r));
+
+	/* In case the application called munlockall() since. */
+	if (mlockall(MCL_CURRENT | MCL_FUTURE))
+		r.mlock_status = -errno;
+
+	/*
+	 * Keep the memory glibc obtains from the kernel in the arena,
+	 * so that the heap reserve we touch next is recycled by
+	 * malloc() instead of being trimmed, then faulted in again.
+	 */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	if (heap_size) {
+		p = malloc(heap_size);
+		if (p == NULL)
+			return -ENOMEM;
+		for (off = 0; off < heap_size; off += pagesz)
+			p[off] = 0;
+		free((void *)p);
+		r.heap_bytes = heap_size;
+	}
+
+	ret = evl_prefault_stack(stack_size);
+	if (ret < 0)
+		return ret;
+
+	r.stack_bytes = ret;
+
+	p = __evl_shared_memory;
+	for (off = 0; off < core_info.shm_size; off += pagesz)
+		__force_read_access(p[off]);
+
+	r.shm_bytes = core_info.shm_size;
+	r.locked_bytes = get_locked_bytes();
+
+	if (report)
+		*report = r;
+
+	return 0;
+}
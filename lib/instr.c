@@ -0,0 +1,149 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <evl/instr.h>
+#include "internal.h"
+
+/*
+ * Common plumbing of the instrumentation counter sets. Each set
+ * hands out one block per thread, which is chained to the set and
+ * never released, so that the figures collected by threads which
+ * have exited can still be reported. The set-specific code only
+ * deals with the contents of the blocks.
+ */
+static struct evl_instr_set *instr_sets[] = {
+	[EVL_INSTR_LOCKSTAT] = &__evl_lockstat,
+	[EVL_INSTR_FPSTATS] = &__evl_fpstats,
+};
+
+static struct evl_instr_set *get_set(enum evl_instr_id id)
+{
+	if ((unsigned int)id >= EVL_INSTR_NR_SETS)
+		return NULL;
+
+	return instr_sets[id];
+}
+
+/*
+ * Allocating a block might switch the caller in-band, which is why
+ * evl_attach_thread() does this early on behalf of the new thread.
+ * The caller should keep the returned data pointer in TLS.
+ */
+void *__evl_instr_attach(struct evl_instr_set *set)
+{
+	struct evl_instr_block *b;
+
+	b = calloc(1, sizeof(*b) + set->size);
+	if (b == NULL) {
+		__atomic_add_fetch(&set->dropped, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	b->tid = (pid_t)syscall(SYS_gettid);
+
+	pthread_mutex_lock(&set->lock);
+	b->next = set->blocks;
+	set->blocks = b;
+	pthread_mutex_unlock(&set->lock);
+
+	return b->data;
+}
+
+int evl_enable_instr(enum evl_instr_id id, bool enabled)
+{
+	struct evl_instr_set *set = get_set(id);
+
+	if (set == NULL)
+		return -EINVAL;
+
+	set->enabled = enabled;
+
+	return 0;
+}
+
+bool evl_instr_enabled(enum evl_instr_id id)
+{
+	struct evl_instr_set *set = get_set(id);
+
+	return set ? set->enabled : false;
+}
+
+int evl_dump_instr(enum evl_instr_id id, FILE *fp)
+{
+	struct evl_instr_set *set = get_set(id);
+
+	if (set == NULL)
+		return -EINVAL;
+
+	return set->dump(fp);
+}
+
+/*
+ * Sets which are told to dump into the same file share it, in set
+ * order.
+ */
+static void dump_at_exit(void)
+{
+	struct evl_instr_set *set;
+	const char *mode;
+	unsigned int n, m;
+	FILE *fp;
+
+	for (n = 0; n < EVL_INSTR_NR_SETS; n++) {
+		set = instr_sets[n];
+		if (set->dump_path == NULL)
+			continue;
+
+		if (!strcmp(set->dump_path, "1")) {
+			set->dump(stderr);
+			continue;
+		}
+
+		for (m = 0, mode = "w"; m < n; m++) {
+			if (instr_sets[m]->dump_path &&
+				!strcmp(instr_sets[m]->dump_path, set->dump_path))
+				mode = "a";
+		}
+
+		fp = fopen(set->dump_path, mode);
+		if (fp == NULL) {
+			fprintf(stderr, "evl: cannot open %s for %s dump\n",
+				set->dump_path, set->name);
+			continue;
+		}
+
+		set->dump(fp);
+		fclose(fp);
+	}
+}
+
+void __evl_init_instr(void)
+{
+	struct evl_instr_set *set;
+	bool dump = false;
+	const char *env;
+	unsigned int n;
+
+	for (n = 0; n < EVL_INSTR_NR_SETS; n++) {
+		set = instr_sets[n];
+		env = getenv(set->env);
+		if (env == NULL || *env == '\0' || !strcmp(env, "0"))
+			continue;
+		set->dump_path = env;
+		set->enabled = true;
+		dump = true;
+	}
+
+	if (dump)
+		atexit(dump_at_exit);
+}
@@ -7,10 +7,21 @@
 #ifndef _LIB_EVL_INTERNAL_H
 #define _LIB_EVL_INTERNAL_H
 
+#include <sys/syscall.h>
 #include <time.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <asm-generic/dovetail.h>
+#include <asm/evl/syscall-evl.h>
 #include <evl/thread.h>
+#include <evl/syscall-evl.h>
+#include <evl/instr.h>
+#include <evl/lockstat.h>
+#include <evl/fpstats.h>
 
 #define __evl_ptr64(__ptr)	((__u64)(uintptr_t)(__ptr))
 
@@ -89,6 +100,48 @@ int __evl_current_efd;
 extern __thread __attribute__ ((tls_model (EVL_TLS_MODEL)))
 struct evl_user_window *__evl_current_window;
 
+extern __thread __attribute__ ((tls_model (EVL_TLS_MODEL)))
+struct evl_fpstats *__evl_current_fpstats;
+
+extern __thread __attribute__ ((tls_model (EVL_TLS_MODEL)))
+int __evl_oob_cancel_mode;
+
+extern int __evl_oob_cancel_default;
+
+static inline bool __evl_oob_cancellable(void)
+{
+	int mode = __evl_oob_cancel_mode;
+
+	if (mode == EVL_OOB_CANCEL_DEFAULT)
+		mode = __atomic_load_n(&__evl_oob_cancel_default,
+				__ATOMIC_RELAXED);
+
+	return mode == EVL_OOB_CANCEL_ASYNC;
+}
+
+/*
+ * Issue an out-of-band ioctl request from a hot path, returning
+ * either a non-negative result or -errno. If the caller does not
+ * need to be switched to asynchronous cancellation, we can branch
+ * directly to the kernel via the arch-specific stub if present,
+ * bypassing the libc indirection and errno handling.
+ */
+static inline int __evl_oob_ioctl(int efd, unsigned long request, void *arg)
+{
+	int ret;
+
+#if defined(__EVL_HAVE_RAW_SYSCALL) && !defined(EVL_EMULATION)
+	if (!__evl_oob_cancellable())
+		return (int)__evl_raw_syscall5(__NR_prctl,
+					sys_evl_ioctl | __OOB_SYSCALL_BIT,
+					(long)efd, (long)request,
+					(long)arg, 0);
+#endif
+	ret = oob_ioctl(efd, request, arg);
+
+	return ret < 0 ? -errno : ret;
+}
+
 static inline int __evl_get_current_mode(void)
 {
 	return __evl_current_window ?
@@ -121,6 +174,143 @@ static inline bool __evl_is_inband(void)
 		__ret ? -errno : 0;				\
 	})
 
+/*
+ * An instrumentation counter set, see instr.c. Each thread gets a
+ * private block of @size bytes from __evl_instr_attach(). Blocks
+ * are chained to the set, readers walk them under @lock.
+ */
+struct evl_instr_block {
+	struct evl_instr_block *next;
+	pid_t tid;
+	char data[] __attribute__((aligned(8)));
+};
+
+struct evl_instr_set {
+	bool enabled;
+	const char *name;
+	const char *env;
+	size_t size;
+	int (*dump)(FILE *fp);
+	struct evl_instr_block *blocks;
+	unsigned long dropped;	/* Blocks we could not allocate. */
+	pthread_mutex_t lock;
+	const char *dump_path;
+};
+
+#define for_each_instr_block(__set, __b)	\
+	for (__b = (__set)->blocks; __b; __b = __b->next)
+
+void *__evl_instr_attach(struct evl_instr_set *set);
+
+void __evl_init_instr(void);
+
+extern struct evl_instr_set __evl_lockstat;
+
+__u64 __evl_lockstat_clock(void);
+
+void __evl_lockstat_note_acquire(const void *lock,
+				enum evl_lockstat_type type, __u64 t0);
+
+void __evl_lockstat_note_release(const void *lock,
+				enum evl_lockstat_type type);
+
+void __evl_lockstat_note_rehold(const void *lock,
+				enum evl_lockstat_type type);
+
+void __evl_lockstat_note_wait(const void *obj,
+			enum evl_lockstat_type type, __u64 t0);
+
+/*
+ * Lock profiling hooks. With profiling disabled, each hook boils
+ * down to a single test on a global flag. A null timestamp from
+ * __evl_lockstat_stamp() denotes an uncontended acquisition.
+ */
+static inline __u64 __evl_lockstat_stamp(void)
+{
+	return __builtin_expect(__evl_lockstat.enabled, 0) ?
+		__evl_lockstat_clock() : 0;
+}
+
+static inline void __evl_lockstat_acquire(const void *lock,
+					enum evl_lockstat_type type, __u64 t0)
+{
+	if (__builtin_expect(__evl_lockstat.enabled, 0))
+		__evl_lockstat_note_acquire(lock, type, t0);
+}
+
+static inline void __evl_lockstat_release(const void *lock,
+					enum evl_lockstat_type type)
+{
+	if (__builtin_expect(__evl_lockstat.enabled, 0))
+		__evl_lockstat_note_release(lock, type);
+}
+
+static inline void __evl_lockstat_rehold(const void *lock,
+					enum evl_lockstat_type type)
+{
+	if (__builtin_expect(__evl_lockstat.enabled, 0))
+		__evl_lockstat_note_rehold(lock, type);
+}
+
+static inline void __evl_lockstat_wait(const void *obj,
+				enum evl_lockstat_type type, __u64 t0)
+{
+	if (__builtin_expect(__evl_lockstat.enabled, 0))
+		__evl_lockstat_note_wait(obj, type, t0);
+}
+
+void __evl_lockstat_attach(void);
+
+extern struct evl_instr_set __evl_fpstats;
+
+void __evl_fpstat_note_fast(enum evl_fpstat_entry entry);
+
+void __evl_fpstat_note_slow(enum evl_fpstat_entry entry, int mode);
+
+/*
+ * Fast path accounting hooks. Entry points sample the caller mode
+ * with __evl_fpstat_mode() before going the slow path, so that
+ * __evl_fpstat_slow() can tell whether the request moved the caller
+ * to the other stage. With counting disabled, each hook boils down
+ * to a single test on a global flag.
+ */
+static inline int __evl_fpstat_mode(void)
+{
+	return __builtin_expect(__evl_fpstats.enabled, 0) ?
+		__evl_get_current_mode() : 0;
+}
+
+static inline void __evl_fpstat_fast(enum evl_fpstat_entry entry)
+{
+	if (__builtin_expect(__evl_fpstats.enabled, 0))
+		__evl_fpstat_note_fast(entry);
+}
+
+static inline void __evl_fpstat_slow(enum evl_fpstat_entry entry, int mode)
+{
+	if (__builtin_expect(__evl_fpstats.enabled, 0))
+		__evl_fpstat_note_slow(entry, mode);
+}
+
+struct evl_fpstats *__evl_fpstats_attach(void);
+
+extern bool __evl_logger;
+
+void __evl_log_attach(void);
+
+struct evl_element_req;
+
+struct evl_mutex;
+
+int __evl_create_anon_elements(const char *type, void *attrs,
+			int clone_flags, int nr,
+			struct evl_element_req **r_reqs);
+
+int __evl_open_shared_element_vargs(const char *type,
+				const char *fmt, va_list ap);
+
+int __evl_inflate_mutex(struct evl_mutex *mutex);
+
 int __evl_arch_init(void);
 
 int __evl_attach_clocks(void);
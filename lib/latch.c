@@ -0,0 +1,154 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include <evl/latch.h>
+
+#define __LATCH_ACTIVE_MAGIC	0x4d7e4d7e
+#define __LATCH_DEAD_MAGIC	0
+
+/* Serializes the lazy init of statically initialized latches. */
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int init_latch(struct evl_latch *latch)
+{
+	int ret;
+
+	ret = evl_new_sem(&latch->gate, NULL); /* Unnamed private sema4. */
+	if (ret < 0)
+		return ret;
+
+	__atomic_store_n(&latch->magic, __LATCH_ACTIVE_MAGIC,
+			__ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int evl_create_latch(struct evl_latch *latch, int count)
+{
+	if (count < 0)
+		return -EINVAL;
+
+	*latch = EVL_LATCH_INITIALIZER(count);
+
+	return init_latch(latch);
+}
+
+int evl_destroy_latch(struct evl_latch *latch)
+{
+	if (latch->magic == __LATCH_UNINIT_MAGIC)
+		return 0;
+
+	if (latch->magic != __LATCH_ACTIVE_MAGIC)
+		return -EINVAL;
+
+	latch->magic = __LATCH_DEAD_MAGIC;
+
+	return evl_close_sem(&latch->gate);
+}
+
+static int check_sanity(struct evl_latch *latch)
+{
+	unsigned int magic;
+	int ret = 0;
+
+	magic = __atomic_load_n(&latch->magic, __ATOMIC_ACQUIRE);
+	if (magic == __LATCH_ACTIVE_MAGIC)
+		return 0;
+
+	if (magic != __LATCH_UNINIT_MAGIC)
+		return -EINVAL;
+
+	/*
+	 * Proceed with lazy init of a statically initialized latch,
+	 * which several threads may attempt at once.
+	 */
+	pthread_mutex_lock(&init_lock);
+	if (latch->magic == __LATCH_UNINIT_MAGIC)
+		ret = init_latch(latch);
+	pthread_mutex_unlock(&init_lock);
+
+	return ret;
+}
+
+int evl_count_down_latch(struct evl_latch *latch, int count)
+{
+	int old, new, nrwait, ret;
+
+	if (count <= 0)
+		return -EINVAL;
+
+	ret = check_sanity(latch);
+	if (ret)
+		return ret;
+
+	old = atomic_load(&latch->count);
+	do {
+		if (old == 0)	/* Already open. */
+			return 0;
+		new = old > count ? old - count : 0;
+	} while (!atomic_compare_exchange_weak(&latch->count, &old, new));
+
+	if (new > 0)
+		return 0;
+
+	/*
+	 * We opened the latch. Any thread registering as a waiter
+	 * from now on is bound to see the zero count and skip
+	 * sleeping, so we only have to release those which made it
+	 * to the waiter count before us.
+	 */
+	nrwait = atomic_exchange(&latch->waiters, 0);
+	if (nrwait > 0)
+		return evl_put_sem_n(&latch->gate, nrwait);
+
+	return 0;
+}
+
+int evl_trywait_latch(struct evl_latch *latch)
+{
+	int ret;
+
+	ret = check_sanity(latch);
+	if (ret)
+		return ret;
+
+	return atomic_load(&latch->count) == 0 ? 0 : -EAGAIN;
+}
+
+int evl_timedwait_latch(struct evl_latch *latch,
+			const struct timespec *timeout)
+{
+	int ret;
+
+	ret = evl_trywait_latch(latch);
+	if (ret != -EAGAIN)
+		return ret;
+
+	/*
+	 * Register as a waiter, then check the count again. Either we
+	 * see the latch open, or the opener sees us in the waiter
+	 * count and posts a unit for us. In the former case, we might
+	 * leave a stale unit in the gate, which is harmless since
+	 * nobody sleeps on an open latch.
+	 */
+	atomic_fetch_add(&latch->waiters, 1);
+	if (atomic_load(&latch->count) == 0)
+		return 0;
+
+	do
+		ret = evl_timedget_sem(&latch->gate, timeout);
+	while (ret == -EINTR);
+
+	return ret;
+}
+
+int evl_wait_latch(struct evl_latch *latch)
+{
+	struct timespec timeout = { .tv_sec = 0, .tv_nsec = 0 };
+
+	return evl_timedwait_latch(latch, &timeout);
+}
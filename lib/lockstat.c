@@ -0,0 +1,354 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <evl/lockstat.h>
+#include "internal.h"
+
+/*
+ * Per-thread open-addressed table of lock records, indexed by lock
+ * address and type. Each table lives in the instrumentation block of
+ * its thread.
+ */
+#define LOCKSTAT_SLOTS	256	/* Must be a power of 2. */
+
+struct lockstat_slot {
+	const void *lock;
+	enum evl_lockstat_type type;
+	int held;
+	__u64 hold_start;
+	unsigned long acquired;
+	unsigned long contended;
+	__u64 wait_total;
+	__u64 wait_max;
+	__u64 hold_total;
+	__u64 hold_max;
+};
+
+struct lockstat_table {
+	unsigned long overflow;
+	struct lockstat_slot slots[LOCKSTAT_SLOTS];
+};
+
+static int dump_lockstat(FILE *fp);
+
+struct evl_instr_set __evl_lockstat = {
+	.name = "lockstat",
+	.env = "EVL_LOCKSTAT",
+	.size = sizeof(struct lockstat_table),
+	.dump = dump_lockstat,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread __attribute__ ((tls_model (EVL_TLS_MODEL)))
+struct lockstat_table *lockstat_table;
+
+__u64 __evl_lockstat_clock(void)
+{
+	struct timespec now;
+
+	__evl_clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (__u64)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void __evl_lockstat_attach(void)
+{
+	if (lockstat_table == NULL)
+		lockstat_table = __evl_instr_attach(&__evl_lockstat);
+}
+
+static struct lockstat_slot *
+get_slot(const void *lock, enum evl_lockstat_type type)
+{
+	struct lockstat_slot *slot;
+	struct lockstat_table *t;
+	unsigned int n, h;
+
+	if (lockstat_table == NULL) {
+		__evl_lockstat_attach();
+		if (lockstat_table == NULL)
+			return NULL;
+	}
+
+	t = lockstat_table;
+	h = (unsigned int)(((uintptr_t)lock >> 3) * 2654435761U) ^ type;
+
+	for (n = 0; n < LOCKSTAT_SLOTS; n++) {
+		slot = t->slots + ((h + n) & (LOCKSTAT_SLOTS - 1));
+		if (slot->lock == lock && slot->type == type)
+			return slot;
+		if (slot->lock == NULL) {
+			slot->type = type;
+			/* Publish to evl_get_lockstat() last. */
+			__atomic_store_n(&slot->lock, lock, __ATOMIC_RELEASE);
+			return slot;
+		}
+	}
+
+	t->overflow++;
+
+	return NULL;
+}
+
+static void start_hold(struct lockstat_slot *slot)
+{
+	if (slot->held++ == 0)
+		slot->hold_start = __evl_lockstat_clock();
+}
+
+void __evl_lockstat_note_acquire(const void *lock,
+				enum evl_lockstat_type type, __u64 t0)
+{
+	struct lockstat_slot *slot;
+	__u64 delta;
+
+	slot = get_slot(lock, type);
+	if (slot == NULL)
+		return;
+
+	slot->acquired++;
+
+	if (t0) {
+		slot->contended++;
+		delta = __evl_lockstat_clock() - t0;
+		slot->wait_total += delta;
+		if (delta > slot->wait_max)
+			slot->wait_max = delta;
+	}
+
+	start_hold(slot);
+}
+
+void __evl_lockstat_note_release(const void *lock,
+				enum evl_lockstat_type type)
+{
+	struct lockstat_slot *slot;
+	__u64 delta;
+
+	slot = get_slot(lock, type);
+	if (slot == NULL || slot->held == 0)
+		return;
+
+	if (--slot->held > 0)
+		return;
+
+	delta = __evl_lockstat_clock() - slot->hold_start;
+	slot->hold_total += delta;
+	if (delta > slot->hold_max)
+		slot->hold_max = delta;
+}
+
+void __evl_lockstat_note_rehold(const void *lock,
+				enum evl_lockstat_type type)
+{
+	struct lockstat_slot *slot;
+
+	slot = get_slot(lock, type);
+	if (slot)
+		start_hold(slot);
+}
+
+void __evl_lockstat_note_wait(const void *obj,
+			enum evl_lockstat_type type, __u64 t0)
+{
+	struct lockstat_slot *slot;
+	__u64 delta;
+
+	if (t0 == 0)
+		return;
+
+	slot = get_slot(obj, type);
+	if (slot == NULL)
+		return;
+
+	delta = __evl_lockstat_clock() - t0;
+	slot->acquired++;
+	slot->contended++;
+	slot->wait_total += delta;
+	if (delta > slot->wait_max)
+		slot->wait_max = delta;
+}
+
+static int compare_lock(const void *l, const void *r)
+{
+	const struct evl_lockstat *ls = l, *rs = r;
+
+	if (ls->lock != rs->lock)
+		return (uintptr_t)ls->lock < (uintptr_t)rs->lock ? -1 : 1;
+
+	return (int)ls->type - (int)rs->type;
+}
+
+static int compare_wait(const void *l, const void *r)
+{
+	const struct evl_lockstat *ls = l, *rs = r;
+
+	if (ls->wait_total != rs->wait_total)
+		return ls->wait_total > rs->wait_total ? -1 : 1;
+
+	return compare_lock(l, r);
+}
+
+/*
+ * Merge the records from all thread tables into a single array of
+ * per-lock statistics, sorted by lock address. Owners keep updating
+ * their records while we read them, which means that the counters
+ * of a busy lock may be slightly inconsistent with each other.
+ */
+static ssize_t collect_stats(struct evl_lockstat **statsp)
+{
+	struct evl_lockstat *stats, *p;
+	struct evl_instr_block *b;
+	struct lockstat_slot *slot;
+	struct lockstat_table *t;
+	size_t nr = 0, n, m;
+	const void *lock;
+
+	*statsp = NULL;
+
+	pthread_mutex_lock(&__evl_lockstat.lock);
+
+	for_each_instr_block(&__evl_lockstat, b)
+		nr += LOCKSTAT_SLOTS;
+
+	if (nr == 0) {
+		pthread_mutex_unlock(&__evl_lockstat.lock);
+		return 0;
+	}
+
+	stats = malloc(nr * sizeof(*stats));
+	if (stats == NULL) {
+		pthread_mutex_unlock(&__evl_lockstat.lock);
+		return -ENOMEM;
+	}
+
+	p = stats;
+	for_each_instr_block(&__evl_lockstat, b) {
+		t = (struct lockstat_table *)b->data;
+		for (n = 0; n < LOCKSTAT_SLOTS; n++) {
+			slot = t->slots + n;
+			lock = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+			if (lock == NULL)
+				continue;
+			p->lock = lock;
+			p->type = slot->type;
+			p->acquired = slot->acquired;
+			p->contended = slot->contended;
+			p->wait_total = slot->wait_total;
+			p->wait_max = slot->wait_max;
+			p->hold_total = slot->hold_total;
+			p->hold_max = slot->hold_max;
+			p++;
+		}
+	}
+
+	pthread_mutex_unlock(&__evl_lockstat.lock);
+
+	nr = p - stats;
+	if (nr == 0) {
+		free(stats);
+		return 0;
+	}
+
+	qsort(stats, nr, sizeof(*stats), compare_lock);
+
+	for (n = 0, m = 1; m < nr; m++) {
+		if (compare_lock(stats + n, stats + m)) {
+			stats[++n] = stats[m];
+			continue;
+		}
+		p = stats + n;
+		p->acquired += stats[m].acquired;
+		p->contended += stats[m].contended;
+		p->wait_total += stats[m].wait_total;
+		if (stats[m].wait_max > p->wait_max)
+			p->wait_max = stats[m].wait_max;
+		p->hold_total += stats[m].hold_total;
+		if (stats[m].hold_max > p->hold_max)
+			p->hold_max = stats[m].hold_max;
+	}
+
+	*statsp = stats;
+
+	return n + 1;
+}
+
+ssize_t evl_get_lockstat(struct evl_lockstat *stats, size_t count)
+{
+	struct evl_lockstat *all;
+	ssize_t nr;
+
+	nr = collect_stats(&all);
+	if (nr <= 0)
+		return nr;
+
+	memcpy(stats, all, ((size_t)nr < count ? (size_t)nr : count) *
+		sizeof(*stats));
+	free(all);
+
+	return nr;
+}
+
+static const char *lock_type_names[] = {
+	[EVL_LOCKSTAT_MUTEX] = "mutex",
+	[EVL_LOCKSTAT_EVENT] = "event",
+	[EVL_LOCKSTAT_RWLOCK_RD] = "rwlock/r",
+	[EVL_LOCKSTAT_RWLOCK_WR] = "rwlock/w",
+};
+
+static int dump_lockstat(FILE *fp)
+{
+	struct evl_lockstat *stats, *p;
+	struct evl_instr_block *b;
+	unsigned long overflow;
+	struct lockstat_table *t;
+	ssize_t nr;
+
+	nr = collect_stats(&stats);
+	if (nr < 0)
+		return nr;
+
+	pthread_mutex_lock(&__evl_lockstat.lock);
+	overflow = __atomic_load_n(&__evl_lockstat.dropped, __ATOMIC_RELAXED);
+	for_each_instr_block(&__evl_lockstat, b) {
+		t = (struct lockstat_table *)b->data;
+		overflow += t->overflow;
+	}
+	pthread_mutex_unlock(&__evl_lockstat.lock);
+
+	fprintf(fp, "evl lockstat: pid %d, %zd lock(s), %lu record(s) dropped\n",
+		getpid(), nr, overflow);
+	fprintf(fp, "%-18s %-8s %10s %10s %14s %12s %14s %12s\n",
+		"LOCK", "TYPE", "ACQUIRED", "CONTENDED",
+		"WAIT-TOTAL", "WAIT-MAX", "HOLD-TOTAL", "HOLD-MAX");
+
+	if (nr == 0)
+		return 0;
+
+	/* Show the most contended locks first. */
+	qsort(stats, nr, sizeof(*stats), compare_wait);
+
+	for (p = stats; p < stats + nr; p++)
+		fprintf(fp, "%-18p %-8s %10lu %10lu %14llu %12llu %14llu %12llu\n",
+			p->lock, lock_type_names[p->type],
+			p->acquired, p->contended,
+			(unsigned long long)p->wait_total,
+			(unsigned long long)p->wait_max,
+			(unsigned long long)p->hold_total,
+			(unsigned long long)p->hold_max);
+
+	free(stats);
+
+	return 0;
+}
@@ -0,0 +1,764 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <evl/log.h>
+#include "internal.h"
+
+/*
+ * Each logging thread owns a single-producer, single-consumer ring
+ * of variable-size records, the logger thread is the only
+ * consumer. A record never wraps around the end of the ring, a zero
+ * size header tells the consumer to resume reading from the start
+ * instead. Rings are released by the consumer once their owner has
+ * exited and every record has been drained. New rings are pushed to
+ * the head of ring_list locklessly, since the logger holds log_lock
+ * while writing out. Only the consumer unlinks rings, under
+ * log_lock.
+ */
+#define LOG_DEFAULT_RING	(64 * 1024)
+#define LOG_MIN_RING		4096
+#define LOG_DEFAULT_PERIOD	10000000ULL /* 10ms */
+#define LOG_LINE_MAX		1024
+#define LOG_OUTBUF		8192
+
+struct log_record {
+	__u32 size;		/* 0 means wrap to the ring start. */
+	__u32 nargs;
+	__u64 stamp;
+	const char *fmt;
+	struct evl_log_arg args[];
+};
+
+struct log_ring {
+	struct log_ring *next;
+	pid_t tid;
+	bool dead;
+	unsigned long head;
+	unsigned long tail;
+	unsigned long dropped;
+	unsigned long reported;
+	size_t size;
+	char data[];
+};
+
+bool __evl_logger;
+
+static struct log_ring *ring_list;
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_cond_t log_wakeup = PTHREAD_COND_INITIALIZER;
+
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+
+static pthread_key_t log_key;
+
+static pthread_t log_thread;
+
+static bool log_stopping;
+
+static int log_fd = -EBADF;
+
+static size_t log_ring_size;
+
+static __u64 log_period;
+
+static unsigned long log_drops;
+
+static char log_outbuf[LOG_OUTBUF];
+
+static size_t log_outfill;
+
+static __thread __attribute__ ((tls_model (EVL_TLS_MODEL)))
+struct log_ring *log_ring;
+
+static void drop_ring(void *arg)
+{
+	struct log_ring *ring = arg;
+
+	log_ring = NULL;
+	__atomic_store_n(&ring->dead, true, __ATOMIC_RELEASE);
+}
+
+/*
+ * Allocating a ring might switch the caller in-band, which is why
+ * evl_attach_thread() does this early on behalf of the new thread
+ * if the logger is running.
+ */
+void __evl_log_attach(void)
+{
+	struct log_ring *ring, *head;
+
+	if (log_ring)
+		return;
+
+	ring = malloc(sizeof(*ring) + log_ring_size);
+	if (ring == NULL)
+		return;
+
+	ring->tid = (pid_t)syscall(SYS_gettid);
+	ring->dead = false;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dropped = 0;
+	ring->reported = 0;
+	ring->size = log_ring_size;
+
+	head = __atomic_load_n(&ring_list, __ATOMIC_RELAXED);
+	do
+		ring->next = head;
+	while (!__atomic_compare_exchange_n(&ring_list, &head, ring, true,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	pthread_setspecific(log_key, ring);
+	log_ring = ring;
+}
+
+static inline size_t align_record(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+static void note_drop(struct log_ring *ring)
+{
+	__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&log_drops, 1, __ATOMIC_RELAXED);
+}
+
+int __evl_log(const char *fmt, int nargs,
+	const struct evl_log_arg *args)
+{
+	size_t len[EVL_LOG_MAX_ARGS], size, off, to_end, strpos;
+	unsigned long head, tail;
+	struct log_record *rec;
+	struct log_ring *ring;
+	struct timespec now;
+	const char *s;
+	int n;
+
+	if (nargs > EVL_LOG_MAX_ARGS)
+		return -EINVAL;
+
+	ring = log_ring;
+	if (ring == NULL) {
+		if (!__evl_logger)
+			return -ENXIO;
+		__evl_log_attach();
+		ring = log_ring;
+		if (ring == NULL) {
+			__atomic_add_fetch(&log_drops, 1, __ATOMIC_RELAXED);
+			return -ENOMEM;
+		}
+	}
+
+	size = sizeof(*rec) + nargs * sizeof(*args);
+	for (n = 0; n < nargs; n++) {
+		if (args[n].type != EVL_LOG_STRING)
+			continue;
+		s = args[n].v.p ?: "(null)";
+		len[n] = strnlen(s, EVL_LOG_MAX_STRING);
+		size += len[n] + 1;
+	}
+
+	size = align_record(size);
+	head = ring->head;
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	off = head & (ring->size - 1);
+	to_end = ring->size - off;
+
+	if ((size <= to_end ? size : size + to_end) >
+		ring->size - (head - tail)) {
+		note_drop(ring);
+		return -ENOBUFS;
+	}
+
+	if (size > to_end) {
+		rec = (struct log_record *)(ring->data + off);
+		rec->size = 0;
+		head += to_end;
+		off = 0;
+	}
+
+	__evl_clock_gettime(CLOCK_MONOTONIC, &now);
+
+	rec = (struct log_record *)(ring->data + off);
+	rec->size = size;
+	rec->nargs = nargs;
+	rec->stamp = now.tv_sec * 1000000000ULL + now.tv_nsec;
+	rec->fmt = fmt;
+
+	/*
+	 * Strings are copied past the argument array in argument
+	 * order, the arguments keep the original pointers for %p.
+	 */
+	strpos = sizeof(*rec) + nargs * sizeof(*args);
+	for (n = 0; n < nargs; n++) {
+		rec->args[n] = args[n];
+		if (args[n].type != EVL_LOG_STRING)
+			continue;
+		s = args[n].v.p ?: "(null)";
+		memcpy((char *)rec + strpos, s, len[n]);
+		((char *)rec)[strpos + len[n]] = '\0';
+		strpos += len[n] + 1;
+	}
+
+	__atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static void flush_output(void)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < log_outfill) {
+		ret = write(log_fd, log_outbuf + done, log_outfill - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		done += ret;
+	}
+
+	log_outfill = 0;
+}
+
+static void emit_line(const char *line, size_t len)
+{
+	if (log_outfill + len > sizeof(log_outbuf))
+		flush_output();
+
+	memcpy(log_outbuf + log_outfill, line, len);
+	log_outfill += len;
+}
+
+static long long int_value(const struct evl_log_arg *arg)
+{
+	return arg->type == EVL_LOG_DOUBLE ? (long long)arg->v.d : arg->v.i;
+}
+
+static double double_value(const struct evl_log_arg *arg)
+{
+	switch (arg->type) {
+	case EVL_LOG_DOUBLE:
+		return arg->v.d;
+	case EVL_LOG_INT:
+		return (double)arg->v.i;
+	case EVL_LOG_UINT:
+		return (double)arg->v.u;
+	default:
+		return 0.0;
+	}
+}
+
+enum length_mod {
+	LMOD_NONE,
+	LMOD_LONG,
+	LMOD_LLONG,	/* Also long double. */
+	LMOD_INTMAX,
+	LMOD_SIZE,
+	LMOD_PTRDIFF,
+};
+
+static enum length_mod parse_length(const char **pp)
+{
+	const char *p = *pp;
+	enum length_mod lmod = LMOD_NONE;
+
+	switch (*p) {
+	case 'h':
+		p += p[1] == 'h' ? 2 : 1;
+		break;
+	case 'l':
+		if (p[1] == 'l') {
+			lmod = LMOD_LLONG;
+			p++;
+		} else
+			lmod = LMOD_LONG;
+		p++;
+		break;
+	case 'L':
+	case 'q':
+		lmod = LMOD_LLONG;
+		p++;
+		break;
+	case 'j':
+		lmod = LMOD_INTMAX;
+		p++;
+		break;
+	case 'z':
+		lmod = LMOD_SIZE;
+		p++;
+		break;
+	case 't':
+		lmod = LMOD_PTRDIFF;
+		p++;
+		break;
+	}
+
+	*pp = p;
+
+	return lmod;
+}
+
+#define format_value(__buf, __len, __spec, __nstar, __star, __val)	\
+	({								\
+		int __ret;						\
+		switch (__nstar) {					\
+		case 0:							\
+			__ret = snprintf(__buf, __len, __spec, __val);	\
+			break;						\
+		case 1:							\
+			__ret = snprintf(__buf, __len, __spec,		\
+					__star[0], __val);		\
+			break;						\
+		default:						\
+			__ret = snprintf(__buf, __len, __spec,		\
+					__star[0], __star[1], __val);	\
+		}							\
+		__ret;							\
+	})
+
+/*
+ * Apply the format to the recorded arguments one conversion at a
+ * time, casting each value to the type the length modifier of the
+ * conversion calls for.
+ */
+static size_t format_record(char *line, size_t size,
+			const struct log_record *rec)
+{
+	const struct evl_log_arg *arg = rec->args;
+	const char *p = rec->fmt, *start;
+	size_t stroff[EVL_LOG_MAX_ARGS], pos;
+	int nstar, star[2], ret, n;
+	char spec[32], conv;
+	size_t len, spec_len;
+	enum length_mod lmod;
+
+	/* Locate the string copies, see __evl_log(). */
+	pos = sizeof(*rec) + rec->nargs * sizeof(*arg);
+	for (n = 0; n < (int)rec->nargs; n++) {
+		if (arg[n].type != EVL_LOG_STRING)
+			continue;
+		stroff[n] = pos;
+		pos += strlen((const char *)rec + pos) + 1;
+	}
+
+	ret = snprintf(line, size, "[%llu.%06llu] ",
+		rec->stamp / 1000000000ULL,
+		(rec->stamp % 1000000000ULL) / 1000ULL);
+	len = ret;
+
+	while (*p && len < size - 1) {
+		if (*p != '%') {
+			line[len++] = *p++;
+			continue;
+		}
+
+		if (p[1] == '%') {
+			line[len++] = '%';
+			p += 2;
+			continue;
+		}
+
+		start = p++;
+		nstar = 0;
+		p += strspn(p, "-+ #0'");
+		if (*p == '*') {
+			if (arg < rec->args + rec->nargs)
+				star[nstar++] = int_value(arg++);
+			p++;
+		} else
+			p += strspn(p, "0123456789");
+		if (*p == '.') {
+			p++;
+			if (*p == '*') {
+				if (arg < rec->args + rec->nargs)
+					star[nstar++] = int_value(arg++);
+				p++;
+			} else
+				p += strspn(p, "0123456789");
+		}
+
+		lmod = parse_length(&p);
+		conv = *p;
+		if (conv == '\0')
+			break;
+		p++;
+
+		spec_len = p - start;
+		if (spec_len >= sizeof(spec) ||
+			arg >= rec->args + rec->nargs)
+			break;
+		memcpy(spec, start, spec_len);
+		spec[spec_len] = '\0';
+
+		switch (conv) {
+		case 'd':
+		case 'i':
+			if (lmod == LMOD_LONG)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (long)arg->v.i);
+			else if (lmod == LMOD_LLONG)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, arg->v.i);
+			else if (lmod == LMOD_INTMAX)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (intmax_t)arg->v.i);
+			else if (lmod == LMOD_SIZE)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (ssize_t)arg->v.i);
+			else if (lmod == LMOD_PTRDIFF)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (ptrdiff_t)arg->v.i);
+			else
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (int)arg->v.i);
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			if (lmod == LMOD_LONG)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (unsigned long)arg->v.u);
+			else if (lmod == LMOD_LLONG)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, arg->v.u);
+			else if (lmod == LMOD_INTMAX)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (uintmax_t)arg->v.u);
+			else if (lmod == LMOD_SIZE)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (size_t)arg->v.u);
+			else if (lmod == LMOD_PTRDIFF)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (ptrdiff_t)arg->v.u);
+			else
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, (unsigned int)arg->v.u);
+			break;
+		case 'c':
+			ret = format_value(line + len, size - len, spec,
+					nstar, star, (int)arg->v.i);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (lmod == LMOD_LLONG)
+				ret = format_value(line + len, size - len, spec,
+						nstar, star,
+						(long double)double_value(arg));
+			else
+				ret = format_value(line + len, size - len, spec,
+						nstar, star, double_value(arg));
+			break;
+		case 's':
+			ret = format_value(line + len, size - len, spec,
+					nstar, star,
+					arg->type == EVL_LOG_STRING ?
+					(const char *)rec + stroff[arg - rec->args] :
+					"(?)");
+			break;
+		case 'p':
+			ret = format_value(line + len, size - len, spec,
+					nstar, star, arg->v.p);
+			break;
+		default:
+			/* %n and friends are not supported. */
+			ret = 0;
+		}
+
+		arg++;
+		if (ret > 0)
+			len += ret;
+		if (len >= size)
+			len = size - 1;
+	}
+
+	if (len > 0 && line[len - 1] != '\n') {
+		if (len >= size - 1)
+			len = size - 2;
+		line[len++] = '\n';
+	}
+
+	return len;
+}
+
+static void report_drops(struct log_ring *ring)
+{
+	unsigned long dropped;
+	char line[80];
+	int len;
+
+	dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	if (dropped == ring->reported)
+		return;
+
+	len = snprintf(line, sizeof(line),
+		"[evl_log: %lu record(s) lost by thread %d]\n",
+		dropped - ring->reported, ring->tid);
+	ring->reported = dropped;
+	emit_line(line, len);
+}
+
+/*
+ * Return the next record pending in the ring, skipping the wrap
+ * marker, or NULL if the ring is empty.
+ */
+static struct log_record *peek_record(struct log_ring *ring)
+{
+	struct log_record *rec;
+	unsigned long head;
+	size_t off;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	if (ring->tail == head)
+		return NULL;
+
+	off = ring->tail & (ring->size - 1);
+	rec = (struct log_record *)(ring->data + off);
+	if (rec->size == 0) {
+		__atomic_store_n(&ring->tail, ring->tail + ring->size - off,
+				__ATOMIC_RELEASE);
+		if (ring->tail == head)
+			return NULL;
+		rec = (struct log_record *)ring->data;
+	}
+
+	return rec;
+}
+
+/*
+ * Attaching threads may push new rings concurrently, in which case
+ * the ring we want to unlink from the head is no longer there.
+ */
+static void unlink_ring(struct log_ring *prev, struct log_ring *ring)
+{
+	struct log_ring *head = ring;
+
+	if (prev == NULL) {
+		if (__atomic_compare_exchange_n(&ring_list, &head, ring->next,
+						false, __ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE))
+			return;
+		for (prev = head; prev->next != ring; prev = prev->next)
+			;
+	}
+
+	prev->next = ring->next;
+}
+
+/*
+ * Merge the records from all rings in timestamp order. Called with
+ * log_lock held.
+ */
+static void drain_rings(void)
+{
+	struct log_record *rec, *oldest;
+	struct log_ring *ring, *from, *prev, *next;
+	char line[LOG_LINE_MAX];
+	size_t len;
+
+	for (ring = __atomic_load_n(&ring_list, __ATOMIC_ACQUIRE);
+	     ring; ring = ring->next)
+		report_drops(ring);
+
+	for (;;) {
+		oldest = NULL;
+		from = NULL;
+		for (ring = __atomic_load_n(&ring_list, __ATOMIC_ACQUIRE);
+		     ring; ring = ring->next) {
+			rec = peek_record(ring);
+			if (rec && (oldest == NULL ||
+					rec->stamp < oldest->stamp)) {
+				oldest = rec;
+				from = ring;
+			}
+		}
+
+		if (oldest == NULL)
+			break;
+
+		len = format_record(line, sizeof(line), oldest);
+		emit_line(line, len);
+		__atomic_store_n(&from->tail, from->tail + oldest->size,
+				__ATOMIC_RELEASE);
+	}
+
+	flush_output();
+
+	prev = NULL;
+	ring = __atomic_load_n(&ring_list, __ATOMIC_ACQUIRE);
+	while (ring) {
+		next = ring->next;
+		if (__atomic_load_n(&ring->dead, __ATOMIC_ACQUIRE) &&
+			peek_record(ring) == NULL) {
+			report_drops(ring);
+			flush_output();
+			unlink_ring(prev, ring);
+			free(ring);
+		} else
+			prev = ring;
+		ring = next;
+	}
+}
+
+static void *logger_thread(void *arg)
+{
+	struct timespec timeout;
+
+	pthread_mutex_lock(&log_lock);
+
+	while (!log_stopping) {
+		drain_rings();
+		clock_gettime(CLOCK_MONOTONIC, &timeout);
+		timeout.tv_sec += log_period / 1000000000ULL;
+		timeout.tv_nsec += log_period % 1000000000ULL;
+		if (timeout.tv_nsec >= 1000000000L) {
+			timeout.tv_sec++;
+			timeout.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&log_wakeup, &log_lock, &timeout);
+	}
+
+	pthread_mutex_unlock(&log_lock);
+
+	return NULL;
+}
+
+static void flush_at_exit(void)
+{
+	evl_flush_log();
+}
+
+static void init_logger_once(void)
+{
+	pthread_key_create(&log_key, drop_ring);
+	atexit(flush_at_exit);
+}
+
+/*
+ * Start the in-band logger thread, which formats the pending records
+ * every @period_ns nanoseconds, writing the output to @fd. Each
+ * logging thread gets a ring of @ring_size bytes (rounded up to a
+ * power of two).
+ */
+int evl_start_logger(int fd, size_t ring_size, __u64 period_ns)
+{
+	pthread_condattr_t attr;
+	size_t size;
+	int ret;
+
+	if (fd < 0)
+		return -EBADF;
+
+	if (ring_size == 0)
+		ring_size = LOG_DEFAULT_RING;
+
+	for (size = LOG_MIN_RING; size < ring_size; size <<= 1) {
+		if (size > SIZE_MAX / 2)
+			return -EINVAL;
+	}
+
+	pthread_once(&log_once, init_logger_once);
+
+	pthread_mutex_lock(&log_lock);
+
+	if (__evl_logger) {
+		pthread_mutex_unlock(&log_lock);
+		return -EBUSY;
+	}
+
+	log_fd = fd;
+	log_ring_size = size;
+	log_period = period_ns ?: LOG_DEFAULT_PERIOD;
+	log_stopping = false;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_destroy(&log_wakeup);
+	pthread_cond_init(&log_wakeup, &attr);
+	pthread_condattr_destroy(&attr);
+
+	ret = -pthread_create(&log_thread, NULL, logger_thread, NULL);
+	if (!ret)
+		__evl_logger = true;
+
+	pthread_mutex_unlock(&log_lock);
+
+	return ret;
+}
+
+/*
+ * Stop the logger thread once all the pending records have been
+ * written out. Rings stay in place, records logged after this call
+ * are written out when the logger restarts.
+ */
+int evl_stop_logger(void)
+{
+	pthread_mutex_lock(&log_lock);
+
+	if (!__evl_logger) {
+		pthread_mutex_unlock(&log_lock);
+		return -ENXIO;
+	}
+
+	__evl_logger = false;
+	log_stopping = true;
+	pthread_cond_signal(&log_wakeup);
+	pthread_mutex_unlock(&log_lock);
+
+	pthread_join(log_thread, NULL);
+
+	pthread_mutex_lock(&log_lock);
+	drain_rings();
+	pthread_mutex_unlock(&log_lock);
+
+	return 0;
+}
+
+/*
+ * Write out all the pending records from the caller's context,
+ * which should run in-band.
+ */
+int evl_flush_log(void)
+{
+	pthread_mutex_lock(&log_lock);
+
+	if (log_fd < 0) {
+		pthread_mutex_unlock(&log_lock);
+		return -ENXIO;
+	}
+
+	drain_rings();
+
+	pthread_mutex_unlock(&log_lock);
+
+	return 0;
+}
+
+unsigned long evl_log_drops(void)
+{
+	return __atomic_load_n(&log_drops, __ATOMIC_RELAXED);
+}
@@ -67,19 +67,9 @@ bool fast_unlock_mutex(atomic_t *fastlock, fundle_t cur_ownerh)
                                         EVL_NO_HANDLE) == cur_ownerh;
 }
 
-static int init_mutex_vargs(struct evl_mutex *mutex,
-			int protocol, int clockfd,
-			unsigned int ceiling, int flags,
-			const char *fmt, va_list ap)
+static int check_ceiling(int protocol, unsigned int ceiling)
 {
-	struct evl_monitor_attrs attrs;
-	struct evl_monitor_state *gst;
-	struct evl_element_ids eids;
-	char *name = NULL;
-	int efd, ret;
-
-	if (__evl_shared_memory == NULL)
-		return -ENXIO;
+	int ret;
 
 	/*
 	 * We align on the in-band SCHED_FIFO priority range. Although
@@ -94,6 +84,44 @@ static int init_mutex_vargs(struct evl_mutex *mutex,
 			return -EINVAL;
 	}
 
+	return 0;
+}
+
+static void setup_mutex(struct evl_mutex *mutex,
+			int protocol, int flags, int efd,
+			struct evl_element_ids *eids)
+{
+	struct evl_monitor_state *gst;
+
+	gst = __evl_shared_memory + eids->state_offset;
+	gst->u.gate.recursive = !!(flags & EVL_MUTEX_RECURSIVE);
+	mutex->u.active.state = gst;
+	init_fast_lock(&gst->u.gate.owner);
+	__force_read_access(gst->flags); /* Force sync the PTE. */
+	mutex->u.active.fundle = eids->fundle;
+	mutex->u.active.monitor = EVL_MONITOR_GATE;
+	mutex->u.active.protocol = protocol;
+	mutex->u.active.efd = efd;
+	mutex->magic = __MUTEX_ACTIVE_MAGIC;
+}
+
+static int init_mutex_vargs(struct evl_mutex *mutex,
+			int protocol, int clockfd,
+			unsigned int ceiling, int flags,
+			const char *fmt, va_list ap)
+{
+	struct evl_monitor_attrs attrs;
+	struct evl_element_ids eids;
+	char *name = NULL;
+	int efd, ret;
+
+	if (__evl_shared_memory == NULL)
+		return -ENXIO;
+
+	ret = check_ceiling(protocol, ceiling);
+	if (ret)
+		return ret;
+
 	if (fmt) {
 		ret = vasprintf(&name, fmt, ap);
 		if (ret < 0)
@@ -110,20 +138,46 @@ static int init_mutex_vargs(struct evl_mutex *mutex,
 	if (efd < 0)
 		return efd;
 
-	gst = __evl_shared_memory + eids.state_offset;
-	gst->u.gate.recursive = !!(flags & EVL_MUTEX_RECURSIVE);
-	mutex->u.active.state = gst;
-	init_fast_lock(&gst->u.gate.owner);
-	__force_read_access(gst->flags); /* Force sync the PTE. */
-	mutex->u.active.fundle = eids.fundle;
-	mutex->u.active.monitor = EVL_MONITOR_GATE;
-	mutex->u.active.protocol = protocol;
-	mutex->u.active.efd = efd;
-	mutex->magic = __MUTEX_ACTIVE_MAGIC;
+	setup_mutex(mutex, protocol, flags, efd, &eids);
 
 	return efd;
 }
 
+int evl_create_mutex_array(struct evl_mutex *mutexes, int nr,
+			int clockfd, unsigned int ceiling, int flags)
+{
+	struct evl_monitor_attrs attrs;
+	struct evl_element_req *reqs;
+	int protocol, ret, n;
+
+	if (__evl_shared_memory == NULL)
+		return -ENXIO;
+
+	protocol = ceiling ? EVL_GATE_PP : EVL_GATE_PI;
+	ret = check_ceiling(protocol, ceiling);
+	if (ret)
+		return ret;
+
+	attrs.type = EVL_MONITOR_GATE;
+	attrs.protocol = protocol;
+	attrs.clockfd = clockfd;
+	attrs.initval = ceiling;
+	ret = __evl_create_anon_elements(EVL_MONITOR_DEV, &attrs,
+					flags, nr, &reqs);
+	if (ret)
+		return ret;
+
+	for (n = 0; n < nr; n++) {
+		mutexes[n].lazy_owner = 0;
+		setup_mutex(mutexes + n, protocol, flags,
+			reqs[n].efd, &reqs[n].eids);
+	}
+
+	free(reqs);
+
+	return 0;
+}
+
 static int init_mutex_static(struct evl_mutex *mutex,
 			int clockfd, unsigned int ceiling,
 			int flags, const char *fmt, ...)
@@ -139,6 +193,153 @@ static int init_mutex_static(struct evl_mutex *mutex,
 	return efd;
 }
 
+/*
+ * Until some thread contends for it, a lazy mutex is owned through
+ * the lazy_owner word, which holds __MUTEX_LAZY_MARK or'ed with the
+ * handle of the current owner if any. The first thread which finds
+ * the mutex busy creates the core element, handing over the gate to
+ * the lazy owner. __MUTEX_LAZY_INFLATE freezes the lazy state while
+ * this happens, threads running into it wait for inflate_lock to be
+ * released. Once lazy_owner reads zero, the mutex is a regular one.
+ */
+static pthread_once_t inflate_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t inflate_lock;
+
+static void init_inflate_lock(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&inflate_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static int inflate_mutex(struct evl_mutex *mutex)
+{
+	struct evl_monitor_state *gst;
+	fundle_t owner;
+	__u32 w;
+	int ret;
+
+	pthread_once(&inflate_once, init_inflate_lock);
+	pthread_mutex_lock(&inflate_lock);
+
+	w = atomic_read(&mutex->lazy_owner);
+	do {
+		ret = 0;
+		if (!(w & __MUTEX_LAZY_MARK))	/* Inflated meanwhile. */
+			goto out;
+	} while (!__atomic_compare_exchange_n(&mutex->lazy_owner, &w,
+					w | __MUTEX_LAZY_INFLATE, false,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	/* The lazy owner cannot change until we clear the word. */
+	owner = w & ~__MUTEX_LAZY_MARK;
+	ret = init_mutex_static(mutex,
+				mutex->u.uninit.clockfd, 0,
+				mutex->u.uninit.flags,
+				mutex->u.uninit.name);
+	if (ret < 0) {
+		__atomic_store_n(&mutex->lazy_owner, w, __ATOMIC_RELEASE);
+		goto out;
+	}
+
+	if (owner != EVL_NO_HANDLE) {
+		gst = mutex->u.active.state;
+		atomic_store(&gst->u.gate.owner, owner);
+		gst->u.gate.nesting = 1;
+	}
+
+	ret = 0;
+	__atomic_store_n(&mutex->lazy_owner, 0, __ATOMIC_RELEASE);
+out:
+	pthread_mutex_unlock(&inflate_lock);
+
+	return ret;
+}
+
+static void wait_inflation(void)
+{
+	pthread_mutex_lock(&inflate_lock);
+	pthread_mutex_unlock(&inflate_lock);
+}
+
+int __evl_inflate_mutex(struct evl_mutex *mutex)
+{
+	if (!(atomic_read(&mutex->lazy_owner) & __MUTEX_LAZY_MARK))
+		return 0;
+
+	return inflate_mutex(mutex);
+}
+
+/*
+ * Returns -ENODATA if the caller should go through the regular
+ * locking path. A lazy mutex found busy is inflated unless
+ * @trylock is set, in which case -EBUSY is returned: a failed
+ * attempt is no reason for creating the core element.
+ */
+static int lazy_lock(struct evl_mutex *mutex, fundle_t current,
+		bool trylock)
+{
+	__u32 w = atomic_read(&mutex->lazy_owner);
+	fundle_t owner;
+	int ret;
+
+	while (w & __MUTEX_LAZY_MARK) {
+		if (!(w & __MUTEX_LAZY_INFLATE)) {
+			owner = w & ~__MUTEX_LAZY_MARK;
+			if (owner == current)
+				return -EDEADLK;
+			if (owner == EVL_NO_HANDLE) {
+				if (__atomic_compare_exchange_n(&mutex->lazy_owner,
+						&w, __MUTEX_LAZY_MARK | current,
+						false, __ATOMIC_ACQUIRE,
+						__ATOMIC_ACQUIRE))
+					return 0;
+				continue;
+			}
+			if (trylock)
+				return -EBUSY;
+		} else if (trylock) {
+			wait_inflation();
+			w = atomic_read(&mutex->lazy_owner);
+			continue;
+		}
+		/* Contended, switch to the core element. */
+		ret = inflate_mutex(mutex);
+		if (ret)
+			return ret;
+		break;
+	}
+
+	return -ENODATA;
+}
+
+static int lazy_unlock(struct evl_mutex *mutex, fundle_t current)
+{
+	__u32 w = atomic_read(&mutex->lazy_owner);
+
+	while (w & __MUTEX_LAZY_MARK) {
+		if (w & __MUTEX_LAZY_INFLATE) {
+			wait_inflation();
+			w = atomic_read(&mutex->lazy_owner);
+			continue;
+		}
+		if (current == EVL_NO_HANDLE ||
+			(w & ~__MUTEX_LAZY_MARK) != current)
+			return -EPERM;
+		if (__atomic_compare_exchange_n(&mutex->lazy_owner, &w,
+						__MUTEX_LAZY_MARK, false,
+						__ATOMIC_RELEASE,
+						__ATOMIC_ACQUIRE))
+			return 0;
+	}
+
+	return -ENODATA;
+}
+
 static int open_mutex_vargs(struct evl_mutex *mutex,
 			const char *fmt, va_list ap)
 {
@@ -146,7 +347,7 @@ static int open_mutex_vargs(struct evl_mutex *mutex,
 	struct evl_monitor_state *gst;
 	int ret, efd;
 
-	efd = evl_open_element_vargs(EVL_MONITOR_DEV, fmt, ap);
+	efd = __evl_open_shared_element_vargs(EVL_MONITOR_DEV, fmt, ap);
 	if (efd < 0)
 		return efd;
 
@@ -169,11 +370,12 @@ static int open_mutex_vargs(struct evl_mutex *mutex,
 	mutex->u.active.monitor = bind.type;
 	mutex->u.active.protocol = bind.protocol;
 	mutex->u.active.efd = efd;
+	mutex->lazy_owner = 0;
 	mutex->magic = __MUTEX_ACTIVE_MAGIC;
 
 	return 0;
 fail:
-	close(efd);
+	evl_close_element(efd);
 
 	return ret;
 }
@@ -186,6 +388,7 @@ int evl_create_mutex(struct evl_mutex *mutex,
 	va_list ap;
 
 	protocol = ceiling ? EVL_GATE_PP : EVL_GATE_PI;
+	mutex->lazy_owner = 0;
 	va_start(ap, fmt);
 	efd = init_mutex_vargs(mutex, protocol,
 			clockfd, ceiling, flags, fmt, ap);
@@ -219,7 +422,7 @@ int evl_close_mutex(struct evl_mutex *mutex)
 	efd = mutex->u.active.efd;
 	mutex->u.active.efd = -1;
 	compiler_barrier();
-	close(efd);
+	evl_close_element(efd);
 
 	mutex->u.active.fundle = EVL_NO_HANDLE;
 	mutex->u.active.state = NULL;
@@ -228,7 +431,7 @@ int evl_close_mutex(struct evl_mutex *mutex)
 	return 0;
 }
 
-static int try_lock(struct evl_mutex *mutex)
+static int try_lock(struct evl_mutex *mutex, bool trylock)
 {
 	struct evl_user_window *u_window;
 	struct evl_monitor_state *gst;
@@ -240,6 +443,10 @@ static int try_lock(struct evl_mutex *mutex)
 	if (current == EVL_NO_HANDLE)
 		return -EPERM;
 
+	ret = lazy_lock(mutex, current, trylock);
+	if (ret != -ENODATA)
+		return ret;
+
 	if (mutex->magic == __MUTEX_UNINIT_MAGIC &&
 		mutex->u.uninit.monitor == EVL_MONITOR_GATE) {
 		ret = init_mutex_static(mutex,
@@ -307,23 +514,36 @@ int evl_timedlock_mutex(struct evl_mutex *mutex,
 {
 	struct evl_monitor_state *gst;
 	struct __evl_timespec kts;
-	int ret;
+	int ret, mode;
+	__u64 t0;
 
-	ret = try_lock(mutex);
-	if (ret != -ENODATA)
+	mode = __evl_fpstat_mode();
+
+	ret = try_lock(mutex, false);
+	if (ret != -ENODATA) {
+		if (ret == 0) {
+			__evl_fpstat_fast(EVL_FPSTAT_LOCK_MUTEX);
+			__evl_lockstat_acquire(mutex, EVL_LOCKSTAT_MUTEX, 0);
+		}
 		return ret;
+	}
+
+	t0 = __evl_lockstat_stamp();
 
 	do
-		ret = oob_ioctl(mutex->u.active.efd, EVL_MONIOC_ENTER,
+		ret = __evl_oob_ioctl(mutex->u.active.efd, EVL_MONIOC_ENTER,
 				__evl_ktimespec(timeout, kts));
-	while (ret && errno == EINTR);
+	while (ret == -EINTR);
+
+	__evl_fpstat_slow(EVL_FPSTAT_LOCK_MUTEX, mode);
 
 	if (ret == 0) {
 		gst = mutex->u.active.state;
 		gst->u.gate.nesting = 1;
+		__evl_lockstat_acquire(mutex, EVL_LOCKSTAT_MUTEX, t0);
 	}
 
-	return ret ? -errno : 0;
+	return ret;
 }
 
 int evl_lock_mutex(struct evl_mutex *mutex)
@@ -335,17 +555,37 @@ int evl_lock_mutex(struct evl_mutex *mutex)
 
 int evl_trylock_mutex(struct evl_mutex *mutex)
 {
-	int ret;
+	int ret, mode;
+	__u64 t0;
 
-	ret = try_lock(mutex);
-	if (ret != -ENODATA)
+	mode = __evl_fpstat_mode();
+
+	ret = try_lock(mutex, true);
+	if (ret != -ENODATA) {
+		if (ret == 0) {
+			__evl_fpstat_fast(EVL_FPSTAT_TRYLOCK_MUTEX);
+			__evl_lockstat_acquire(mutex, EVL_LOCKSTAT_MUTEX, 0);
+		}
 		return ret;
+	}
+
+	t0 = __evl_lockstat_stamp();
 
 	do
 		ret = oob_ioctl(mutex->u.active.efd, EVL_MONIOC_TRYENTER);
 	while (ret && errno == EINTR);
 
-	return ret ? -errno : 0;
+	if (ret)
+		ret = -errno;
+
+	__evl_fpstat_slow(EVL_FPSTAT_TRYLOCK_MUTEX, mode);
+
+	if (ret)
+		return ret;
+
+	__evl_lockstat_acquire(mutex, EVL_LOCKSTAT_MUTEX, t0);
+
+	return 0;
 }
 
 int evl_unlock_mutex(struct evl_mutex *mutex)
@@ -355,16 +595,28 @@ int evl_unlock_mutex(struct evl_mutex *mutex)
 	fundle_t current;
 	int ret, mode;
 
+	current = __evl_get_current();
+	ret = lazy_unlock(mutex, current);
+	if (ret != -ENODATA) {
+		if (ret == 0) {
+			__evl_fpstat_fast(EVL_FPSTAT_UNLOCK_MUTEX);
+			__evl_lockstat_release(mutex, EVL_LOCKSTAT_MUTEX);
+		}
+		return ret;
+	}
+
 	if (mutex->magic != __MUTEX_ACTIVE_MAGIC)
 		return -EINVAL;
 
 	gst = mutex->u.active.state;
-	current = __evl_get_current();
 	if (!is_mutex_owner(&gst->u.gate.owner, current))
 		return -EPERM;
 
+	__evl_lockstat_release(mutex, EVL_LOCKSTAT_MUTEX);
+
 	if (gst->u.gate.nesting > 1) {
 		gst->u.gate.nesting--;
+		__evl_fpstat_fast(EVL_FPSTAT_UNLOCK_MUTEX);
 		return 0;
 	}
 
@@ -381,6 +633,7 @@ int evl_unlock_mutex(struct evl_mutex *mutex)
 			u_window = __evl_get_current_window();
 			u_window->pp_pending = EVL_NO_HANDLE;
 		}
+		__evl_fpstat_fast(EVL_FPSTAT_UNLOCK_MUTEX);
 		return 0;
 	}
 
@@ -390,9 +643,11 @@ int evl_unlock_mutex(struct evl_mutex *mutex)
 	 * thread. Need to ask the kernel for proper release.
 	 */
 slow_path:
-	ret = oob_ioctl(mutex->u.active.efd, EVL_MONIOC_EXIT);
+	mode = __evl_fpstat_mode();
+	ret = __evl_oob_ioctl(mutex->u.active.efd, EVL_MONIOC_EXIT, NULL);
+	__evl_fpstat_slow(EVL_FPSTAT_UNLOCK_MUTEX, mode);
 
-	return ret ? -errno : 0;
+	return ret;
 }
 
 int evl_set_mutex_ceiling(struct evl_mutex *mutex,
@@ -4,15 +4,22 @@
  * Copyright (C) 2020 Philippe Gerum  <rpm@xenomai.org>
  */
 
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 #include <evl/compiler.h>
 #include <evl/sys.h>
 #include <evl/thread.h>
 #include <evl/observable.h>
 #include <evl/observable-evl.h>
+#include <evl/timer-evl.h>
 #include <evl/syscall.h>
 #include <evl/syscall-evl.h>
 #include "internal.h"
@@ -65,40 +72,77 @@ int evl_update_observable(int ofd, const struct evl_notice *ntc, int nr)
 	return ret / sizeof(*ntc);
 }
 
+#if !(__WORDSIZE == 64 || __TIMESIZE == 64)
+
+/*
+ * Most notifications the legacy 32bit path may pull with a single
+ * read request, which bounds the scratch array on the stack.
+ */
+#define NOTIFY_READ_MAX		128
+
+static ssize_t read_chunk(int ofd, struct evl_notification *nf, int nr,
+		ssize_t (*readfn)(int ofd, void *buf, size_t count))
+{
+	struct __evl_notification _nf[nr];
+	ssize_t ret;
+	int n;
+
+	ret = readfn(ofd, _nf, nr * sizeof(_nf[0]));
+	if (ret <= 0)
+		return ret;
+
+	ret /= sizeof(_nf[0]);
+	for (n = 0; n < ret; n++, nf++) {
+		nf->tag = _nf[n].tag;
+		nf->serial = _nf[n].serial;
+		nf->issuer = _nf[n].issuer;
+		nf->event = _nf[n].event;
+		nf->date.tv_sec = (long)_nf[n].date.tv_sec;
+		nf->date.tv_nsec = _nf[n].date.tv_nsec;
+	}
+
+	return ret;
+}
+
+#endif
+
 static ssize_t do_read(int ofd, struct evl_notification *nf, int nr,
 		ssize_t (*readfn)(int ofd, void *buf, size_t count))
 {
-	struct __evl_notification _nf __maybe_unused;
 	ssize_t ret, _ret __maybe_unused;
+	int count __maybe_unused;
 
 	/*
 	 * This mess is exclusively intended not to expose the
 	 * __evl_timespec type embedded into the __evl_notification
 	 * descriptor to users.  Legacy 32bit systems with
 	 * Y0238-unsafe C libraries have to pay a price for this, by
-	 * reading every notification one after another instead of
-	 * pulling a bulk - this stupidly trivial way seems acceptable
-	 * for those platforms.  For all others, struct __evl_timespec
-	 * used in kernel space and timespec in userland have the same
-	 * memory layout, so we may read the notifications in one gulp
-	 * directly into the user buffer.
+	 * pulling the notifications into a scratch array sized after
+	 * the request, converting them to the user layout
+	 * afterwards. Up to NOTIFY_READ_MAX notifications, this takes
+	 * a single read request like a bulk read would. Beyond that,
+	 * the request is split into chunks, reading stops as soon as
+	 * a chunk comes back short, but a chunk coming back full may
+	 * cause the next one to wait for more notifications.  For all
+	 * others, struct __evl_timespec used in kernel space and
+	 * timespec in userland have the same memory layout, so we may
+	 * read the notifications in one gulp directly into the user
+	 * buffer.
 	 */
 #if __WORDSIZE == 64 || __TIMESIZE == 64
 	ret = readfn(ofd, nf, nr * sizeof(*nf));
 #else
 	ret = 0;
-	while (nr-- > 0) {
-		_ret = readfn(ofd, &_nf, sizeof(_nf));
+	while (nr > 0) {
+		count = nr < NOTIFY_READ_MAX ? nr : NOTIFY_READ_MAX;
+		_ret = read_chunk(ofd, nf, count, readfn);
 		if (_ret <= 0)
 			return ret ?: _ret;
-		nf->tag = _nf.tag;
-		nf->serial = _nf.serial;
-		nf->issuer = _nf.issuer;
-		nf->event = _nf.event;
-		nf->date.tv_sec = (long)_nf.date.tv_sec;
-		nf->date.tv_nsec = _nf.date.tv_nsec;
-		ret += sizeof(*nf);
-		nf++;
+		nf += _ret;
+		ret += _ret * sizeof(*nf);
+		if (_ret < count)
+			break;
+		nr -= count;
 	}
 #endif
 
@@ -118,3 +162,591 @@ int evl_read_observable(int ofd, struct evl_notification *nf, int nr)
 
 	return ret / sizeof(*nf);
 }
+
+void evl_reset_notify_latency(struct evl_notify_latency *lat)
+{
+	memset(lat, 0, sizeof(*lat));
+	lat->min_ns = ~0ULL;
+}
+
+static void account_latency(struct evl_notify_latency *lat, __u64 delta)
+{
+	int bucket;
+
+	bucket = delta ? 63 - __builtin_clzll(delta) : 0;
+	if (bucket >= EVL_LATENCY_BUCKETS)
+		bucket = EVL_LATENCY_BUCKETS - 1;
+
+	lat->buckets[bucket]++;
+	lat->count++;
+	lat->sum_ns += delta;
+	if (delta < lat->min_ns)
+		lat->min_ns = delta;
+	if (delta > lat->max_ns)
+		lat->max_ns = delta;
+}
+
+/*
+ * Same as evl_read_observable(), also returning the delivery date of
+ * the notifications read, which is sampled once from the vDSO for
+ * the whole batch. If @lat is non-NULL, the delivery latency of
+ * each notification is accounted for into this histogram, which
+ * the caller should have cleared with evl_reset_notify_latency()
+ * first.
+ */
+int evl_read_observable_stamped(int ofd, struct evl_notification *nf,
+				int nr, struct timespec *delivered,
+				struct evl_notify_latency *lat)
+{
+	struct timespec now;
+	__s64 delta;
+	int ret, n;
+
+	ret = evl_read_observable(ofd, nf, nr);
+	if (ret <= 0)
+		return ret;
+
+	__evl_clock_gettime(CLOCK_MONOTONIC, &now);
+	if (delivered)
+		*delivered = now;
+
+	if (lat == NULL)
+		return ret;
+
+	for (n = 0; n < ret; n++) {
+		delta = (now.tv_sec - nf[n].date.tv_sec) * 1000000000LL +
+			(now.tv_nsec - nf[n].date.tv_nsec);
+		account_latency(lat, delta < 0 ? 0 : delta);
+	}
+
+	return ret;
+}
+
+/*
+ * Return an upper bound of the latency below which @percent of the
+ * notifications were delivered, i.e. the upper limit of the bucket
+ * holding this percentile, capped by the maximum latency observed.
+ */
+__u64 evl_get_latency_percentile(const struct evl_notify_latency *lat,
+				unsigned int percent)
+{
+	unsigned long long threshold, sum = 0;
+	__u64 limit;
+	int n;
+
+	if (lat->count == 0)
+		return 0;
+
+	if (percent > 100)
+		percent = 100;
+
+	threshold = ((unsigned long long)lat->count * percent + 99) / 100;
+	for (n = 0; n < EVL_LATENCY_BUCKETS - 1; n++) {
+		sum += lat->buckets[n];
+		if (sum >= threshold && sum > 0)
+			break;
+	}
+
+	/* The last bucket has no upper limit. */
+	if (n == EVL_LATENCY_BUCKETS - 1)
+		return lat->max_ns;
+
+	limit = (2ULL << n) - 1;
+
+	return limit < lat->max_ns ? limit : lat->max_ns;
+}
+
+/*
+ * Latest-value slots are looked up by open addressing on the tag,
+ * each one fills a cache line so that updates to different tags do
+ * not bounce the same line between CPUs. A slot is claimed once for
+ * good by storing its key (tag + 1), the seqlock then protects the
+ * value fields. All fields are accessed atomically, so that a
+ * reader racing with the writer may see a mix of old and new values
+ * but can never trip on undefined behavior, the sequence check then
+ * tells it to retry.
+ */
+#define LATEST_MAGIC	0x4c415456	/* LATV */
+
+struct latest_header {
+	__u32 magic;
+	__u32 nr_slots;
+} __attribute__((aligned(64)));
+
+struct latest_slot {
+	__u32 key;
+	__u32 seq;
+	__u32 serial;
+	__s32 issuer;
+	__s64 event;
+	__s64 sec;
+	__s64 nsec;
+} __attribute__((aligned(64)));
+
+static inline struct latest_slot *get_slots(struct evl_latest_values *lv)
+{
+	return lv->base + sizeof(struct latest_header);
+}
+
+static int map_latest_values(struct evl_latest_values *lv, int ofd,
+			int memfd, size_t len)
+{
+	void *base;
+
+	base = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+	if (base == MAP_FAILED)
+		return -errno;
+
+	lv->ofd = ofd;
+	lv->memfd = memfd;
+	lv->base = base;
+	lv->len = len;
+	lv->issuer = getpid();
+
+	return 0;
+}
+
+/*
+ * Create a latest-value channel for up to @nr_tags tags on top of
+ * observable @ofd, which may be -1 if no history is needed.
+ */
+int evl_create_latest_values(struct evl_latest_values *lv,
+			int ofd, int nr_tags)
+{
+	struct latest_header *hdr;
+	int memfd, ret, nr_slots;
+	size_t len;
+
+	if (nr_tags <= 0 || nr_tags > 65536)
+		return -EINVAL;
+
+	/* Keep the table at most half full, probes stay short. */
+	for (nr_slots = 2; nr_slots < 2 * nr_tags; nr_slots <<= 1)
+		;
+
+	memfd = memfd_create("evl-latest", MFD_CLOEXEC);
+	if (memfd < 0)
+		return -errno;
+
+	len = sizeof(*hdr) + nr_slots * sizeof(struct latest_slot);
+	if (ftruncate(memfd, len)) {
+		ret = -errno;
+		goto fail;
+	}
+
+	ret = map_latest_values(lv, ofd, memfd, len);
+	if (ret)
+		goto fail;
+
+	hdr = lv->base;
+	hdr->nr_slots = nr_slots;
+	__atomic_store_n(&hdr->magic, LATEST_MAGIC, __ATOMIC_RELEASE);
+	lv->nr_slots = nr_slots;
+
+	return 0;
+fail:
+	close(memfd);
+
+	return ret;
+}
+
+/* @memfd is owned by the channel on success. */
+int evl_open_latest_values(struct evl_latest_values *lv,
+			int ofd, int memfd)
+{
+	struct latest_header *hdr;
+	struct stat st;
+	int ret;
+
+	if (fstat(memfd, &st))
+		return -errno;
+
+	if ((size_t)st.st_size < sizeof(*hdr))
+		return -EINVAL;
+
+	ret = map_latest_values(lv, ofd, memfd, st.st_size);
+	if (ret)
+		return ret;
+
+	hdr = lv->base;
+	if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != LATEST_MAGIC ||
+		sizeof(*hdr) + hdr->nr_slots * sizeof(struct latest_slot) >
+		lv->len) {
+		munmap(lv->base, lv->len);
+		lv->base = NULL;
+		return -EINVAL;
+	}
+
+	lv->nr_slots = hdr->nr_slots;
+
+	return 0;
+}
+
+int evl_close_latest_values(struct evl_latest_values *lv)
+{
+	if (lv->base == NULL)
+		return -EINVAL;
+
+	munmap(lv->base, lv->len);
+	close(lv->memfd);
+	lv->base = NULL;
+
+	return 0;
+}
+
+static struct latest_slot *find_slot(struct evl_latest_values *lv,
+				__u32 tag, bool claim)
+{
+	struct latest_slot *slots = get_slots(lv), *slot;
+	__u32 key = tag + 1, mask = lv->nr_slots - 1, pos, cur;
+	int n;
+
+	pos = (tag * 2654435761U) & mask;
+
+	for (n = 0; n < lv->nr_slots; n++, pos = (pos + 1) & mask) {
+		slot = slots + pos;
+		cur = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+		if (cur == key)
+			return slot;
+		if (cur)
+			continue;
+		if (!claim)
+			return NULL;
+		/* Another publisher may be claiming this slot too. */
+		if (__atomic_compare_exchange_n(&slot->key, &cur, key,
+				false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ||
+			cur == key)
+			return slot;
+	}
+
+	return NULL;
+}
+
+/*
+ * Publish the notices into their slots, then forward them to the
+ * observable. Returns the number of notices the observable accepted,
+ * or @nr if the channel has no observable. All tags are validated
+ * and their slots claimed before anything is published, so that a
+ * failed request leaves the channel untouched.
+ */
+int evl_update_latest(struct evl_latest_values *lv,
+		const struct evl_notice *ntc, int nr)
+{
+	struct latest_slot *slot;
+	struct timespec now;
+	union evl_value v;
+	__u32 seq;
+	int n;
+
+	for (n = 0; n < nr; n++) {
+		if (ntc[n].tag < EVL_NOTICE_USER || ntc[n].tag == ~0U)
+			return -EINVAL;
+	}
+
+	for (n = 0; n < nr; n++) {
+		if (find_slot(lv, ntc[n].tag, true) == NULL)
+			return -ENOSPC;
+	}
+
+	__evl_clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (n = 0; n < nr; n++) {
+		slot = find_slot(lv, ntc[n].tag, false);
+		v = ntc[n].event;
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		__atomic_store_n(&slot->serial, slot->serial + 1,
+				__ATOMIC_RELAXED);
+		__atomic_store_n(&slot->issuer, lv->issuer, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->event, v.lval, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->sec, now.tv_sec, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->nsec, now.tv_nsec, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+	}
+
+	if (lv->ofd < 0)
+		return nr;
+
+	return evl_update_observable(lv->ofd, ntc, nr);
+}
+
+/*
+ * Sample the latest notification issued for @tag, which requires no
+ * system call. nf->serial counts the updates of this tag, so that
+ * readers can tell whether they missed some. The publisher may be
+ * preempted in the middle of an update, or update the slot faster
+ * than we can read it: -EAGAIN is returned if no consistent sample
+ * could be obtained after a few attempts.
+ */
+#define LATEST_READ_RETRIES	64
+
+int evl_read_latest(struct evl_latest_values *lv, __u32 tag,
+		struct evl_notification *nf)
+{
+	struct latest_slot *slot;
+	union evl_value v;
+	int retries = 0;
+	__u32 seq;
+
+	slot = find_slot(lv, tag, false);
+	if (slot == NULL)
+		return -ENOENT;
+
+	for (;; retries++) {
+		if (retries >= LATEST_READ_RETRIES)
+			return -EAGAIN;
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		nf->serial = __atomic_load_n(&slot->serial, __ATOMIC_RELAXED);
+		nf->issuer = __atomic_load_n(&slot->issuer, __ATOMIC_RELAXED);
+		v.lval = __atomic_load_n(&slot->event, __ATOMIC_RELAXED);
+		nf->date.tv_sec = __atomic_load_n(&slot->sec, __ATOMIC_RELAXED);
+		nf->date.tv_nsec = __atomic_load_n(&slot->nsec,
+						__ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+
+	/* Slot claimed, but not published yet. */
+	if (seq == 0)
+		return -ENOENT;
+
+	nf->tag = tag;
+	nf->event = v;
+
+	return 0;
+}
+
+static __u64 get_stamp(void)
+{
+	struct timespec now;
+
+	__evl_clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+ * The notice buffer and the deadline timer are allocated upfront,
+ * evl_publish() never allocates resources. The timer is
+ * non-blocking, so that evl_expire_publisher() never waits.
+ */
+int evl_init_publisher(struct evl_publisher *pub, int ofd,
+		int max_count, __u64 max_delay_ns)
+{
+	int ret;
+
+	if (max_count <= 0)
+		return -EINVAL;
+
+	memset(pub, 0, sizeof(*pub));
+	pub->tfd = -1;
+	pub->pending = malloc(max_count * sizeof(*pub->pending));
+	if (pub->pending == NULL)
+		return -ENOMEM;
+
+	if (max_delay_ns) {
+		pub->tfd = evl_new_timer(EVL_CLOCK_MONOTONIC);
+		if (pub->tfd < 0) {
+			ret = pub->tfd;
+			goto fail;
+		}
+		if (fcntl(pub->tfd, F_SETFL,
+				fcntl(pub->tfd, F_GETFL) | O_NONBLOCK)) {
+			ret = -errno;
+			close(pub->tfd);
+			goto fail;
+		}
+	}
+
+	pub->ofd = ofd;
+	pub->max_count = max_count;
+	pub->max_delay_ns = max_delay_ns;
+
+	return 0;
+fail:
+	free(pub->pending);
+	pub->pending = NULL;
+
+	return ret;
+}
+
+/* Should be called in-band, the tag table may have to grow. */
+int evl_set_coalescing(struct evl_publisher *pub,
+		__u32 tag, bool enabled)
+{
+	__u32 *tags;
+	int n;
+
+	for (n = 0; n < pub->nr_coalescable; n++) {
+		if (pub->coalescable[n] == tag)
+			break;
+	}
+
+	if (n < pub->nr_coalescable) {
+		if (!enabled)
+			pub->coalescable[n] =
+				pub->coalescable[--pub->nr_coalescable];
+		return 0;
+	}
+
+	if (!enabled)
+		return 0;
+
+	tags = realloc(pub->coalescable, (n + 1) * sizeof(*tags));
+	if (tags == NULL)
+		return -ENOMEM;
+
+	tags[n] = tag;
+	pub->coalescable = tags;
+	pub->nr_coalescable++;
+
+	return 0;
+}
+
+static bool is_coalescable(struct evl_publisher *pub, __u32 tag)
+{
+	int n;
+
+	for (n = 0; n < pub->nr_coalescable; n++) {
+		if (pub->coalescable[n] == tag)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Post all pending notices at once, returning the number of notices
+ * the observable accepted. Notices it turned down are dropped.
+ */
+int evl_flush_publisher(struct evl_publisher *pub)
+{
+	int ret, nr = pub->nr_pending;
+
+	if (nr == 0)
+		return 0;
+
+	pub->nr_pending = 0;
+	pub->stats.flushes++;
+
+	ret = evl_update_observable(pub->ofd, pub->pending, nr);
+	if (ret < 0) {
+		pub->stats.dropped += nr;
+		return ret;
+	}
+
+	pub->stats.sent += ret;
+	pub->stats.dropped += nr - ret;
+
+	return ret;
+}
+
+static int arm_deadline(struct evl_publisher *pub)
+{
+	__u64 date = pub->first_stamp + pub->max_delay_ns;
+	struct itimerspec value;
+
+	value.it_value.tv_sec = date / 1000000000ULL;
+	value.it_value.tv_nsec = date % 1000000000ULL;
+	value.it_interval.tv_sec = 0;
+	value.it_interval.tv_nsec = 0;
+
+	return evl_set_timer(pub->tfd, &value, NULL);
+}
+
+int evl_publish(struct evl_publisher *pub,
+		__u32 tag, union evl_value event)
+{
+	bool was_empty = pub->nr_pending == 0;
+	struct evl_notice *ntc;
+	__u64 now = get_stamp();
+	int n, ret;
+
+	if (is_coalescable(pub, tag)) {
+		for (n = 0; n < pub->nr_pending; n++) {
+			if (pub->pending[n].tag != tag)
+				continue;
+			memmove(pub->pending + n, pub->pending + n + 1,
+				(pub->nr_pending - n - 1) * sizeof(*ntc));
+			pub->nr_pending--;
+			pub->stats.coalesced++;
+			break;
+		}
+	}
+
+	/*
+	 * The deadline runs from the oldest unsent update. A timer
+	 * left armed by a batch which has been flushed since is
+	 * simply reprogrammed.
+	 */
+	if (was_empty) {
+		pub->first_stamp = now;
+		if (pub->tfd >= 0) {
+			ret = arm_deadline(pub);
+			if (ret)
+				return ret;
+		}
+	}
+
+	ntc = pub->pending + pub->nr_pending++;
+	ntc->tag = tag;
+	ntc->event = event;
+	pub->stats.published++;
+
+	if (pub->nr_pending >= pub->max_count ||
+		(pub->max_delay_ns &&
+			now - pub->first_stamp >= pub->max_delay_ns)) {
+		ret = evl_flush_publisher(pub);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Acknowledge the deadline timer, flushing the pending notices if
+ * the oldest one is due. Returns the number of notices sent.
+ */
+int evl_expire_publisher(struct evl_publisher *pub)
+{
+	__u64 ticks;
+	ssize_t ret;
+
+	if (pub->tfd < 0)
+		return -EINVAL;
+
+	if (__evl_is_inband())
+		ret = read(pub->tfd, &ticks, sizeof(ticks));
+	else
+		ret = oob_read(pub->tfd, &ticks, sizeof(ticks));
+	if (ret < 0 && errno != EAGAIN)
+		return -errno;
+
+	if (pub->nr_pending == 0 ||
+		get_stamp() - pub->first_stamp < pub->max_delay_ns)
+		return 0;
+
+	return evl_flush_publisher(pub);
+}
+
+int evl_destroy_publisher(struct evl_publisher *pub)
+{
+	int ret;
+
+	ret = evl_flush_publisher(pub);
+	if (pub->tfd >= 0) {
+		close(pub->tfd);
+		pub->tfd = -1;
+	}
+	free(pub->pending);
+	free(pub->coalescable);
+	pub->pending = NULL;
+	pub->coalescable = NULL;
+
+	return ret < 0 ? ret : 0;
+}
@@ -63,9 +63,9 @@ static int do_poll(int efd, struct evl_poll_event *pollset,
 	wreq.timeout_ptr = __evl_ktimespec_ptr64(timeout, kts);
 	wreq.pollset_ptr = __evl_ptr64(pollset);
 	wreq.nrset = nrset;
-	ret = oob_ioctl(efd, EVL_POLIOC_WAIT, &wreq);
+	ret = __evl_oob_ioctl(efd, EVL_POLIOC_WAIT, &wreq);
 	if (ret)
-		return -errno;
+		return ret;
 
 	return wreq.nrset;
 }
@@ -8,6 +8,11 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <evl/list.h>
 #include <evl/sys.h>
 #include <evl/proxy.h>
 #include <evl/proxy-evl.h>
@@ -24,6 +29,58 @@ char fmt_buf[1024];
 
 static int evl_outfd = -EBADF, evl_errfd = -EBADF;
 
+/*
+ * Batched printing: when enabled, evl_vprint_proxy() appends the
+ * formatted output to a per-thread staging buffer instead of writing
+ * it to the proxy right away. The buffer goes to the proxy in a
+ * single write when the next output would not fit, when the oldest
+ * output it holds has been waiting for longer than the configured
+ * delay, or upon evl_flush_print(). Outputs are never split across
+ * writes. Output which the proxy did not accept stays staged for the
+ * next flush. The owner claims its buffer with an atomic state
+ * change, so no lock is needed on the fast path. An in-band flusher
+ * thread pushes the outputs which are due on behalf of owners which
+ * do not print again, holding batch_lock while it owns a buffer. At
+ * exit, idle buffers are claimed for good and flushed on behalf of
+ * their owners, which then write directly. Owners caught printing
+ * flush their own buffer when done.
+ */
+enum {
+	BATCH_IDLE,
+	BATCH_OWNED,
+	BATCH_FLUSHING,
+	BATCH_EXITED,
+};
+
+struct print_batch {
+	struct list_head next;
+	int state;
+	int proxyfd;
+	size_t bufsz;
+	size_t fill;
+	__u64 first_stamp;
+	char buf[];
+};
+
+static size_t batch_bufsz;
+
+static __u64 batch_delay;
+
+static bool batch_exiting;
+
+static bool batch_flusher;
+
+static DEFINE_LIST_HEAD(batch_list);
+
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t batch_once = PTHREAD_ONCE_INIT;
+
+static pthread_key_t batch_key;
+
+static __thread __attribute__ ((tls_model (EVL_TLS_MODEL)))
+struct print_batch *print_batch;
+
 void __evl_setup_proxies(void)
 {
 	/*
@@ -66,7 +123,11 @@ ssize_t evl_write_proxy(int proxyfd, const void *buf, size_t count)
 {
 	ssize_t ret;
 
-	ret = __evl_conforming_io(proxyfd, write, buf, count);
+	/* __evl_conforming_io() would not return the byte count. */
+	if (__evl_is_inband())
+		ret = write(proxyfd, buf, count);
+	else
+		ret = oob_write(proxyfd, buf, count);
 
 	return ret < 0 ? -errno : ret;
 }
@@ -75,14 +136,349 @@ ssize_t evl_read_proxy(int proxyfd, void *buf, size_t count)
 {
 	ssize_t ret;
 
-	ret = __evl_conforming_io(proxyfd, read, buf, count);
+	if (__evl_is_inband())
+		ret = read(proxyfd, buf, count);
+	else
+		ret = oob_read(proxyfd, buf, count);
 
 	return ret < 0 ? -errno : ret;
 }
 
+static __u64 get_stamp(void)
+{
+	struct timespec now;
+
+	__evl_clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (__u64)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int flush_batch(struct print_batch *b)
+{
+	ssize_t ret;
+
+	if (b->fill == 0)
+		return 0;
+
+	ret = evl_write_proxy(b->proxyfd, b->buf, b->fill);
+	if (ret < 0)
+		return ret;
+
+	/* Keep what did not make it, in order. */
+	b->fill -= ret;
+	if (b->fill > 0) {
+		memmove(b->buf, b->buf + ret, b->fill);
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+static bool switch_batch(struct print_batch *b, int state)
+{
+	int idle = BATCH_IDLE;
+
+	return __atomic_compare_exchange_n(&b->state, &idle, state, false,
+					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline bool own_batch(struct print_batch *b)
+{
+	return switch_batch(b, BATCH_OWNED);
+}
+
+/*
+ * Either the exit flush claims the buffer once released, or we see
+ * that it failed to and flush it ourselves.
+ */
+static void release_batch(struct print_batch *b)
+{
+	__atomic_store_n(&b->state, BATCH_IDLE, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&batch_exiting, __ATOMIC_SEQ_CST) &&
+		switch_batch(b, BATCH_EXITED))
+		flush_batch(b);
+}
+
+/* The exit flush holds batch_lock while it uses the buffer. */
+static void free_batch(struct print_batch *b)
+{
+	pthread_mutex_lock(&batch_lock);
+	list_remove(&b->next);
+	pthread_mutex_unlock(&batch_lock);
+	free(b);
+}
+
+/*
+ * The flusher thread owns the buffer while holding batch_lock, wait
+ * for it to let go. This may switch the caller in-band.
+ */
+static bool wait_batch(struct print_batch *b)
+{
+	bool owned;
+
+	pthread_mutex_lock(&batch_lock);
+	owned = own_batch(b);
+	pthread_mutex_unlock(&batch_lock);
+
+	return owned;
+}
+
+static void drop_batch(void *arg)
+{
+	struct print_batch *b = arg;
+
+	if (own_batch(b) || wait_batch(b))
+		flush_batch(b);
+
+	free_batch(b);
+}
+
+/* Threads which are still around at exit get flushed too. */
+static void flush_at_exit(void)
+{
+	struct print_batch *b;
+
+	__atomic_store_n(&batch_exiting, true, __ATOMIC_SEQ_CST);
+
+	pthread_mutex_lock(&batch_lock);
+	list_for_each_entry(b, &batch_list, next) {
+		if (switch_batch(b, BATCH_EXITED))
+			flush_batch(b);
+	}
+	pthread_mutex_unlock(&batch_lock);
+}
+
+#define FLUSHER_MAX_SLEEP	1000000000ULL
+
+/*
+ * Flush the outputs which are due, then sleep until the next
+ * deadline, which owners starting a new batch meanwhile cannot
+ * precede. Buffers which the proxy did not drain are retried after
+ * a full delay.
+ */
+static void *flush_batches(void *arg)
+{
+	__u64 delay, now, next, age;
+	struct print_batch *b;
+	struct timespec ts;
+
+	for (;;) {
+		delay = __atomic_load_n(&batch_delay, __ATOMIC_RELAXED);
+		now = get_stamp();
+		if (delay == 0 || delay > FLUSHER_MAX_SLEEP)
+			next = now + FLUSHER_MAX_SLEEP;
+		else
+			next = now + delay;
+
+		pthread_mutex_lock(&batch_lock);
+		list_for_each_entry(b, &batch_list, next) {
+			if (!switch_batch(b, BATCH_FLUSHING))
+				continue;
+			if (b->fill > 0) {
+				age = now - b->first_stamp;
+				if (age >= delay)
+					flush_batch(b);
+				else if (delay - age < next - now)
+					next = now + delay - age;
+			}
+			release_batch(b);
+		}
+		pthread_mutex_unlock(&batch_lock);
+
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	return NULL;
+}
+
+/*
+ * Start the flusher on first use, and again in a forked child which
+ * inherited the staging buffer of its parent but not the thread.
+ */
+static void start_flusher(void)
+{
+	pthread_attr_t attr;
+	pthread_t tid;
+
+	pthread_mutex_lock(&batch_lock);
+
+	if (!batch_flusher) {
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (!pthread_create(&tid, &attr, flush_batches, NULL))
+			__atomic_store_n(&batch_flusher, true, __ATOMIC_RELAXED);
+		pthread_attr_destroy(&attr);
+	}
+
+	pthread_mutex_unlock(&batch_lock);
+}
+
+static void lock_batches(void)
+{
+	pthread_mutex_lock(&batch_lock);
+}
+
+static void unlock_batches(void)
+{
+	pthread_mutex_unlock(&batch_lock);
+}
+
+static void reset_flusher(void)
+{
+	batch_flusher = false;
+	pthread_mutex_unlock(&batch_lock);
+}
+
+static void init_batching_once(void)
+{
+	pthread_key_create(&batch_key, drop_batch);
+	pthread_atfork(lock_batches, unlock_batches, reset_flusher);
+	atexit(flush_at_exit);
+}
+
+/*
+ * Get the staging buffer of the current thread if batching is
+ * enabled, owned by the caller until release_batch(). Allocating the
+ * buffer, starting the flusher or racing with it may switch the
+ * caller in-band.
+ */
+static struct print_batch *get_batch(int proxyfd)
+{
+	size_t bufsz = __atomic_load_n(&batch_bufsz, __ATOMIC_RELAXED);
+	struct print_batch *b = print_batch;
+
+	if (bufsz && !__atomic_load_n(&batch_flusher, __ATOMIC_RELAXED))
+		start_flusher();
+
+	if (b) {
+		/* Claimed by the exit flush, write directly. */
+		if (!own_batch(b) && !wait_batch(b))
+			return NULL;
+		if (b->bufsz != bufsz || b->proxyfd != proxyfd) {
+			/* Keep the output ordered across changes. */
+			flush_batch(b);
+			if (b->bufsz != bufsz) {
+				pthread_setspecific(batch_key, NULL);
+				free_batch(b);
+				print_batch = b = NULL;
+			} else {
+				b->proxyfd = proxyfd;
+			}
+		}
+	}
+
+	if (b || bufsz == 0)
+		return b;
+
+	b = malloc(sizeof(*b) + bufsz);
+	if (b == NULL)
+		return NULL;
+
+	b->state = BATCH_OWNED;
+	b->proxyfd = proxyfd;
+	b->bufsz = bufsz;
+	b->fill = 0;
+	pthread_mutex_lock(&batch_lock);
+	list_append(&b->next, &batch_list);
+	pthread_mutex_unlock(&batch_lock);
+	pthread_setspecific(batch_key, b);
+	print_batch = b;
+
+	return b;
+}
+
+static ssize_t vprint_batch(struct print_batch *b,
+			const char *fmt, va_list ap)
+{
+	ssize_t count, ret;
+	size_t room;
+	va_list aq;
+
+	room = b->bufsz - b->fill;
+	va_copy(aq, ap);
+	count = vsnprintf(b->buf + b->fill, room, fmt, aq);
+	va_end(aq);
+	if (count < 0)
+		return -errno;
+
+	/* The output would not fit, flush and retry once. */
+	if ((size_t)count >= room) {
+		ret = flush_batch(b);
+		if (ret)
+			return ret;
+		count = vsnprintf(b->buf, b->bufsz, fmt, ap);
+		if (count < 0)
+			return -errno;
+		/* Too large for batching, send it on its own. */
+		if ((size_t)count >= b->bufsz)
+			return -ENOSPC;
+	}
+
+	if (b->fill == 0)
+		b->first_stamp = get_stamp();
+
+	b->fill += count;
+
+	/* The output is staged, a failed flush is retried later. */
+	if (get_stamp() - b->first_stamp >= batch_delay)
+		flush_batch(b);
+
+	return count;
+}
+
+/*
+ * Enable batched printing with per-thread staging buffers of
+ * @bufsz bytes, outputs waiting no longer than @max_delay_ns. A
+ * zero size disables batching, each thread flushing its buffer on
+ * its next print.
+ */
+int evl_set_print_batching(size_t bufsz, __u64 max_delay_ns)
+{
+	pthread_once(&batch_once, init_batching_once);
+	__atomic_store_n(&batch_delay, max_delay_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&batch_bufsz, bufsz, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/* Push the outputs the current thread has staged to the proxy. */
+int evl_flush_print(void)
+{
+	struct print_batch *b = print_batch;
+	int ret;
+
+	if (b == NULL || (!own_batch(b) && !wait_batch(b)))
+		return 0;
+
+	ret = flush_batch(b);
+	release_batch(b);
+
+	return ret;
+}
+
 ssize_t evl_vprint_proxy(int proxyfd, const char *fmt, va_list ap)
 {
-	ssize_t count = vsnprintf(fmt_buf, sizeof(fmt_buf), fmt, ap), ret;
+	struct print_batch *b;
+	ssize_t count, ret;
+	va_list aq;
+
+	if (proxyfd >= 0 && (print_batch ||
+		__atomic_load_n(&batch_bufsz, __ATOMIC_RELAXED))) {
+		b = get_batch(proxyfd);
+		if (b) {
+			va_copy(aq, ap);
+			ret = vprint_batch(b, fmt, aq);
+			va_end(aq);
+			release_batch(b);
+			if (ret != -ENOSPC)
+				return ret;
+		}
+	}
+
+	count = vsnprintf(fmt_buf, sizeof(fmt_buf), fmt, ap);
 
 	if (count < 0)
 		return -errno;	/* assume POSIX behavior. */
@@ -0,0 +1,453 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <evl/proxy.h>
+#include <evl/proxy-evl.h>
+#include "internal.h"
+
+/*
+ * A file proxy relays the output of a proxy to a pipe, which an
+ * in-band drainer thread empties into the current log file. Disk
+ * I/O, rotation and compression all happen in-band, so out-of-band
+ * writers can only observe the proxy buffer filling up, in which
+ * case the output is dropped and accounted for instead of blocking
+ * the caller.
+ */
+#define DRAIN_CHUNK	4096
+
+extern char **environ;
+
+static __u64 get_stamp(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int open_file(struct evl_file_proxy *fp)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(fp->path, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+
+	fp->filefd = fd;
+	fp->filesz = fstat(fd, &st) ? 0 : st.st_size;
+	fp->opened_at = get_stamp();
+
+	return 0;
+}
+
+static void wait_compressor(struct evl_file_proxy *fp)
+{
+	int status, ret;
+
+	if (fp->compressor <= 0)
+		return;
+
+	do
+		ret = waitpid(fp->compressor, &status, 0);
+	while (ret < 0 && errno == EINTR);
+
+	if (ret < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+		fp->stats.errors++;
+
+	fp->compressor = 0;
+}
+
+static void start_compressor(struct evl_file_proxy *fp, char *name)
+{
+	char *argv[] = { "gzip", "-f", "--", name, NULL };
+	int ret;
+
+	ret = posix_spawnp(&fp->compressor, "gzip", NULL, NULL,
+			argv, environ);
+	if (ret) {
+		fp->compressor = 0;
+		fp->stats.errors++;
+	}
+}
+
+static int rename_file(struct evl_file_proxy *fp,
+			int from, int to, const char *suffix)
+{
+	char *oldname, *newname;
+	int ret = -ENOMEM;
+
+	if (asprintf(&oldname, "%s.%d%s", fp->path, from, suffix) < 0)
+		return ret;
+
+	if (asprintf(&newname, "%s.%d%s", fp->path, to, suffix) >= 0) {
+		ret = rename(oldname, newname) ? -errno : 0;
+		free(newname);
+	}
+
+	free(oldname);
+
+	return ret;
+}
+
+/*
+ * A rotated file stays uncompressed if gzip is missing or failed,
+ * so shift the plain name too when compressing.
+ */
+static void shift_file(struct evl_file_proxy *fp, int from, int to)
+{
+	int ret;
+
+	if (fp->rotation.compress) {
+		ret = rename_file(fp, from, to, ".gz");
+		if (ret && ret != -ENOENT)
+			fp->stats.errors++;
+	}
+
+	ret = rename_file(fp, from, to, "");
+	if (ret && ret != -ENOENT)
+		fp->stats.errors++;
+}
+
+/*
+ * Called with fp->lock held. The previous compression job has to
+ * finish before the rotated files are renamed, since gzip creates
+ * <path>.1.gz once done with <path>.1.
+ */
+static int rotate_file(struct evl_file_proxy *fp)
+{
+	char *name;
+	int n;
+
+	wait_compressor(fp);
+
+	if (fp->filefd >= 0) {
+		close(fp->filefd);
+		fp->filefd = -1;
+	}
+
+	if (fp->rotation.keep <= 0) {
+		if (truncate(fp->path, 0) && errno != ENOENT)
+			fp->stats.errors++;
+	} else {
+		for (n = fp->rotation.keep - 1; n > 0; n--)
+			shift_file(fp, n, n + 1);
+
+		if (asprintf(&name, "%s.1", fp->path) < 0)
+			return -ENOMEM;
+
+		if (rename(fp->path, name))
+			fp->stats.errors++;
+		else if (fp->rotation.compress)
+			start_compressor(fp, name);
+
+		free(name);
+	}
+
+	fp->stats.rotations++;
+
+	return open_file(fp);
+}
+
+static void write_file(struct evl_file_proxy *fp,
+		const char *buf, size_t count)
+{
+	ssize_t ret;
+
+	if (fp->filefd < 0 && open_file(fp)) {
+		fp->stats.errors++;
+		return;
+	}
+
+	while (count > 0) {
+		ret = write(fp->filefd, buf, count);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			fp->stats.errors++;
+			return;
+		}
+		buf += ret;
+		count -= ret;
+		fp->filesz += ret;
+		fp->stats.written += ret;
+	}
+
+	if (fp->rotation.max_size && fp->filesz >= fp->rotation.max_size)
+		rotate_file(fp);
+}
+
+static int get_timeout(struct evl_file_proxy *fp)
+{
+	__u64 age, ms;
+
+	if (!fp->rotation.max_age_ns)
+		return -1;
+
+	age = get_stamp() - fp->opened_at;
+	if (age >= fp->rotation.max_age_ns)
+		return 0;
+
+	/* Round up, we don't want to spin on sub-ms leftovers. */
+	ms = (fp->rotation.max_age_ns - age + 999999) / 1000000;
+
+	/* Waking up early only means computing the timeout again. */
+	return ms > INT_MAX ? INT_MAX : (int)ms;
+}
+
+/* Must hold fp->lock. Empty files are not worth rotating. */
+static void rotate_aged_file(struct evl_file_proxy *fp)
+{
+	if (get_timeout(fp) != 0)
+		return;
+
+	if (fp->filesz > 0)
+		rotate_file(fp);
+	else
+		fp->opened_at = get_stamp();
+}
+
+static void *drain_file_proxy(void *arg)
+{
+	struct evl_file_proxy *fp = arg;
+	struct pollfd pfd;
+	char buf[DRAIN_CHUNK];
+	ssize_t count;
+	int ret;
+
+	pfd.fd = fp->pipefd[0];
+	pfd.events = POLLIN;
+
+	for (;;) {
+		pthread_mutex_lock(&fp->lock);
+		ret = get_timeout(fp);
+		pthread_mutex_unlock(&fp->lock);
+
+		ret = poll(&pfd, 1, ret);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (ret == 0) {
+			pthread_mutex_lock(&fp->lock);
+			rotate_aged_file(fp);
+			pthread_mutex_unlock(&fp->lock);
+			continue;
+		}
+
+		count = read(fp->pipefd[0], buf, sizeof(buf));
+		if (count == 0)
+			break;	/* The proxy is gone. */
+
+		if (count < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			break;
+		}
+
+		/* A steady output would never let poll() time out. */
+		pthread_mutex_lock(&fp->lock);
+		write_file(fp, buf, count);
+		rotate_aged_file(fp);
+		pthread_mutex_unlock(&fp->lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * Create a proxy relaying its output to @path, which is rotated
+ * according to @rotation (never if NULL). The proxy is set
+ * non-blocking, so that writers never wait for the drainer to catch
+ * up.
+ */
+int evl_create_file_proxy(struct evl_file_proxy *fp,
+			const char *path, size_t bufsz,
+			const struct evl_rotation *rotation,
+			int flags, const char *fmt, ...)
+{
+	char *name = NULL;
+	va_list ap;
+	int ret;
+
+	memset(fp, 0, sizeof(*fp));
+	fp->efd = -1;
+	fp->filefd = -1;
+	fp->pipefd[0] = fp->pipefd[1] = -1;
+
+	if (rotation)
+		fp->rotation = *rotation;
+
+	fp->path = strdup(path);
+	if (fp->path == NULL)
+		return -ENOMEM;
+
+	if (fmt) {
+		va_start(ap, fmt);
+		ret = vasprintf(&name, fmt, ap);
+		va_end(ap);
+		if (ret < 0) {
+			ret = -ENOMEM;
+			goto fail_name;
+		}
+	}
+
+	ret = open_file(fp);
+	if (ret)
+		goto fail_file;
+
+	if (pipe2(fp->pipefd, O_CLOEXEC)) {
+		ret = -errno;
+		goto fail_pipe;
+	}
+
+	fp->efd = evl_create_proxy(fp->pipefd[1], bufsz, 0, flags,
+				name ? "%s" : NULL, name);
+	if (fp->efd < 0) {
+		ret = fp->efd;
+		goto fail_proxy;
+	}
+
+	if (fcntl(fp->efd, F_SETFL, fcntl(fp->efd, F_GETFL) | O_NONBLOCK)) {
+		ret = -errno;
+		goto fail_thread;
+	}
+
+	pthread_mutex_init(&fp->lock, NULL);
+
+	ret = -pthread_create(&fp->drainer, NULL, drain_file_proxy, fp);
+	if (ret) {
+		pthread_mutex_destroy(&fp->lock);
+		goto fail_thread;
+	}
+
+	free(name);
+
+	return fp->efd;
+
+fail_thread:
+	close(fp->efd);
+fail_proxy:
+	close(fp->pipefd[0]);
+	close(fp->pipefd[1]);
+fail_pipe:
+	close(fp->filefd);
+fail_file:
+	free(name);
+fail_name:
+	free(fp->path);
+
+	return ret;
+}
+
+/*
+ * Output which does not fit in the proxy buffer is dropped, and
+ * accounted for as an overflow.
+ */
+ssize_t evl_write_file_proxy(struct evl_file_proxy *fp,
+			const void *buf, size_t count)
+{
+	ssize_t ret;
+
+	ret = evl_write_proxy(fp->efd, buf, count);
+	if (ret == -EAGAIN || (ret >= 0 && (size_t)ret < count)) {
+		__atomic_add_fetch(&fp->stats.overflows, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&fp->stats.lost,
+				count - (ret < 0 ? 0 : ret), __ATOMIC_RELAXED);
+	}
+
+	return ret;
+}
+
+ssize_t evl_print_file_proxy(struct evl_file_proxy *fp,
+			const char *fmt, ...)
+{
+	char buf[1024];
+	va_list ap;
+	int count;
+
+	va_start(ap, fmt);
+	count = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (count < 0)
+		return -errno;
+
+	if ((size_t)count >= sizeof(buf))
+		count = sizeof(buf) - 1;
+
+	return evl_write_file_proxy(fp, buf, count);
+}
+
+/* Force a rotation, from the in-band stage. */
+int evl_rotate_file_proxy(struct evl_file_proxy *fp)
+{
+	int ret;
+
+	pthread_mutex_lock(&fp->lock);
+	ret = rotate_file(fp);
+	pthread_mutex_unlock(&fp->lock);
+
+	return ret;
+}
+
+int evl_get_file_proxy_stats(struct evl_file_proxy *fp,
+			struct evl_file_proxy_stats *stats)
+{
+	pthread_mutex_lock(&fp->lock);
+	*stats = fp->stats;
+	pthread_mutex_unlock(&fp->lock);
+
+	stats->overflows = __atomic_load_n(&fp->stats.overflows,
+					__ATOMIC_RELAXED);
+	stats->lost = __atomic_load_n(&fp->stats.lost, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/*
+ * Closing the proxy eventually releases the write side of the pipe,
+ * the drainer exits once it has written out the remaining output.
+ */
+int evl_close_file_proxy(struct evl_file_proxy *fp)
+{
+	if (fp->efd < 0)
+		return -EBADF;
+
+	close(fp->efd);
+	fp->efd = -1;
+	close(fp->pipefd[1]);
+	pthread_join(fp->drainer, NULL);
+	close(fp->pipefd[0]);
+
+	pthread_mutex_lock(&fp->lock);
+	wait_compressor(fp);
+	if (fp->filefd >= 0)
+		close(fp->filefd);
+	pthread_mutex_unlock(&fp->lock);
+
+	pthread_mutex_destroy(&fp->lock);
+	free(fp->path);
+
+	return 0;
+}
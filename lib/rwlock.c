@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <evl/rwlock.h>
+#include "internal.h"
 
 #define __RWLOCK_ACTIVE_MAGIC	0xd8d8f9f9
 #define __RWLOCK_DEAD_MAGIC	0
@@ -67,6 +68,7 @@ int evl_lock_read(struct evl_rwlock *rwlock)
 {
 	union __evl_rwlock_inner prev, next;
 	uint32_t oldval;
+	__u64 t0 = 0;
 	int ret;
 
 	ret = check_sanity(rwlock);
@@ -115,6 +117,8 @@ int evl_lock_read(struct evl_rwlock *rwlock)
 		 * resume. Unblocking a thread waiting on a rwlock
 		 * should not be allowed, ignore such requests.
 		 */
+		if (t0 == 0)
+			t0 = __evl_lockstat_stamp();
 		do {
 			ret = evl_wait_exact_flags(&rwlock->event, __EVL_RWLOCK_RD);
 		} while (ret && ret == -EINTR);
@@ -122,6 +126,8 @@ int evl_lock_read(struct evl_rwlock *rwlock)
 			return ret;
 	}
 
+	__evl_lockstat_acquire(rwlock, EVL_LOCKSTAT_RWLOCK_RD, t0);
+
 	return ret;
 }
 
@@ -143,8 +149,12 @@ int evl_trylock_read(struct evl_rwlock *rwlock)
 	next.u.rdpend = 0;
 	next.u.count = prev.u.count - 1;
 	oldval = atomic_cmpxchg(&rwlock->u.lock, prev.value, next.value);
+	if (oldval != prev.value)
+		return -EAGAIN;
+
+	__evl_lockstat_acquire(rwlock, EVL_LOCKSTAT_RWLOCK_RD, 0);
 
-	return oldval == prev.value ? 0 : -EAGAIN;
+	return 0;
 }
 
 int evl_unlock_read(struct evl_rwlock *rwlock)
@@ -153,6 +163,8 @@ int evl_unlock_read(struct evl_rwlock *rwlock)
 	uint32_t oldval;
 	int ret = 0;
 
+	__evl_lockstat_release(rwlock, EVL_LOCKSTAT_RWLOCK_RD);
+
 	for (;;) {
 		prev.value = atomic_read(&rwlock->u.lock);
 		next.u.rdpend = prev.u.rdpend;
@@ -184,6 +196,7 @@ int evl_lock_write(struct evl_rwlock *rwlock)
 {
 	union __evl_rwlock_inner prev, next;
 	uint32_t oldval;
+	__u64 t0 = 0;
 	int ret;
 
 	ret = check_sanity(rwlock);
@@ -228,11 +241,15 @@ int evl_lock_write(struct evl_rwlock *rwlock)
 	 *  which released it.
 	 */
 	if (next.u.count != 0) {
+		t0 = __evl_lockstat_stamp();
 		do {
 			ret = evl_wait_exact_flags(&rwlock->event, __EVL_RWLOCK_WR);
 		} while (ret && ret == -EINTR);
 	}
 
+	if (ret == 0)
+		__evl_lockstat_acquire(rwlock, EVL_LOCKSTAT_RWLOCK_WR, t0);
+
 	return ret;
 }
 
@@ -254,8 +271,12 @@ int evl_trylock_write(struct evl_rwlock *rwlock)
 
 	next.u.rdpend = prev.u.rdpend;
 	oldval = atomic_cmpxchg(&rwlock->u.lock, prev.value, next.value);
+	if (oldval != prev.value)
+		return -EAGAIN;
+
+	__evl_lockstat_acquire(rwlock, EVL_LOCKSTAT_RWLOCK_WR, 0);
 
-	return oldval == prev.value ? 0 : -EAGAIN;
+	return 0;
 }
 
 int evl_unlock_write(struct evl_rwlock *rwlock)
@@ -264,6 +285,8 @@ int evl_unlock_write(struct evl_rwlock *rwlock)
 	uint32_t oldval;
 	int ret = 0;
 
+	__evl_lockstat_release(rwlock, EVL_LOCKSTAT_RWLOCK_WR);
+
 	for (;;) {
 		prev.value = atomic_read(&rwlock->u.lock);
 		if (prev.u.count < 0) {
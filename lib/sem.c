@@ -18,6 +18,7 @@
 #include <evl/atomic.h>
 #include <evl/sys.h>
 #include <evl/sem.h>
+#include <evl/flags.h>
 #include <evl/thread.h>
 #include <evl/thread-evl.h>
 #include <evl/syscall.h>
@@ -27,6 +28,30 @@
 #define __SEM_ACTIVE_MAGIC	0xcb13cb13
 #define __SEM_DEAD_MAGIC	0
 
+/*
+ * Multi-unit getters of a private semaphore wait for the count to
+ * change on a flags group attached to it, which posters kick when
+ * some of them are pending. This is only set up on the first
+ * multi-unit wait.
+ */
+struct evl_sem_bulk {
+	struct evl_flags beacon;
+	int waiters;
+};
+
+static void setup_sem(struct evl_sem *sem, int clockfd, int initval,
+		int flags, int efd, struct evl_element_ids *eids)
+{
+	sem->u.active.state = __evl_shared_memory + eids->state_offset;
+	atomic_store(&sem->u.active.state->u.event.value, initval);
+	sem->u.active.fundle = eids->fundle;
+	sem->u.active.clockfd = clockfd;
+	sem->u.active.efd = efd;
+	sem->u.active.flags = flags;
+	sem->u.active.bulk = NULL;
+	sem->magic = __SEM_ACTIVE_MAGIC;
+}
+
 int evl_create_sem(struct evl_sem *sem, int clockfd,
 		int initval, int flags,
 		const char *fmt, ...)
@@ -58,15 +83,39 @@ int evl_create_sem(struct evl_sem *sem, int clockfd,
 	if (efd < 0)
 		return efd;
 
-	sem->u.active.state = __evl_shared_memory + eids.state_offset;
-	atomic_store(&sem->u.active.state->u.event.value, initval);
-	sem->u.active.fundle = eids.fundle;
-	sem->u.active.efd = efd;
-	sem->magic = __SEM_ACTIVE_MAGIC;
+	setup_sem(sem, clockfd, initval, flags, efd, &eids);
 
 	return efd;
 }
 
+int evl_create_sem_array(struct evl_sem *sems, int nr,
+			int clockfd, int initval, int flags)
+{
+	struct evl_monitor_attrs attrs;
+	struct evl_element_req *reqs;
+	int ret, n;
+
+	if (__evl_shared_memory == NULL)
+		return -ENXIO;
+
+	attrs.type = EVL_MONITOR_EVENT;
+	attrs.protocol = EVL_EVENT_COUNT;
+	attrs.clockfd = clockfd;
+	attrs.initval = initval;
+	ret = __evl_create_anon_elements(EVL_MONITOR_DEV, &attrs,
+					flags, nr, &reqs);
+	if (ret)
+		return ret;
+
+	for (n = 0; n < nr; n++)
+		setup_sem(sems + n, clockfd, initval, flags,
+			reqs[n].efd, &reqs[n].eids);
+
+	free(reqs);
+
+	return 0;
+}
+
 int evl_open_sem(struct evl_sem *sem, const char *fmt, ...)
 {
 	struct evl_monitor_binding bind;
@@ -77,7 +126,7 @@ int evl_open_sem(struct evl_sem *sem, const char *fmt, ...)
 		return -ENXIO;
 
 	va_start(ap, fmt);
-	efd = evl_open_element_vargs(EVL_MONITOR_DEV, fmt, ap);
+	efd = __evl_open_shared_element_vargs(EVL_MONITOR_DEV, fmt, ap);
 	va_end(ap);
 	if (efd < 0)
 		return efd;
@@ -97,12 +146,15 @@ int evl_open_sem(struct evl_sem *sem, const char *fmt, ...)
 	sem->u.active.state = __evl_shared_memory + bind.eids.state_offset;
 	__force_read_access(sem->u.active.state->u.event.value);
 	sem->u.active.fundle = bind.eids.fundle;
+	sem->u.active.clockfd = -1;
 	sem->u.active.efd = efd;
+	sem->u.active.flags = EVL_CLONE_PUBLIC;
+	sem->u.active.bulk = NULL;
 	sem->magic = __SEM_ACTIVE_MAGIC;
 
 	return efd;
 fail:
-	close(efd);
+	evl_close_element(efd);
 
 	return ret;
 }
@@ -117,9 +169,15 @@ int evl_close_sem(struct evl_sem *sem)
 	if (sem->magic != __SEM_ACTIVE_MAGIC)
 		return -EINVAL;
 
-	ret = close(sem->u.active.efd);
+	ret = evl_close_element(sem->u.active.efd);
 	if (ret)
-		return -errno;
+		return ret;
+
+	if (sem->u.active.bulk) {
+		evl_close_flags(&sem->u.active.bulk->beacon);
+		free(sem->u.active.bulk);
+		sem->u.active.bulk = NULL;
+	}
 
 	sem->u.active.fundle = EVL_NO_HANDLE;
 	sem->u.active.state = NULL;
@@ -144,112 +202,268 @@ static int check_sanity(struct evl_sem *sem)
 	return sem->magic != __SEM_ACTIVE_MAGIC ? -EINVAL : 0;
 }
 
-static int try_get(struct evl_monitor_state *state)
+static int try_get(struct evl_monitor_state *state, int count)
 {
 	__s32 val;
 
 	val = atomic_load_explicit(&state->u.event.value, __ATOMIC_ACQUIRE);
 	do {
-		if (val <= 0)
+		if (val < count)
 			return -EAGAIN;
 	} while (!atomic_compare_exchange_weak_explicit(
-			&state->u.event.value, &val, val - 1,
+			&state->u.event.value, &val, val - count,
 			__ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
 
 	return 0;
 }
 
-int evl_timedget_sem(struct evl_sem *sem, const struct timespec *timeout)
+static inline bool is_polled(struct evl_monitor_state *state)
+{
+	return !!atomic_load(&state->u.event.pollrefs);
+}
+
+static int signal_sem(struct evl_sem *sem, __s32 sigval)
+{
+	int ret;
+
+	if (__evl_get_current() && !__evl_is_inband())
+		return __evl_oob_ioctl(sem->u.active.efd,
+				EVL_MONIOC_SIGNAL, &sigval);
+
+	/* In-band threads may post pended sema4s. */
+	ret = ioctl(sem->u.active.efd, EVL_MONIOC_SIGNAL, &sigval);
+
+	return ret ? -errno : 0;
+}
+
+/*
+ * Post @count units at once. The fast path adds them to the count in
+ * a single CAS loop. Otherwise, we have to issue one signal per unit
+ * to the core, which credits a single unit and readies a single
+ * waiter each time. A zero signal value only notifies the pollers.
+ */
+static int put_sem(struct evl_sem *sem, int count)
 {
 	struct evl_monitor_state *state;
+	struct evl_sem_bulk *bulk;
+	int ret = 0, n, mode;
+	__s32 val;
+
+	state = sem->u.active.state;
+	val = atomic_load_explicit(&state->u.event.value, __ATOMIC_ACQUIRE);
+	if (val < 0 || is_polled(state)) {
+	slow_path:
+		mode = __evl_fpstat_mode();
+		for (n = 0; n < count && !ret; n++)
+			ret = signal_sem(sem, 1);
+		__evl_fpstat_slow(EVL_FPSTAT_PUT_SEM, mode);
+		goto out;
+	}
+
+	while (!atomic_compare_exchange_weak_explicit(
+			&state->u.event.value, &val, val + count,
+			__ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)) {
+		if (val < 0)
+			goto slow_path;
+	}
+
+	if (is_polled(state)) {
+		mode = __evl_fpstat_mode();
+		ret = signal_sem(sem, 0);
+		__evl_fpstat_slow(EVL_FPSTAT_PUT_SEM, mode);
+	} else {
+		__evl_fpstat_fast(EVL_FPSTAT_PUT_SEM);
+	}
+out:
+	/* Pairs with the waiter count update in get_sem_n(). */
+	bulk = __atomic_load_n(&sem->u.active.bulk, __ATOMIC_ACQUIRE);
+	if (!ret && bulk && __atomic_load_n(&bulk->waiters, __ATOMIC_SEQ_CST) > 0)
+		evl_broadcast_flags(&bulk->beacon, 1);
+
+	return ret;
+}
+
+static int wait_sem(struct evl_sem *sem, const struct timespec *timeout)
+{
 	struct evl_monitor_waitreq req;
 	struct __evl_timespec kts;
-	fundle_t current;
 	int ret;
 
+	req.gatefd = -1;
+	req.timeout_ptr = __evl_ktimespec_ptr64(timeout, kts);
+	req.status = -EINVAL;
+	req.value = 0;		/* dummy */
+
+	ret = __evl_oob_ioctl(sem->u.active.efd, EVL_MONIOC_WAIT, &req);
+
+	return ret ?: req.status;
+}
+
+static int get_bulk(struct evl_sem *sem, struct evl_sem_bulk **r_bulk)
+{
+	struct evl_sem_bulk *bulk, *old = NULL;
+	int ret;
+
+	bulk = __atomic_load_n(&sem->u.active.bulk, __ATOMIC_ACQUIRE);
+	if (bulk)
+		goto out;
+
+	bulk = malloc(sizeof(*bulk));
+	if (bulk == NULL)
+		return -ENOMEM;
+
+	ret = evl_create_flags(&bulk->beacon, sem->u.active.clockfd, 0,
+			EVL_CLONE_PRIVATE, NULL);
+	if (ret < 0) {
+		free(bulk);
+		return ret;
+	}
+
+	bulk->waiters = 0;
+
+	/* Another getter may have beaten us to it. */
+	if (!__atomic_compare_exchange_n(&sem->u.active.bulk, &old, bulk,
+			false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		evl_close_flags(&bulk->beacon);
+		free(bulk);
+		bulk = old;
+	}
+out:
+	*r_bulk = bulk;
+
+	return 0;
+}
+
+/*
+ * The core hands over a single unit to each waiter it wakes up, so
+ * collecting @count units from there would mean sleeping while
+ * holding the first ones, which deadlocks as soon as two such getters
+ * compete for the same units. Instead, we only take the units from
+ * user space when all of them are available at once, waiting for
+ * posts to happen in between. Every post wakes up all the multi-unit
+ * getters of the semaphore, those which still lack units go back to
+ * sleep.
+ */
+static int get_sem_n(struct evl_sem *sem, int count,
+		const struct timespec *timeout)
+{
+	struct evl_sem_bulk *bulk;
+	int ret, bits;
+
+	ret = get_bulk(sem, &bulk);
+	if (ret)
+		return ret;
+
+	/* Pairs with the waiter count check in put_sem(). */
+	__atomic_add_fetch(&bulk->waiters, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	for (;;) {
+		ret = try_get(sem->u.active.state, count);
+		if (ret != -EAGAIN)
+			break;
+		ret = evl_timedwait_flags(&bulk->beacon, timeout, &bits);
+		if (ret)
+			break;
+	}
+
+	__atomic_sub_fetch(&bulk->waiters, 1, __ATOMIC_SEQ_CST);
+
+	return ret;
+}
+
+int evl_timedget_sem_n(struct evl_sem *sem, int count,
+		const struct timespec *timeout)
+{
+	struct evl_monitor_state *state;
+	fundle_t current;
+	int ret, mode;
+
 	current = __evl_get_current();
 	if (current == EVL_NO_HANDLE)
 		return -EPERM;
 
+	if (count <= 0)
+		return -EINVAL;
+
 	ret = check_sanity(sem);
 	if (ret)
 		return ret;
 
+	/* Posts from other processes would not wake us up. */
+	if (count > 1 && (sem->u.active.flags & EVL_CLONE_PUBLIC))
+		return -EINVAL;
+
 	state = sem->u.active.state;
-	ret = try_get(state);
-	if (ret != -EAGAIN)
+	ret = try_get(state, count);
+	if (ret != -EAGAIN) {
+		__evl_fpstat_fast(EVL_FPSTAT_GET_SEM);
 		return ret;
+	}
 
-	req.gatefd = -1;
-	req.timeout_ptr = __evl_ktimespec_ptr64(timeout, kts);
-	req.status = -EINVAL;
-	req.value = 0;		/* dummy */
+	mode = __evl_fpstat_mode();
+	if (count == 1)
+		ret = wait_sem(sem, timeout);
+	else
+		ret = get_sem_n(sem, count, timeout);
+	__evl_fpstat_slow(EVL_FPSTAT_GET_SEM, mode);
 
-	ret = oob_ioctl(sem->u.active.efd, EVL_MONIOC_WAIT, &req);
+	return ret;
+}
 
-	return ret ? -errno : req.status;
+int evl_timedget_sem(struct evl_sem *sem, const struct timespec *timeout)
+{
+	return evl_timedget_sem_n(sem, 1, timeout);
 }
 
-int evl_get_sem(struct evl_sem *sem)
+int evl_get_sem_n(struct evl_sem *sem, int count)
 {
 	struct timespec timeout = { .tv_sec = 0, .tv_nsec = 0 };
 
-	return evl_timedget_sem(sem, &timeout);
+	return evl_timedget_sem_n(sem, count, &timeout);
 }
 
-int evl_tryget_sem(struct evl_sem *sem)
+int evl_get_sem(struct evl_sem *sem)
+{
+	return evl_get_sem_n(sem, 1);
+}
+
+int evl_tryget_sem_n(struct evl_sem *sem, int count)
 {
 	int ret;
 
+	if (count <= 0)
+		return -EINVAL;
+
 	ret = check_sanity(sem);
 	if (ret)
 		return ret;
 
-	return try_get(sem->u.active.state);
+	return try_get(sem->u.active.state, count);
 }
 
-static inline bool is_polled(struct evl_monitor_state *state)
+int evl_tryget_sem(struct evl_sem *sem)
 {
-	return !!atomic_load(&state->u.event.pollrefs);
+	return evl_tryget_sem_n(sem, 1);
 }
 
-int evl_put_sem(struct evl_sem *sem)
+int evl_put_sem_n(struct evl_sem *sem, int count)
 {
-	struct evl_monitor_state *state;
-	__s32 sigval = 1, val;
 	int ret;
 
+	if (count <= 0)
+		return -EINVAL;
+
 	ret = check_sanity(sem);
 	if (ret)
 		return ret;
 
-	state = sem->u.active.state;
-	val = atomic_load_explicit(&state->u.event.value, __ATOMIC_ACQUIRE);
-	if (val < 0 || is_polled(state)) {
-	slow_path:
-		if (__evl_get_current() && !__evl_is_inband())
-			ret = oob_ioctl(sem->u.active.efd,
-					EVL_MONIOC_SIGNAL, &sigval);
-		else
-			/* In-band threads may post pended sema4s. */
-			ret = ioctl(sem->u.active.efd,
-				EVL_MONIOC_SIGNAL, &sigval);
-		return ret ? -errno : 0;
-	}
-
-	while (!atomic_compare_exchange_weak_explicit(
-			&state->u.event.value, &val, val + 1,
-			__ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
-		if (val < 0)
-			goto slow_path;
-	}
-
-	if (is_polled(state)) {
-		sigval = 0;
-		goto slow_path;
-	}
+	return put_sem(sem, count);
+}
 
-	return 0;
+int evl_put_sem(struct evl_sem *sem)
+{
+	return evl_put_sem_n(sem, 1);
 }
 
 int evl_flush_sem(struct evl_sem *sem)
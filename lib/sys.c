@@ -11,9 +11,12 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <evl/sys.h>
 #include <evl/factory.h>
 #include "internal.h"
@@ -29,25 +32,140 @@ static void lart_once(void)
 	pthread_once(&lart_once, do_lart_once);
 }
 
-static int flip_fd_flags(int efd, int cmd, int flags)
+static int set_fd_flags(int efd, int flags)
 {
 	int ret;
 
-	ret = fcntl(efd, cmd == F_SETFD ? F_GETFD : F_GETFL, 0);
+	ret = fcntl(efd, F_GETFL, 0);
 	if (ret < 0)
 		return -errno;
 
-	ret = fcntl(efd, cmd, ret | flags);
+	ret = fcntl(efd, F_SETFL, ret | flags);
 	if (ret)
 		return -errno;
 
 	return 0;
 }
 
+/*
+ * We keep the clone device of each element class open once used,
+ * so that creating elements does not involve opening and closing
+ * the factory every time. The cache is only looked up when
+ * creating elements, which is an in-band operation anyway.
+ */
+#define FACTORY_CACHE_SIZE	16
+
+static struct factory_slot {
+	char type[32];
+	int fd;
+	dev_t rdev;
+	ino_t ino;
+} factory_cache[FACTORY_CACHE_SIZE];
+
+static pthread_mutex_t factory_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int open_factory(const char *type)
+{
+	char devname[PATH_MAX];
+	int ret;
+
+	ret = snprintf(devname, sizeof(devname), "/dev/evl/%s/clone", type);
+	if (ret < 0 || ret >= (int)sizeof(devname))
+		return -ENAMETOOLONG;
+
+	ret = open(devname, O_RDWR|O_CLOEXEC);
+
+	return ret < 0 ? -errno : ret;
+}
+
+/*
+ * The application may have closed a cached descriptor behind our
+ * back, possibly reusing its number for another file. Make sure it
+ * still refers to the clone device we opened.
+ */
+static bool factory_is_valid(struct factory_slot *slot)
+{
+	struct stat st;
+
+	if (fstat(slot->fd, &st))
+		return false;
+
+	return st.st_rdev == slot->rdev && st.st_ino == slot->ino;
+}
+
+/*
+ * Get a descriptor to the clone device of @type from the cache,
+ * opening it if needed. A stale slot is dropped without closing its
+ * descriptor, which we do not own anymore.
+ */
+static int get_factory(const char *type)
+{
+	struct factory_slot *slot, *free_slot = NULL;
+	struct stat st;
+	int ffd;
+
+	if (strlen(type) >= sizeof(slot->type))
+		return open_factory(type);
+
+	pthread_mutex_lock(&factory_lock);
+
+	for (slot = factory_cache;
+	     slot < factory_cache + FACTORY_CACHE_SIZE; slot++) {
+		if (slot->type[0] == '\0') {
+			if (free_slot == NULL)
+				free_slot = slot;
+			continue;
+		}
+		if (strcmp(slot->type, type))
+			continue;
+		if (factory_is_valid(slot)) {
+			ffd = slot->fd;
+			goto out;
+		}
+		slot->type[0] = '\0';
+		free_slot = slot;
+		break;
+	}
+
+	ffd = open_factory(type);
+	if (ffd >= 0 && free_slot && !fstat(ffd, &st)) {
+		strcpy(free_slot->type, type);
+		free_slot->fd = ffd;
+		free_slot->rdev = st.st_rdev;
+		free_slot->ino = st.st_ino;
+	}
+out:
+	pthread_mutex_unlock(&factory_lock);
+
+	return ffd;
+}
+
+/* Release a descriptor obtained from get_factory(). */
+static void put_factory(const char *type, int ffd)
+{
+	struct factory_slot *slot;
+
+	pthread_mutex_lock(&factory_lock);
+
+	for (slot = factory_cache;
+	     slot < factory_cache + FACTORY_CACHE_SIZE; slot++) {
+		if (slot->fd == ffd && !strcmp(slot->type, type)) {
+			pthread_mutex_unlock(&factory_lock);
+			return;
+		}
+	}
+
+	pthread_mutex_unlock(&factory_lock);
+
+	/* Cache was full, this one was opened on the fly. */
+	close(ffd);
+}
+
 /*
  * Creating an EVL element is done in the following steps:
  *
- * 1. open the clone device of the proper element class.
+ * 1. open the clone device of the proper element class, unless we
+ * have it in the factory cache already.
  *
  * 2. issue ioctl(EVL_IOC_CLONE) to create a new element, passing
  * an attribute structure.
@@ -60,13 +178,13 @@ static int flip_fd_flags(int efd, int cmd, int flags)
  * Except for threads, closing the last file descriptor referring to
  * an element causes its automatic deletion.
  */
-int evl_create_element(const char *type, const char *name,
-		void *attrs, int clone_flags,
-		struct evl_element_ids *eids)
+static int clone_element(int ffd, const char *type, const char *name,
+			void *attrs, int clone_flags,
+			struct evl_element_ids *eids)
 {
-	char *fdevname, *edevname = NULL;
+	char edevname[PATH_MAX];
 	struct evl_clone_req clone;
-	int ffd, efd, ret;
+	int efd, ret, oflags;
 	bool nonblock;
 
 	nonblock = !!(clone_flags & EVL_CLONE_NONBLOCK);
@@ -74,16 +192,6 @@ int evl_create_element(const char *type, const char *name,
 	clone_flags &= EVL_CLONE_MASK;
 	clone_flags &= ~EVL_CLONE_NONBLOCK;
 
-	ret = asprintf(&fdevname, "/dev/evl/%s/clone", type);
-	if (ret < 0)
-		return -ENOMEM;
-
-	ffd = open(fdevname, O_RDWR);
-	if (ffd < 0) {
-		ret = -errno;
-		goto out_factory;
-	}
-
 	/*
 	 * Turn on public mode if the user-provided name starts with a
 	 * slash.  Anonymous elements must be private by definition.
@@ -96,6 +204,13 @@ int evl_create_element(const char *type, const char *name,
 		name++;
 	}
 
+	if (clone_flags & EVL_CLONE_PUBLIC) {
+		ret = snprintf(edevname, sizeof(edevname),
+			"/dev/evl/%s/%s", type, name);
+		if (ret < 0 || ret >= (int)sizeof(edevname))
+			return -ENAMETOOLONG;
+	}
+
 	clone.name_ptr = __evl_ptr64(name);
 	clone.attrs_ptr = __evl_ptr64(attrs);
 	clone.clone_flags = clone_flags;
@@ -104,94 +219,379 @@ int evl_create_element(const char *type, const char *name,
 		ret = -errno;
 		if (ret == -ENXIO)
 			lart_once();
-		goto out_new;
+		return ret;
 	}
 
 	if (clone_flags & EVL_CLONE_PUBLIC) {
-		ret = asprintf(&edevname, "/dev/evl/%s/%s", type, name);
-		if (ret < 0) {
-			ret = -ENOMEM;
-			goto out_new;
-		}
-
-		efd = open(edevname, O_RDWR);
-		if (efd < 0) {
-			ret = -errno;
-			goto out_element;
-		}
+		/* Get all descriptor flags right from the start. */
+		oflags = O_RDWR|O_CLOEXEC;
+		if (nonblock)
+			oflags |= O_NONBLOCK;
+		efd = open(edevname, oflags);
+		if (efd < 0)
+			return -errno;
 	} else {
 		efd = clone.efd;
-	}
-
-	ret = flip_fd_flags(efd, F_SETFD, O_CLOEXEC);
-	if (ret)
-		goto out_element;
-
-	if (nonblock) {
-		ret = flip_fd_flags(efd, F_SETFL, O_NONBLOCK);
-		if (ret)
-			goto out_element;
+		/* FD_CLOEXEC is the only descriptor flag. */
+		ret = fcntl(efd, F_SETFD, FD_CLOEXEC);
+		if (ret) {
+			ret = -errno;
+			goto fail;
+		}
+		if (nonblock) {
+			ret = set_fd_flags(efd, O_NONBLOCK);
+			if (ret)
+				goto fail;
+		}
 	}
 
 	if (eids)
 		*eids = clone.eids;
 
-	ret = efd;
+	return efd;
+fail:
+	close(efd);
 
-out_element:
-	if (edevname)
-		free(edevname);
-out_new:
-	close(ffd);
-out_factory:
-	free(fdevname);
+	return ret;
+}
+
+int evl_create_element(const char *type, const char *name,
+		void *attrs, int clone_flags,
+		struct evl_element_ids *eids)
+{
+	int ffd, efd;
+
+	ffd = get_factory(type);
+	if (ffd < 0)
+		return ffd;
+
+	efd = clone_element(ffd, type, name, attrs, clone_flags, eids);
+
+	put_factory(type, ffd);
+
+	return efd;
+}
+
+/*
+ * Create @nr elements of the same class at once. This is all or
+ * nothing: if any creation fails, the elements already created are
+ * dropped and the error is returned. On success, each request
+ * receives the descriptor of the new element and its identifiers.
+ */
+int evl_create_element_array(const char *type,
+			struct evl_element_req *reqs, int nr)
+{
+	int ffd, efd, n, ret = 0;
+
+	if (nr < 0)
+		return -EINVAL;
+
+	if (nr == 0)
+		return 0;
+
+	ffd = get_factory(type);
+	if (ffd < 0)
+		return ffd;
+
+	for (n = 0; n < nr; n++) {
+		efd = clone_element(ffd, type, reqs[n].name, reqs[n].attrs,
+				reqs[n].clone_flags, &reqs[n].eids);
+		if (efd < 0) {
+			ret = efd;
+			break;
+		}
+		reqs[n].efd = efd;
+	}
+
+	put_factory(type, ffd);
+
+	if (ret) {
+		while (--n >= 0) {
+			close(reqs[n].efd);
+			reqs[n].efd = -1;
+		}
+	}
 
 	return ret;
 }
 
-int evl_open_element_vargs(const char *type,
-		const char *fmt, va_list ap)
+/*
+ * Create @nr anonymous elements of the same class sharing the same
+ * attributes, returning the array of completed requests in
+ * @r_reqs. The caller should free this array after use.
+ */
+int __evl_create_anon_elements(const char *type, void *attrs,
+			int clone_flags, int nr,
+			struct evl_element_req **r_reqs)
 {
-	char *path, *name;
-	int efd, ret;
+	struct evl_element_req *reqs;
+	int ret, n;
 
-	ret = vasprintf(&name, fmt, ap);
-	if (ret < 0)
-		return -ENOMEM;
+	if (nr <= 0)
+		return -EINVAL;
 
-	ret = asprintf(&path, "/dev/evl/%s/%s", type, name);
-	free(name);
-	if (ret < 0)
+	reqs = malloc(nr * sizeof(*reqs));
+	if (reqs == NULL)
 		return -ENOMEM;
 
-	efd = open(path, O_RDWR);
-	if (efd < 0) {
-		ret = -errno;
-		goto fail_open;
+	for (n = 0; n < nr; n++) {
+		reqs[n].name = NULL;
+		reqs[n].attrs = attrs;
+		reqs[n].clone_flags = clone_flags;
+		reqs[n].efd = -1;
 	}
 
-	ret = fcntl(efd, F_GETFD, 0);
-	if (ret < 0) {
-		ret = -errno;
-		goto fail;
+	ret = evl_create_element_array(type, reqs, nr);
+	if (ret) {
+		free(reqs);
+		return ret;
 	}
 
-	ret = fcntl(efd, F_SETFD, ret | O_CLOEXEC);
-	if (ret) {
-		ret = -errno;
-		goto fail;
+	*r_reqs = reqs;
+
+	return 0;
+}
+
+/*
+ * Process-wide cache of descriptors to named elements, which
+ * evl_open_element*() look up before opening the element device.
+ * The cache is off by default. With EVL_OPEN_CACHE_DUP, every open
+ * request returns a fresh duplicate of a descriptor the cache keeps
+ * open for the element, which the caller may close as usual. With
+ * EVL_OPEN_CACHE_SHARE, the same descriptor is handed out to the
+ * element-specific openers of this library, which release it with
+ * evl_close_element() so that it is closed with the last reference;
+ * callers of evl_open_element*() still get a duplicate, since
+ * nothing prevents them from closing their descriptor directly.
+ * This is in-band stuff, a plain mutex serializes accesses.
+ */
+#define OPEN_CACHE_BUCKETS	64	/* Must be a power of 2. */
+
+struct open_entry {
+	struct open_entry *next;
+	int fd;
+	dev_t dev;
+	ino_t ino;
+	int refs;	/* EVL_OPEN_CACHE_SHARE users */
+	bool pinned;	/* Kept open for EVL_OPEN_CACHE_DUP */
+	char path[];
+};
+
+static struct open_entry *open_cache[OPEN_CACHE_BUCKETS];
+
+static int open_cache_mode = EVL_OPEN_CACHE_OFF;
+
+static int open_cache_count;
+
+static pthread_mutex_t open_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct open_entry **hash_path(const char *path)
+{
+	unsigned int h = 2166136261U; /* FNV-1a */
+
+	while (*path)
+		h = (h ^ (unsigned char)*path++) * 16777619U;
+
+	return open_cache + (h & (OPEN_CACHE_BUCKETS - 1));
+}
+
+static void unlink_entry(struct open_entry **bucket, struct open_entry *e)
+{
+	struct open_entry **pp;
+
+	for (pp = bucket; *pp != e; pp = &(*pp)->next)
+		;
+
+	*pp = e->next;
+	open_cache_count--;
+}
+
+static void drop_entry(struct open_entry **bucket, struct open_entry *e)
+{
+	unlink_entry(bucket, e);
+	close(e->fd);
+	free(e);
+}
+
+/*
+ * Make sure the cached descriptor still refers to the element we
+ * opened, the application may have closed it then reused its number
+ * by mistake. A stale entry is dropped without closing its
+ * descriptor, which we do not own anymore.
+ */
+static bool check_entry(struct open_entry **bucket, struct open_entry *e)
+{
+	struct stat st;
+
+	if (!fstat(e->fd, &st) && st.st_dev == e->dev && st.st_ino == e->ino)
+		return true;
+
+	unlink_entry(bucket, e);
+	free(e);
+
+	return false;
+}
+
+static int open_cached(const char *path, int mode)
+{
+	struct open_entry **bucket, *e;
+	struct stat st;
+	int efd;
+
+	bucket = hash_path(path);
+
+	pthread_mutex_lock(&open_cache_lock);
+
+	for (e = *bucket; e; e = e->next) {
+		if (!strcmp(e->path, path)) {
+			if (!check_entry(bucket, e))
+				e = NULL;
+			break;
+		}
 	}
 
-	free(path);
+	if (e == NULL) {
+		efd = open(path, O_RDWR|O_CLOEXEC);
+		if (efd < 0) {
+			efd = -errno;
+			goto out;
+		}
+		if (fstat(efd, &st))	/* Go uncached. */
+			goto out;
+		e = malloc(sizeof(*e) + strlen(path) + 1);
+		if (e == NULL)
+			goto out;
+		strcpy(e->path, path);
+		e->fd = efd;
+		e->dev = st.st_dev;
+		e->ino = st.st_ino;
+		e->refs = 0;
+		e->pinned = false;
+		e->next = *bucket;
+		*bucket = e;
+		open_cache_count++;
+	}
+
+	if (mode == EVL_OPEN_CACHE_SHARE) {
+		e->refs++;
+		efd = e->fd;
+	} else {
+		e->pinned = true;
+		efd = fcntl(e->fd, F_DUPFD_CLOEXEC, 0);
+		if (efd < 0)
+			efd = -errno;
+	}
+out:
+	pthread_mutex_unlock(&open_cache_lock);
 
 	return efd;
+}
 
-fail:
-	close(efd);
-fail_open:
-	free(path);
+int evl_set_open_cache(int mode)
+{
+	switch (mode) {
+	case EVL_OPEN_CACHE_OFF:
+	case EVL_OPEN_CACHE_DUP:
+	case EVL_OPEN_CACHE_SHARE:
+		break;
+	default:
+		return -EINVAL;
+	}
 
-	return ret;
+	return __atomic_exchange_n(&open_cache_mode, mode, __ATOMIC_RELAXED);
+}
+
+/*
+ * Close the descriptors the cache keeps open for duplicating, which
+ * lets the core delete the elements nobody else refers to.
+ * Descriptors shared with EVL_OPEN_CACHE_SHARE remain until their
+ * last user releases them.
+ */
+void evl_flush_open_cache(void)
+{
+	struct open_entry **bucket, *e, *next;
+
+	pthread_mutex_lock(&open_cache_lock);
+
+	for (bucket = open_cache;
+	     bucket < open_cache + OPEN_CACHE_BUCKETS; bucket++) {
+		for (e = *bucket; e; e = next) {
+			next = e->next;
+			e->pinned = false;
+			if (e->refs == 0)
+				drop_entry(bucket, e);
+		}
+	}
+
+	pthread_mutex_unlock(&open_cache_lock);
+}
+
+int evl_close_element(int efd)
+{
+	struct open_entry **bucket, *e;
+
+	if (__atomic_load_n(&open_cache_count, __ATOMIC_RELAXED) > 0) {
+		pthread_mutex_lock(&open_cache_lock);
+		for (bucket = open_cache;
+		     bucket < open_cache + OPEN_CACHE_BUCKETS; bucket++) {
+			for (e = *bucket; e; e = e->next) {
+				if (e->fd != efd || e->refs == 0)
+					continue;
+				if (!check_entry(bucket, e))
+					break;
+				if (--e->refs == 0 && !e->pinned)
+					drop_entry(bucket, e);
+				pthread_mutex_unlock(&open_cache_lock);
+				return 0;
+			}
+		}
+		pthread_mutex_unlock(&open_cache_lock);
+	}
+
+	return close(efd) ? -errno : 0;
+}
+
+static int open_element(const char *type, bool share,
+			const char *fmt, va_list ap)
+{
+	char path[PATH_MAX];
+	int efd, ret, len, mode;
+
+	len = snprintf(path, sizeof(path), "/dev/evl/%s/", type);
+	if (len < 0 || len >= (int)sizeof(path))
+		return -ENAMETOOLONG;
+
+	ret = vsnprintf(path + len, sizeof(path) - len, fmt, ap);
+	if (ret < 0 || ret >= (int)sizeof(path) - len)
+		return -ENAMETOOLONG;
+
+	mode = __atomic_load_n(&open_cache_mode, __ATOMIC_RELAXED);
+	if (mode == EVL_OPEN_CACHE_SHARE && !share)
+		mode = EVL_OPEN_CACHE_DUP;
+
+	if (mode != EVL_OPEN_CACHE_OFF)
+		return open_cached(path, mode);
+
+	efd = open(path, O_RDWR|O_CLOEXEC);
+
+	return efd < 0 ? -errno : efd;
+}
+
+int evl_open_element_vargs(const char *type,
+		const char *fmt, va_list ap)
+{
+	return open_element(type, false, fmt, ap);
+}
+
+/*
+ * Same as evl_open_element_vargs(), except that the descriptor may
+ * be shared with other openers in EVL_OPEN_CACHE_SHARE mode: the
+ * caller must release it with evl_close_element().
+ */
+int __evl_open_shared_element_vargs(const char *type,
+				const char *fmt, va_list ap)
+{
+	return open_element(type, true, fmt, ap);
 }
 
 int evl_open_element(const char *type, const char *fmt, ...)
@@ -208,33 +608,16 @@ int evl_open_element(const char *type, const char *fmt, ...)
 
 int evl_open_raw(const char *type)
 {
-	char *devname;
+	char devname[PATH_MAX];
 	int efd, ret;
 
-	ret = asprintf(&devname, "/dev/evl/%s", type);
-	if (ret < 0)
-		return -ENOMEM;
-
-	efd = open(devname, O_RDWR);
-	if (efd < 0) {
-		ret = -errno;
-		goto fail;
-	}
-
-	ret = flip_fd_flags(efd, F_SETFD, O_CLOEXEC);
-	if (ret)
-		goto fail_setfd;
+	ret = snprintf(devname, sizeof(devname), "/dev/evl/%s", type);
+	if (ret < 0 || ret >= (int)sizeof(devname))
+		return -ENAMETOOLONG;
 
-	free(devname);
+	efd = open(devname, O_RDWR|O_CLOEXEC);
 
-	return efd;
-
-fail_setfd:
-	close(efd);
-fail:
-	free(devname);
-
-	return ret;
+	return efd < 0 ? -errno : efd;
 }
 
 int evl_get_current_mode(void)
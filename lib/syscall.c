@@ -8,10 +8,12 @@
 #include <sys/types.h>
 #include <sys/prctl.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include <errno.h>
 #include <evl/syscall.h>
 #include <evl/syscall-evl.h>
 #include <asm-generic/dovetail.h>
+#include "internal.h"
 
 /*
  * EVL relies on Dovetail's handling of prctl(2) to receive requests
@@ -22,11 +24,24 @@
 #define __evl_syscall(__nr, __a0, __a1, __a2)	\
 	prctl((__nr) | __OOB_SYSCALL_BIT, (long)(__a0), (long)(__a1), (long)(__a2), 0)
 
+int __evl_oob_cancel_default = EVL_OOB_CANCEL_ASYNC;
+
+__thread __attribute__ ((tls_model (EVL_TLS_MODEL)))
+int __evl_oob_cancel_mode = EVL_OOB_CANCEL_DEFAULT;
+
+ssize_t oob_read_nocancel(int efd, void *buf, size_t count)
+{
+	return __evl_syscall(sys_evl_read, efd, buf, count);
+}
+
 ssize_t oob_read(int efd, void *buf, size_t count)
 {
 	int old_type;
 	ssize_t ret;
 
+	if (!__evl_oob_cancellable())
+		return oob_read_nocancel(efd, buf, count);
+
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &old_type);
 	ret = __evl_syscall(sys_evl_read, efd, buf, count);
 	pthread_setcanceltype(old_type, NULL);
@@ -34,11 +49,19 @@ ssize_t oob_read(int efd, void *buf, size_t count)
 	return ret;
 }
 
+ssize_t oob_write_nocancel(int efd, const void *buf, size_t count)
+{
+	return __evl_syscall(sys_evl_write, efd, buf, count);
+}
+
 ssize_t oob_write(int efd, const void *buf, size_t count)
 {
 	int old_type;
 	ssize_t ret;
 
+	if (!__evl_oob_cancellable())
+		return oob_write_nocancel(efd, buf, count);
+
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &old_type);
 	ret = __evl_syscall(sys_evl_write, efd, buf, count);
 	pthread_setcanceltype(old_type, NULL);
@@ -46,6 +69,18 @@ ssize_t oob_write(int efd, const void *buf, size_t count)
 	return ret;
 }
 
+int oob_ioctl_nocancel(int efd, unsigned long request, ...)
+{
+	va_list ap;
+	long arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, long);
+	va_end(ap);
+
+	return __evl_syscall(sys_evl_ioctl, efd, request, arg);
+}
+
 int oob_ioctl(int efd, unsigned long request, ...)
 {
 	int ret, old_type;
@@ -54,10 +89,103 @@ int oob_ioctl(int efd, unsigned long request, ...)
 
 	va_start(ap, request);
 	arg = va_arg(ap, long);
+	va_end(ap);
+
+	if (!__evl_oob_cancellable())
+		return __evl_syscall(sys_evl_ioctl, efd, request, arg);
+
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &old_type);
 	ret = __evl_syscall(sys_evl_ioctl, efd, request, arg);
 	pthread_setcanceltype(old_type, NULL);
-	va_end(ap);
 
 	return ret;
 }
+
+static bool valid_cancel_mode(int mode)
+{
+	return mode == EVL_OOB_CANCEL_ASYNC || mode == EVL_OOB_CANCEL_NONE;
+}
+
+/*
+ * Threads which never get cancelled may skip switching to
+ * asynchronous cancellation around each out-of-band syscall. This
+ * sets the behavior for the caller, EVL_OOB_CANCEL_DEFAULT reverts
+ * to the process-wide setting.
+ */
+int evl_set_oob_cancel(int mode)
+{
+	int old_mode = __evl_oob_cancel_mode;
+
+	if (mode != EVL_OOB_CANCEL_DEFAULT && !valid_cancel_mode(mode))
+		return -EINVAL;
+
+	__evl_oob_cancel_mode = mode;
+
+	return old_mode;
+}
+
+int evl_set_oob_cancel_default(int mode)
+{
+	if (!valid_cancel_mode(mode))
+		return -EINVAL;
+
+	return __atomic_exchange_n(&__evl_oob_cancel_default, mode,
+				__ATOMIC_RELAXED);
+}
+
+static ssize_t run_batch_op(struct evl_batch_op *op)
+{
+	ssize_t ret;
+
+	switch (op->type) {
+	case EVL_BATCH_IOCTL:
+		return __evl_oob_ioctl(op->fd, op->request, op->arg);
+	case EVL_BATCH_READ:
+		ret = oob_read(op->fd, op->arg, op->count);
+		break;
+	case EVL_BATCH_WRITE:
+		ret = oob_write(op->fd, op->arg, op->count);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return ret < 0 ? -errno : ret;
+}
+
+static int submit_batch(struct evl_batch_op *ops, int nr, int flags)
+{
+	int n;
+
+	for (n = 0; n < nr; n++) {
+		ops[n].result = run_batch_op(ops + n);
+		if (ops[n].result < 0 && (flags & EVL_BATCH_STOP_ON_ERROR))
+			return n + 1;
+	}
+
+	return nr;
+}
+
+/*
+ * Run a series of independent out-of-band requests in order. The
+ * status of each request is stored into its ->result field, which
+ * receives either a non-negative value or -errno. Unless
+ * EVL_BATCH_STOP_ON_ERROR is set, a failed request does not prevent
+ * the next ones from running.
+ *
+ * Returns the number of requests which ran, or -errno if the batch
+ * could not be submitted at all.
+ *
+ * The core has no batching request, so the requests are issued one
+ * after another from user space.
+ */
+int evl_submit_batch(struct evl_batch_op *ops, int nr, int flags)
+{
+	if (nr < 0 || (flags & ~EVL_BATCH_STOP_ON_ERROR))
+		return -EINVAL;
+
+	if (__evl_get_current() == EVL_NO_HANDLE)
+		return -EPERM;
+
+	return submit_batch(ops, nr, flags);
+}
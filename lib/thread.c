@@ -36,6 +36,10 @@ int __evl_current_efd = -1;
 __thread __attribute__ ((tls_model (EVL_TLS_MODEL)))
 struct evl_user_window *__evl_current_window;
 
+/* Fast path counters, survive detaching. See fpstats.c. */
+__thread __attribute__ ((tls_model (EVL_TLS_MODEL)))
+struct evl_fpstats *__evl_current_fpstats;
+
 static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
 
 static void clear_tls(void)
@@ -133,6 +137,15 @@ int evl_attach_thread(int flags, const char *fmt, ...)
 		goto fail;
 	}
 
+	if (__evl_lockstat.enabled)
+		__evl_lockstat_attach();
+
+	if (__evl_fpstats.enabled)
+		__evl_fpstats_attach();
+
+	if (__evl_logger)
+		__evl_log_attach();
+
 	return efd;
 fail:
 	close(efd);
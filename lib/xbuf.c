@@ -4,11 +4,16 @@
  * 2018 - Philippe Gerum <rpm@xenomai.org>
  */
 
+#include <sys/types.h>
+#include <sys/mman.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <evl/sys.h>
 #include <evl/xbuf-evl.h>
+#include "internal.h"
 
 int evl_create_xbuf(size_t i_bufsz, size_t o_bufsz,
 		int flags, const char *fmt, ...)
@@ -34,3 +39,700 @@ int evl_create_xbuf(size_t i_bufsz, size_t o_bufsz,
 
 	return efd;
 }
+
+/*
+ * Positions are free-running 32bit counters, the ring size is a
+ * power of two so that they remain valid across wrap-arounds.
+ */
+struct evl_xbuf_ring_state {
+	/* Producer side. */
+	__u32 head __attribute__((aligned(64)));
+	__u32 policy;
+	__u32 recsz;
+	__u32 high_water;
+	__u64 dropped;
+	__u64 would_block;
+	/*
+	 * Consumer side. The producer may move the tail too, when
+	 * overwriting the oldest records.
+	 */
+	__u32 tail __attribute__((aligned(64)));
+	__u32 waiting;		/* Sleeping on the doorbell. */
+};
+
+/* The doorbell only conveys wakeup bytes, at most one per ring. */
+#define XBUF_DOORBELL_SIZE	16
+
+#define XBUF_MAX_RING_SIZE	(1U << 30)
+
+static size_t get_ring_size(size_t bufsz, size_t pagesz)
+{
+	size_t size = pagesz;
+
+	if (bufsz == 0)
+		return 0;
+
+	while (size < bufsz)
+		size <<= 1;
+
+	return size;
+}
+
+/* Map the ring data twice back-to-back, over the reserved range. */
+static int map_ring(void *addr, size_t size, int memfd, off_t offset)
+{
+	void *p;
+	int n;
+
+	/* One-way xbuf, nothing to map for the unused direction. */
+	if (size == 0)
+		return 0;
+
+	for (n = 0; n < 2; n++) {
+		p = mmap(addr + n * size, size, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_FIXED, memfd, offset);
+		if (p == MAP_FAILED)
+			return -errno;
+	}
+
+	return 0;
+}
+
+static void setup_ring(struct evl_xbuf_ring *ring,
+		struct evl_xbuf_ring_state *state,
+		void *data, size_t size, int efd, bool oob_producer)
+{
+	ring->state = state;
+	ring->data = size ? data : NULL;
+	ring->size = size;
+	ring->efd = efd;
+	ring->oob_producer = oob_producer;
+	ring->cpos = 0;
+	state->recsz = 1;
+}
+
+int evl_create_mapped_xbuf(struct evl_mapped_xbuf *xm,
+			size_t i_bufsz, size_t o_bufsz,
+			int flags, const char *fmt, ...)
+{
+	size_t pagesz = sysconf(_SC_PAGESIZE), i_size, o_size;
+	struct evl_xbuf_ring_state *states;
+	struct evl_xbuf_attrs attrs;
+	int ret, efd, memfd;
+	char *name = NULL;
+	void *base, *p;
+	size_t len;
+	va_list ap;
+
+	/*
+	 * The rings live in a memfd which only this process knows
+	 * about, other processes opening the element would only get
+	 * the doorbell.
+	 */
+	if (flags & EVL_CLONE_PUBLIC)
+		return -EINVAL;
+
+	i_size = get_ring_size(i_bufsz, pagesz);
+	o_size = get_ring_size(o_bufsz, pagesz);
+	if (i_size > XBUF_MAX_RING_SIZE || o_size > XBUF_MAX_RING_SIZE)
+		return -EINVAL;
+
+	if (fmt) {
+		va_start(ap, fmt);
+		ret = vasprintf(&name, fmt, ap);
+		va_end(ap);
+		if (ret < 0)
+			return -ENOMEM;
+	}
+
+	attrs.i_bufsz = i_size ? XBUF_DOORBELL_SIZE : 0;
+	attrs.o_bufsz = o_size ? XBUF_DOORBELL_SIZE : 0;
+	efd = evl_create_element(EVL_XBUF_DEV, name, &attrs, flags, NULL);
+	if (name)
+		free(name);
+	if (efd < 0)
+		return efd;
+
+	memfd = memfd_create("evl-xbuf", MFD_CLOEXEC);
+	if (memfd < 0) {
+		ret = -errno;
+		goto fail_memfd;
+	}
+
+	/* Ring states come first, in their own page. */
+	if (ftruncate(memfd, pagesz + i_size + o_size)) {
+		ret = -errno;
+		goto fail_map;
+	}
+
+	len = pagesz + 2 * (i_size + o_size);
+	base = mmap(NULL, len, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		ret = -errno;
+		goto fail_map;
+	}
+
+	p = mmap(base, pagesz, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_FIXED, memfd, 0);
+	if (p == MAP_FAILED) {
+		ret = -errno;
+		goto fail_ring;
+	}
+
+	ret = map_ring(base + pagesz, i_size, memfd, pagesz);
+	if (ret)
+		goto fail_ring;
+
+	ret = map_ring(base + pagesz + 2 * i_size, o_size,
+		memfd, pagesz + i_size);
+	if (ret)
+		goto fail_ring;
+
+	states = base;
+	setup_ring(&xm->inbound, states, base + pagesz,
+		i_size, efd, false);
+	setup_ring(&xm->outbound, states + 1, base + pagesz + 2 * i_size,
+		o_size, efd, true);
+	xm->efd = efd;
+	xm->memfd = memfd;
+	xm->base = base;
+	xm->len = len;
+
+	return efd;
+
+fail_ring:
+	munmap(base, len);
+fail_map:
+	close(memfd);
+fail_memfd:
+	close(efd);
+
+	return ret;
+}
+
+int evl_close_mapped_xbuf(struct evl_mapped_xbuf *xm)
+{
+	if (xm->base == NULL)
+		return -EINVAL;
+
+	munmap(xm->base, xm->len);
+	close(xm->memfd);
+	close(xm->efd);
+	xm->base = NULL;
+
+	return 0;
+}
+
+static inline __u32 producer_fill(struct evl_xbuf_ring *ring, __u32 *headp)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+	__u32 head, tail;
+
+	head = __atomic_load_n(&state->head, __ATOMIC_RELAXED);
+	tail = __atomic_load_n(&state->tail, __ATOMIC_ACQUIRE);
+	*headp = head;
+
+	return head - tail;
+}
+
+/*
+ * The producer may move the tail forward under an overwrite policy,
+ * in which case we might read a stale tail which lags more than a
+ * ring size behind the head, so retry until both are consistent.
+ */
+static inline __u32 consumer_fill(struct evl_xbuf_ring *ring, __u32 *tailp)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+	__u32 head, tail;
+
+	do {
+		tail = __atomic_load_n(&state->tail, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&state->head, __ATOMIC_ACQUIRE);
+	} while (head - tail > ring->size);
+
+	*tailp = tail;
+
+	return head - tail;
+}
+
+/* Drop the oldest records until @size bytes are free. */
+static void overwrite_oldest(struct evl_xbuf_ring *ring, size_t size)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+	__u32 tail, head, fill, drop;
+
+	tail = __atomic_load_n(&state->tail, __ATOMIC_ACQUIRE);
+	do {
+		head = __atomic_load_n(&state->head, __ATOMIC_RELAXED);
+		fill = head - tail;
+		if (size <= ring->size - fill)
+			return;
+		drop = size - (ring->size - fill);
+		drop = (drop + state->recsz - 1) / state->recsz * state->recsz;
+	} while (!__atomic_compare_exchange_n(&state->tail, &tail,
+				tail + drop, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	__atomic_store_n(&state->dropped, state->dropped + drop,
+			__ATOMIC_RELAXED);
+}
+
+/*
+ * Reserve @size contiguous bytes at the producer end of @ring,
+ * without blocking. The caller fills the space in, then publishes it
+ * with evl_commit_xbuf(). If the ring is full, this call either
+ * fails with -EAGAIN, or drops the oldest records to make room if
+ * the ring has the EVL_XBUF_OVERWRITE policy.
+ */
+int evl_reserve_xbuf(struct evl_xbuf_ring *ring,
+		size_t size, void **bufp)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+	__u32 fill, head;
+
+	if (ring->size == 0)
+		return -ENXIO;
+
+	if (size > ring->size)
+		return -EFBIG;
+
+	fill = producer_fill(ring, &head);
+	if (size > ring->size - fill) {
+		__atomic_store_n(&state->would_block,
+				state->would_block + 1, __ATOMIC_RELAXED);
+		if (state->policy != EVL_XBUF_OVERWRITE)
+			return -EAGAIN;
+		if (size % state->recsz)
+			return -EINVAL;
+		overwrite_oldest(ring, size);
+	}
+
+	*bufp = ring->data + (head & (ring->size - 1));
+
+	return 0;
+}
+
+static int ring_doorbell(struct evl_xbuf_ring *ring)
+{
+	char c = 0;
+	ssize_t ret;
+
+	/*
+	 * Out-of-band writes go to the outbound buffer, in-band
+	 * writes to the inbound one, which is what the consumer of
+	 * the ring listens to.
+	 */
+	if (ring->oob_producer)
+		ret = oob_write(ring->efd, &c, 1);
+	else
+		ret = write(ring->efd, &c, 1);
+
+	return ret < 0 ? -errno : 0;
+}
+
+int evl_commit_xbuf(struct evl_xbuf_ring *ring, size_t size)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+	__u32 fill, head;
+
+	if (ring->size == 0)
+		return -ENXIO;
+
+	fill = producer_fill(ring, &head);
+	if (size > ring->size - fill)
+		return -EINVAL;
+
+	if (state->policy == EVL_XBUF_OVERWRITE && size % state->recsz)
+		return -EINVAL;
+
+	__atomic_store_n(&state->head, head + size, __ATOMIC_RELEASE);
+
+	if (fill + size > state->high_water)
+		__atomic_store_n(&state->high_water, fill + size,
+				__ATOMIC_RELAXED);
+
+	/* Pairs with the barrier in evl_wait_xbuf(). */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&state->waiting, __ATOMIC_RELAXED) &&
+		__atomic_exchange_n(&state->waiting, 0, __ATOMIC_ACQ_REL))
+		return ring_doorbell(ring);
+
+	return 0;
+}
+
+/*
+ * Return the number of bytes readable from the consumer end of
+ * @ring, which start at *@bufp. Zero means that the ring is empty.
+ */
+ssize_t evl_peek_xbuf(struct evl_xbuf_ring *ring, void **bufp)
+{
+	__u32 fill, tail;
+
+	if (ring->size == 0)
+		return -ENXIO;
+
+	fill = consumer_fill(ring, &tail);
+	ring->cpos = tail;
+	*bufp = ring->data + (tail & (ring->size - 1));
+
+	return fill;
+}
+
+/*
+ * Like evl_peek_xbuf(), sleeping on the doorbell until the ring
+ * has data. The consumer of the inbound ring must run out-of-band,
+ * the consumer of the outbound ring in-band.
+ */
+ssize_t evl_wait_xbuf(struct evl_xbuf_ring *ring, void **bufp)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+	ssize_t ret;
+	char c;
+
+	for (;;) {
+		ret = evl_peek_xbuf(ring, bufp);
+		if (ret)
+			return ret;
+
+		__atomic_store_n(&state->waiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		ret = evl_peek_xbuf(ring, bufp);
+		if (ret) {
+			/*
+			 * We may leave a stale wakeup behind if the
+			 * producer raced with us, the next wait will
+			 * just go through another loop.
+			 */
+			__atomic_store_n(&state->waiting, 0, __ATOMIC_RELAXED);
+			return ret;
+		}
+
+		if (ring->oob_producer)
+			ret = read(ring->efd, &c, 1);
+		else
+			ret = oob_read(ring->efd, &c, 1);
+		if (ret < 0)
+			return -errno;
+	}
+}
+
+/*
+ * Release @size bytes from the data returned by the last peek. With
+ * the EVL_XBUF_OVERWRITE policy, -ESTALE means that the producer
+ * dropped some of these bytes meanwhile, so the data the caller
+ * got from the ring might have been overwritten. The caller should
+ * discard it and peek again.
+ */
+int evl_release_xbuf(struct evl_xbuf_ring *ring, size_t size)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+	__u32 fill, tail, cpos;
+
+	if (ring->size == 0)
+		return -ENXIO;
+
+	fill = consumer_fill(ring, &tail);
+
+	if (state->policy != EVL_XBUF_OVERWRITE) {
+		if (size > fill)
+			return -EINVAL;
+		__atomic_store_n(&state->tail, tail + size, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	cpos = ring->cpos;
+	if (tail != cpos)
+		return -ESTALE;
+
+	if (size > fill)
+		return -EINVAL;
+
+	if (!__atomic_compare_exchange_n(&state->tail, &cpos,
+				cpos + size, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return -ESTALE;
+
+	return 0;
+}
+
+/*
+ * Copy up to @len bytes from @ring to @buf without blocking,
+ * releasing them from the ring. With the EVL_XBUF_OVERWRITE policy,
+ * only whole records are copied. Return the number of bytes copied,
+ * zero if the ring is empty.
+ */
+ssize_t evl_drain_xbuf(struct evl_xbuf_ring *ring, void *buf, size_t len)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+	ssize_t ret;
+	size_t count;
+	void *data;
+
+	do {
+		ret = evl_peek_xbuf(ring, &data);
+		if (ret <= 0)
+			return ret;
+		count = (size_t)ret < len ? (size_t)ret : len;
+		if (state->policy == EVL_XBUF_OVERWRITE)
+			count -= count % state->recsz;
+		if (count == 0)
+			return 0;
+		memcpy(buf, data, count);
+		ret = evl_release_xbuf(ring, count);
+	} while (ret == -ESTALE);
+
+	return ret ?: (ssize_t)count;
+}
+
+/*
+ * Set the policy of @ring when it is full. EVL_XBUF_OVERWRITE
+ * requires all reservations to be multiples of @recsz bytes, the
+ * oldest data is dropped by whole records. This should be done
+ * before the ring is in use.
+ */
+int evl_set_xbuf_policy(struct evl_xbuf_ring *ring,
+			enum evl_xbuf_policy policy, size_t recsz)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+
+	if (ring->size == 0)
+		return -ENXIO;
+
+	switch (policy) {
+	case EVL_XBUF_REJECT:
+		recsz = 1;
+		break;
+	case EVL_XBUF_OVERWRITE:
+		if (recsz == 0 || recsz > ring->size)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	state->recsz = recsz;
+	__atomic_store_n(&state->policy, policy, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int evl_get_xbuf_stats(struct evl_xbuf_ring *ring,
+		struct evl_xbuf_stats *stats)
+{
+	struct evl_xbuf_ring_state *state = ring->state;
+	__u32 tail;
+
+	if (ring->size == 0)
+		return -ENXIO;
+
+	stats->size = ring->size;
+	stats->pending = consumer_fill(ring, &tail);
+	stats->high_water = __atomic_load_n(&state->high_water,
+					__ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&state->dropped, __ATOMIC_RELAXED);
+	stats->would_block = __atomic_load_n(&state->would_block,
+					__ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/* Each record of a framed xbuf is preceded by its length. */
+typedef __u32 xbuf_frame_t;
+
+int evl_open_framed_xbuf(struct evl_framed_xbuf *xf, int efd,
+			size_t i_bufsz, size_t o_bufsz)
+{
+	size_t bufsz = i_bufsz > o_bufsz ? i_bufsz : o_bufsz;
+	void *buf;
+
+	if (bufsz <= sizeof(xbuf_frame_t))
+		return -EINVAL;
+
+	/* Either side may run in-band or out-of-band. */
+	buf = malloc(bufsz * 2);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	xf->efd = efd;
+	xf->i_bufsz = i_bufsz;
+	xf->o_bufsz = o_bufsz;
+	xf->wbuf = buf;
+	xf->rbuf = buf + bufsz;
+	xf->rhead = 0;
+	xf->rtail = 0;
+
+	return 0;
+}
+
+/* In-band writers feed the inbound ring. */
+static inline size_t write_limit(struct evl_framed_xbuf *xf)
+{
+	return __evl_is_inband() ? xf->i_bufsz : xf->o_bufsz;
+}
+
+/* In-band readers drain the outbound ring. */
+static inline size_t read_limit(struct evl_framed_xbuf *xf)
+{
+	return __evl_is_inband() ? xf->o_bufsz : xf->i_bufsz;
+}
+
+int evl_create_framed_xbuf(struct evl_framed_xbuf *xf,
+			size_t i_bufsz, size_t o_bufsz,
+			int flags, const char *fmt, ...)
+{
+	char *name = NULL;
+	int ret, efd;
+	va_list ap;
+
+	if (fmt) {
+		va_start(ap, fmt);
+		ret = vasprintf(&name, fmt, ap);
+		va_end(ap);
+		if (ret < 0)
+			return -ENOMEM;
+	}
+
+	efd = evl_create_xbuf(i_bufsz, o_bufsz, flags,
+			name ? "%s" : NULL, name);
+	if (name)
+		free(name);
+	if (efd < 0)
+		return efd;
+
+	ret = evl_open_framed_xbuf(xf, efd, i_bufsz, o_bufsz);
+	if (ret) {
+		close(efd);
+		return ret;
+	}
+
+	return efd;
+}
+
+int evl_close_framed_xbuf(struct evl_framed_xbuf *xf)
+{
+	if (xf->wbuf == NULL)
+		return -EINVAL;
+
+	free(xf->wbuf);
+	xf->wbuf = NULL;
+	xf->rbuf = NULL;
+
+	return close(xf->efd) ? -errno : 0;
+}
+
+/*
+ * Send as many records from @iov as the ring we write to can hold in
+ * a single write, since xbuf writes are atomic the reader either gets
+ * all of them or none. Return the number of records sent.
+ */
+ssize_t evl_writev_xbuf(struct evl_framed_xbuf *xf,
+			const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0, reclen, limit;
+	xbuf_frame_t hdr;
+	ssize_t ret;
+	int n;
+
+	if (iovcnt <= 0)
+		return -EINVAL;
+
+	limit = write_limit(xf);
+
+	for (n = 0; n < iovcnt; n++) {
+		reclen = sizeof(hdr) + iov[n].iov_len;
+		if (len + reclen > limit)
+			break;
+		hdr = iov[n].iov_len;
+		memcpy(xf->wbuf + len, &hdr, sizeof(hdr));
+		memcpy(xf->wbuf + len + sizeof(hdr),
+			iov[n].iov_base, iov[n].iov_len);
+		len += reclen;
+	}
+
+	if (n == 0)
+		return -EFBIG;
+
+	if (__evl_is_inband())
+		ret = write(xf->efd, xf->wbuf, len);
+	else
+		ret = oob_write(xf->efd, xf->wbuf, len);
+
+	return ret < 0 ? -errno : n;
+}
+
+static bool get_pending_record(struct evl_framed_xbuf *xf,
+			xbuf_frame_t *lenp)
+{
+	size_t pending = xf->rtail - xf->rhead;
+	xbuf_frame_t hdr;
+
+	if (pending < sizeof(hdr))
+		return false;
+
+	memcpy(&hdr, xf->rbuf + xf->rhead, sizeof(hdr));
+	*lenp = hdr;
+
+	return pending - sizeof(hdr) >= hdr;
+}
+
+/*
+ * Receive up to @iovcnt records, each into the next vector, whose
+ * iov_len is updated with the record length. A single read drains
+ * all the data available from the xbuf into the staging buffer,
+ * records which do not fit into @iov are kept there for the next
+ * call. Return the number of records received, waiting for one if
+ * none is pending. A record larger than the vector it should go to
+ * stays pending, -EMSGSIZE is returned if it is the first one.
+ */
+ssize_t evl_readv_xbuf(struct evl_framed_xbuf *xf,
+		struct iovec *iov, int iovcnt)
+{
+	xbuf_frame_t reclen;
+	size_t limit;
+	ssize_t ret;
+	int n = 0;
+
+	if (iovcnt <= 0)
+		return -EINVAL;
+
+	limit = read_limit(xf);
+
+	for (;;) {
+		while (n < iovcnt && get_pending_record(xf, &reclen)) {
+			if (reclen > iov[n].iov_len)
+				return n ?: -EMSGSIZE;
+			memcpy(iov[n].iov_base,
+				xf->rbuf + xf->rhead + sizeof(reclen), reclen);
+			iov[n].iov_len = reclen;
+			xf->rhead += sizeof(reclen) + reclen;
+			n++;
+		}
+
+		if (n > 0)
+			return n;
+
+		if (xf->rhead > 0) {
+			memmove(xf->rbuf, xf->rbuf + xf->rhead,
+				xf->rtail - xf->rhead);
+			xf->rtail -= xf->rhead;
+			xf->rhead = 0;
+		}
+
+		/* The writer used a larger staging buffer. */
+		if (xf->rtail >= limit)
+			return -EMSGSIZE;
+
+		if (__evl_is_inband())
+			ret = read(xf->efd, xf->rbuf + xf->rtail,
+				limit - xf->rtail);
+		else
+			ret = oob_read(xf->efd, xf->rbuf + xf->rtail,
+				limit - xf->rtail);
+		if (ret <= 0)
+			return ret < 0 ? -errno : 0;
+
+		xf->rtail += ret;
+	}
+}
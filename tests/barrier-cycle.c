@@ -0,0 +1,71 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <evl/atomic.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/barrier.h>
+#include "helpers.h"
+
+#define NR_THREADS	4
+#define NR_CYCLES	1000
+
+static DEFINE_EVL_BARRIER(barrier, NR_THREADS);
+
+static atomic_t stage[NR_CYCLES];
+
+static atomic_t serials;
+
+static void run_cycles(int nth)
+{
+	int n, ret;
+
+	for (n = 0; n < NR_CYCLES; n++) {
+		atomic_fetch_add(&stage[n], 1);
+		__Tcall_assert(ret, evl_wait_barrier(&barrier));
+		/* Nobody may leave a cycle before everyone entered it. */
+		__Texpr_assert(atomic_load(&stage[n]) == NR_THREADS);
+		if (ret == EVL_BARRIER_SERIAL)
+			atomic_fetch_add(&serials, 1);
+	}
+}
+
+static void *barrier_thread(void *arg)
+{
+	int nth = (int)(long)arg, tfd;
+
+	__Tcall_assert(tfd, evl_attach_self("barrier-cycle:%d.%d", getpid(), nth));
+	run_cycles(nth);
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t threads[NR_THREADS - 1];
+	int tfd, n;
+
+	__Tcall_assert(tfd, evl_attach_self("barrier-cycle:%d", getpid()));
+
+	for (n = 0; n < NR_THREADS - 1; n++)
+		new_thread(threads + n, SCHED_FIFO, 1,
+			barrier_thread, (void *)(long)(n + 1));
+
+	run_cycles(0);
+
+	for (n = 0; n < NR_THREADS - 1; n++)
+		pthread_join(threads[n], NULL);
+
+	/* Exactly one serial thread per cycle. */
+	__Texpr_assert(atomic_load(&serials) == NR_CYCLES);
+
+	evl_destroy_barrier(&barrier);
+
+	return 0;
+}
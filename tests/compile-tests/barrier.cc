@@ -0,0 +1,22 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * COMPILE-TESTING ONLY.
+ */
+
+#include <evl/barrier.h>
+
+static DEFINE_EVL_BARRIER(barrier_static, 2);
+
+int main(int argc, char *argv[])
+{
+	struct evl_barrier barrier;
+
+	evl_wait_barrier(&barrier_static);
+	evl_new_barrier(&barrier, 2);
+	evl_create_barrier(&barrier, 2);
+	evl_wait_barrier(&barrier);
+	evl_destroy_barrier(&barrier);
+
+	return 0;
+}
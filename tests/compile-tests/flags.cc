@@ -15,11 +15,14 @@ static DEFINE_EVL_FLAGS(static_flags);
 int main(int argc, char *argv[])
 {
 	struct evl_flags dynamic_flags;
+	struct evl_flags_group groups[1];
+	struct evl_flags_waitset ws;
 	struct timespec timeout;
 	int bits;
 
 	evl_new_flags(&dynamic_flags, "dynamic_flags");
 	evl_create_flags(&dynamic_flags, CLOCK_MONOTONIC, 0, 0, "dynamic_flags");
+	evl_create_flags_array(&dynamic_flags, 1, CLOCK_MONOTONIC, 0, 0);
 	evl_open_flags(&dynamic_flags, "dynamic_flags");
 	evl_close_flags(&dynamic_flags);
 	evl_wait_flags(&static_flags, &bits);
@@ -35,6 +38,13 @@ int main(int argc, char *argv[])
 	evl_peek_flags(&static_flags, &bits);
 	evl_post_flags(&static_flags, bits);
 	evl_broadcast_flags(&static_flags, bits);
+	groups[0].flags = &static_flags;
+	groups[0].bits = -1;
+	evl_create_flags_waitset(&ws, groups, 1);
+	evl_wait_any_flags(&ws, &bits);
+	evl_timedwait_any_flags(&ws, &timeout, &bits);
+	evl_trywait_any_flags(&ws, &bits);
+	evl_destroy_flags_waitset(&ws);
 
 	return 0;
 }
@@ -11,9 +11,12 @@
 
 int main(int argc, char *argv[])
 {
+	struct evl_rt_report report;
 	struct evl_version v;
 
 	evl_init();
+	evl_prepare_rt(0, 0, &report);
+	evl_prefault_stack(0);
 	v = evl_get_version();
 
 	return v.api_level;
@@ -0,0 +1,26 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * COMPILE-TESTING ONLY.
+ */
+
+#include <stdio.h>
+#include <evl/instr.h>
+#include <evl/lockstat.h>
+#include <evl/fpstats.h>
+
+int main(int argc, char *argv[])
+{
+	struct evl_lockstat locks[4];
+	struct evl_fpstats stats;
+
+	evl_enable_instr(EVL_INSTR_LOCKSTAT, true);
+	evl_instr_enabled(EVL_INSTR_FPSTATS);
+	evl_dump_instr(EVL_INSTR_LOCKSTAT, stderr);
+	evl_get_lockstat(locks, 4);
+	evl_get_thread_fpstats(&stats);
+	evl_get_fpstats(&stats);
+	evl_fpstat_name(EVL_FPSTAT_LOCK_MUTEX);
+
+	return 0;
+}
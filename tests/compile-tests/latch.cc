@@ -0,0 +1,32 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * COMPILE-TESTING ONLY.
+ */
+
+#include <evl/atomic.h>
+#include <evl/syscall.h>
+#include <evl/syscall-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/latch.h>
+
+static DEFINE_EVL_LATCH(latch_static, 1);
+
+int main(int argc, char *argv[])
+{
+	struct timespec timeout;
+	struct evl_latch latch;
+
+	evl_count_down_latch(&latch_static, 1);
+	evl_new_latch(&latch, 2);
+	evl_create_latch(&latch, 2);
+	evl_count_down_latch(&latch, 1);
+	evl_wait_latch(&latch);
+	evl_read_clock(EVL_CLOCK_MONOTONIC, &timeout);
+	evl_timedwait_latch(&latch, &timeout);
+	evl_trywait_latch(&latch);
+	evl_destroy_latch(&latch);
+
+	return 0;
+}
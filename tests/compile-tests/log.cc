@@ -0,0 +1,17 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * COMPILE-TESTING ONLY.
+ */
+
+#include <evl/log.h>
+
+int main(int argc, char *argv[])
+{
+	evl_start_logger(2, 0, 0);
+	evl_flush_log();
+	evl_log_drops();
+	evl_stop_logger();
+
+	return 0;
+}
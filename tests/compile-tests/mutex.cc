@@ -13,6 +13,7 @@
 #include <evl/mutex-evl.h>
 
 static DEFINE_EVL_MUTEX(static_mutex);
+static DEFINE_EVL_LAZY_MUTEX(lazy_mutex);
 
 int main(int argc, char *argv[])
 {
@@ -22,6 +23,8 @@ int main(int argc, char *argv[])
 	evl_new_mutex(&dynamic_mutex, "dynamic_mutex");
 	evl_create_mutex(&dynamic_mutex, CLOCK_MONOTONIC, 0,
 			  EVL_MUTEX_NORMAL, "dynamic_mutex");
+	evl_create_mutex_array(&dynamic_mutex, 1, CLOCK_MONOTONIC, 0,
+			  EVL_MUTEX_NORMAL);
 	evl_open_mutex(&dynamic_mutex, "dynamic_mutex");
 	evl_close_mutex(&dynamic_mutex);
 	evl_lock_mutex(&dynamic_mutex);
@@ -31,6 +34,8 @@ int main(int argc, char *argv[])
 	evl_unlock_mutex(&static_mutex);
 	evl_set_mutex_ceiling(&static_mutex, 0);
 	evl_get_mutex_ceiling(&static_mutex);
+	evl_lock_mutex(&lazy_mutex);
+	evl_unlock_mutex(&lazy_mutex);
 
 	return 0;
 }
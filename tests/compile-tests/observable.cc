@@ -10,6 +10,10 @@
 int main(int argc, char *argv[])
 {
 	struct evl_notification nf;
+	struct evl_notify_latency lat;
+	struct evl_latest_values lv;
+	struct timespec delivered;
+	struct evl_publisher pub;
 	struct evl_notice no;
 	int efd;
 
@@ -17,6 +21,20 @@ int main(int argc, char *argv[])
 	efd = evl_create_observable(EVL_CLONE_PRIVATE, "test");
 	evl_update_observable(efd, &no, 1);
 	evl_read_observable(efd, &nf, 1);
+	evl_reset_notify_latency(&lat);
+	evl_read_observable_stamped(efd, &nf, 1, &delivered, &lat);
+	evl_get_latency_percentile(&lat, 99);
+	evl_create_latest_values(&lv, efd, 8);
+	evl_update_latest(&lv, &no, 1);
+	evl_read_latest(&lv, EVL_NOTICE_USER, &nf);
+	evl_close_latest_values(&lv);
+	evl_open_latest_values(&lv, efd, 0);
+	evl_init_publisher(&pub, efd, 16, 1000000ULL);
+	evl_set_coalescing(&pub, EVL_NOTICE_USER, true);
+	evl_publish(&pub, EVL_NOTICE_USER, no.event);
+	evl_flush_publisher(&pub);
+	evl_expire_publisher(&pub);
+	evl_destroy_publisher(&pub);
 
 	return 0;
 }
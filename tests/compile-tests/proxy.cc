@@ -19,6 +19,9 @@ static void do_vprint(int efd, const char *fmt, ...)
 
 int main(int argc, char *argv[])
 {
+	struct evl_rotation rotation = { 1 << 20, 0, 4, true };
+	struct evl_file_proxy_stats stats;
+	struct evl_file_proxy fp;
 	int efd;
 
 	efd = evl_new_proxy(1, 8192, "test-proxy");
@@ -26,6 +29,13 @@ int main(int argc, char *argv[])
 	evl_read_proxy(efd, NULL, 0);
 	do_vprint(efd, "%s,%d", "string", 42);
 	evl_printf("%s,%d", "string", 42);
+	evl_set_print_batching(4096, 1000000ULL);
+	evl_flush_print();
+	evl_new_file_proxy(&fp, "/tmp/log", 8192, &rotation, "test-file-proxy");
+	evl_print_file_proxy(&fp, "%s,%d", "string", 42);
+	evl_rotate_file_proxy(&fp);
+	evl_get_file_proxy_stats(&fp, &stats);
+	evl_close_file_proxy(&fp);
 
 	return 0;
 }
@@ -21,14 +21,19 @@ int main(int argc, char *argv[])
 
 	evl_new_sem(&dynamic_sem, "dynamic_sem");
 	evl_create_sem(&dynamic_sem, CLOCK_MONOTONIC, 0, 0, "dynamic-sem");
+	evl_create_sem_array(&dynamic_sem, 1, CLOCK_MONOTONIC, 0, 0);
 	evl_open_sem(&dynamic_sem, "dynamic_sem");
 	evl_close_sem(&dynamic_sem);
 	evl_get_sem(&static_sem);
 	evl_read_clock(EVL_CLOCK_MONOTONIC, &timeout);
 	evl_timedget_sem(&static_sem, &timeout);
 	evl_tryget_sem(&static_sem);
+	evl_get_sem_n(&static_sem, 2);
+	evl_timedget_sem_n(&static_sem, 2, &timeout);
+	evl_tryget_sem_n(&static_sem, 2);
 	evl_peek_sem(&static_sem, &val);
 	evl_put_sem(&static_sem);
+	evl_put_sem_n(&static_sem, 2);
 
 	return 0;
 }
@@ -9,7 +9,29 @@
 
 int main(int argc, char *argv[])
 {
+	struct evl_mapped_xbuf xm;
+	struct evl_framed_xbuf xf;
+	struct evl_xbuf_stats stats;
+	char data[64];
+	struct iovec iov;
+	void *buf;
+
 	evl_new_xbuf(16384, "test-xbuf");
+	evl_new_mapped_xbuf(&xm, 16384, "test-mapped-xbuf");
+	evl_reserve_xbuf(&xm.outbound, 64, &buf);
+	evl_commit_xbuf(&xm.outbound, 64);
+	evl_peek_xbuf(&xm.inbound, &buf);
+	evl_wait_xbuf(&xm.inbound, &buf);
+	evl_release_xbuf(&xm.inbound, 64);
+	evl_drain_xbuf(&xm.inbound, data, sizeof(data));
+	evl_set_xbuf_policy(&xm.outbound, EVL_XBUF_OVERWRITE, 16);
+	evl_get_xbuf_stats(&xm.outbound, &stats);
+	evl_close_mapped_xbuf(&xm);
+	evl_new_framed_xbuf(&xf, 16384, "test-framed-xbuf");
+	evl_writev_xbuf(&xf, &iov, 1);
+	evl_readv_xbuf(&xf, &iov, 1);
+	evl_close_framed_xbuf(&xf);
+	evl_open_framed_xbuf(&xf, 0, 16384, 16384);
 
 	return 0;
 }
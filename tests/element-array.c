@@ -0,0 +1,77 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <error.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <evl/atomic.h>
+#include <evl/evl.h>
+#include <evl/sys.h>
+#include <evl/sem.h>
+#include <evl/observable-evl.h>
+#include "helpers.h"
+
+#define NR_ELEMENTS  8
+
+int main(int argc, char *argv[])
+{
+	struct evl_element_req reqs[NR_ELEMENTS];
+	struct evl_notice ntc;
+	int ret, n, ffd, efd;
+	struct evl_sem sem;
+
+	__Tcall_assert(ret, evl_init());
+
+	/* The factory descriptor comes first, guess its number. */
+	__Tcall_errno_assert(ffd, dup(0));
+	close(ffd);
+
+	for (n = 0; n < NR_ELEMENTS; n++) {
+		/* Mix public and private elements. */
+		reqs[n].name = n & 1 ? get_unique_name(EVL_OBSERVABLE_DEV, n) : NULL;
+		reqs[n].attrs = NULL;
+		reqs[n].clone_flags = n & 2 ? EVL_CLONE_NONBLOCK : 0;
+		reqs[n].efd = -1;
+	}
+
+	__Tcall_assert(ret, evl_create_element_array(EVL_OBSERVABLE_DEV,
+						reqs, NR_ELEMENTS));
+
+	for (n = 0; n < NR_ELEMENTS; n++) {
+		__Texpr_assert(reqs[n].efd >= 0);
+		__Tcall_assert(ret, fcntl(reqs[n].efd, F_GETFD));
+		__Texpr_assert(ret & FD_CLOEXEC);
+		__Tcall_assert(ret, fcntl(reqs[n].efd, F_GETFL));
+		__Texpr_assert(!!(ret & O_NONBLOCK) == !!(n & 2));
+		close(reqs[n].efd);
+	}
+
+	/* A duplicate name must roll back the whole array. */
+	reqs[0].name = get_unique_name(EVL_OBSERVABLE_DEV, NR_ELEMENTS);
+	reqs[1].name = reqs[0].name;
+	__Fcall_assert(ret, evl_create_element_array(EVL_OBSERVABLE_DEV,
+						reqs, 2));
+	__Texpr_assert(ret == -EEXIST);
+	__Texpr_assert(reqs[0].efd == -1);
+
+	/*
+	 * Close the cached factory behind the library's back, then
+	 * have another factory reuse its number. The next creation
+	 * must not clone an element of the wrong type from it.
+	 */
+	close(ffd);
+	__Tcall_assert(efd, evl_new_sem(&sem, NULL));
+	__Tcall_assert(efd, evl_create_observable(EVL_CLONE_PRIVATE, NULL));
+	ntc.tag = EVL_NOTICE_USER;
+	ntc.event.val = 0;
+	__Tcall_assert(ret, evl_update_observable(efd, &ntc, 1));
+	__Texpr_assert(ret == 1);
+	close(efd);
+	evl_close_sem(&sem);
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <error.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <evl/atomic.h>
+#include <evl/evl.h>
+#include <evl/sys.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/mutex.h>
+#include <evl/mutex-evl.h>
+#include "helpers.h"
+
+int main(int argc, char *argv[])
+{
+	struct evl_mutex lock, m1, m2;
+	int tfd, gfd, fd1, fd2, nfd, ret;
+	char *name, *path;
+
+	__Tcall_assert(tfd, evl_attach_self("element-cache:%d", getpid()));
+
+	name = get_unique_name_and_path(EVL_MONITOR_DEV, 0, &path);
+	__Tcall_assert(gfd, evl_new_mutex(&lock, name));
+
+	/* Duplicate mode: distinct descriptors, closed as usual. */
+	__Tcall_assert(ret, evl_set_open_cache(EVL_OPEN_CACHE_DUP));
+	__Texpr_assert(ret == EVL_OPEN_CACHE_OFF);
+	__Tcall_assert(ret, evl_open_mutex(&m1, name + 1));
+	__Tcall_assert(ret, evl_open_mutex(&m2, name + 1));
+	fd1 = m1.u.active.efd;
+	fd2 = m2.u.active.efd;
+	__Texpr_assert(fd1 != fd2);
+	__Tcall_assert(ret, evl_close_mutex(&m1));
+	__Tcall_assert(ret, evl_lock_mutex(&m2));
+	__Tcall_assert(ret, evl_unlock_mutex(&m2));
+	__Tcall_assert(ret, evl_close_mutex(&m2));
+
+	/* Shared mode: same descriptor, last close releases it. */
+	__Tcall_assert(ret, evl_set_open_cache(EVL_OPEN_CACHE_SHARE));
+	__Texpr_assert(ret == EVL_OPEN_CACHE_DUP);
+	__Tcall_assert(ret, evl_open_mutex(&m1, name + 1));
+	__Tcall_assert(ret, evl_open_mutex(&m2, name + 1));
+	fd1 = m1.u.active.efd;
+	fd2 = m2.u.active.efd;
+	__Texpr_assert(fd1 == fd2);
+
+	/* Plain openers get their own descriptor. */
+	__Tcall_assert(fd2, evl_open_element(EVL_MONITOR_DEV, "%s", name + 1));
+	__Texpr_assert(fd2 != fd1);
+	close(fd2);
+	__Tcall_assert(ret, evl_close_mutex(&m1));
+	__Tcall_assert(ret, evl_lock_mutex(&m2));
+	__Tcall_assert(ret, evl_unlock_mutex(&m2));
+	__Tcall_assert(ret, evl_close_mutex(&m2));
+
+	/*
+	 * A shared descriptor closed behind our back then reused for
+	 * another file must not be handed out again.
+	 */
+	__Tcall_assert(ret, evl_open_mutex(&m1, name + 1));
+	fd1 = m1.u.active.efd;
+	__Tcall_errno_assert(nfd, open("/dev/null", O_RDWR));
+	__Tcall_errno_assert(ret, dup2(nfd, fd1));
+	close(nfd);
+	__Tcall_assert(ret, evl_open_mutex(&m2, name + 1));
+	__Texpr_assert(m2.u.active.efd != fd1);
+	__Tcall_assert(ret, evl_lock_mutex(&m2));
+	__Tcall_assert(ret, evl_unlock_mutex(&m2));
+	__Tcall_assert(ret, evl_close_mutex(&m2));
+	close(fd1);
+
+	evl_flush_open_cache();
+	__Tcall_assert(ret, evl_set_open_cache(EVL_OPEN_CACHE_OFF));
+
+	/* Misses are not cached. */
+	__Fcall_assert(ret, evl_open_element(EVL_MONITOR_DEV, "%s.nope",
+						name + 1));
+	__Texpr_assert(ret == -ENOENT);
+
+	__Fcall_assert(ret, evl_set_open_cache(42));
+	__Texpr_assert(ret == -EINVAL);
+
+	evl_close_mutex(&lock);
+	free(path);
+
+	return 0;
+}
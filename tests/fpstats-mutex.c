@@ -0,0 +1,94 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/mutex.h>
+#include <evl/mutex-evl.h>
+#include <evl/sem.h>
+#include <evl/flags.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/fpstats.h>
+#include "helpers.h"
+
+#define LOOPS  16
+
+static DEFINE_EVL_MUTEX(mutex);
+
+int main(int argc, char *argv[])
+{
+	struct evl_fpstats stats, total;
+	const struct evl_fpstat *e;
+	struct timespec now, timeout;
+	struct evl_flags flags;
+	struct evl_sem sem;
+	int tfd, ret, n;
+	char *name;
+
+	__Tcall_assert(ret, evl_enable_instr(EVL_INSTR_FPSTATS, true));
+	__Texpr_assert(evl_instr_enabled(EVL_INSTR_FPSTATS));
+
+	__Tcall_assert(tfd, evl_attach_self("fpstats-mutex:%d", getpid()));
+
+	name = get_unique_name(EVL_MONITOR_DEV, 0);
+	__Tcall_assert(ret, evl_new_sem(&sem, name));
+	name = get_unique_name(EVL_MONITOR_DEV, 1);
+	__Tcall_assert(ret, evl_new_flags(&flags, name));
+
+	/* Uncontended requests must not leave user space. */
+	for (n = 0; n < LOOPS; n++) {
+		__Tcall_assert(ret, evl_lock_mutex(&mutex));
+		__Tcall_assert(ret, evl_unlock_mutex(&mutex));
+		__Tcall_assert(ret, evl_put_sem(&sem));
+		__Tcall_assert(ret, evl_get_sem(&sem));
+	}
+
+	/* Waiting on an empty semaphore has to. */
+	__Tcall_assert(ret, evl_read_clock(EVL_CLOCK_MONOTONIC, &now));
+	timespec_add_ns(&timeout, &now, 1000000); /* 1ms */
+	__Fcall_assert(ret, evl_timedget_sem(&sem, &timeout));
+	__Texpr_assert(ret == -ETIMEDOUT);
+
+	/* Flags are always posted by the core. */
+	__Tcall_assert(ret, evl_post_flags(&flags, 1));
+
+	__Tcall_assert(ret, evl_get_thread_fpstats(&stats));
+
+	e = stats.entries + EVL_FPSTAT_LOCK_MUTEX;
+	__Texpr_assert(e->fast == LOOPS && e->slow == 0);
+	e = stats.entries + EVL_FPSTAT_UNLOCK_MUTEX;
+	__Texpr_assert(e->fast == LOOPS && e->slow == 0);
+	e = stats.entries + EVL_FPSTAT_PUT_SEM;
+	__Texpr_assert(e->fast == LOOPS && e->slow == 0);
+	e = stats.entries + EVL_FPSTAT_GET_SEM;
+	__Texpr_assert(e->fast == LOOPS && e->slow == 1);
+	__Texpr_assert(e->switches == 0);
+	e = stats.entries + EVL_FPSTAT_POST_FLAGS;
+	__Texpr_assert(e->fast == 0 && e->slow == 1);
+
+	__Tcall_assert(ret, evl_get_fpstats(&total));
+	__Texpr_assert(ret >= 1);
+	__Texpr_assert(total.entries[EVL_FPSTAT_LOCK_MUTEX].fast >= LOOPS);
+
+	__Tcall_assert(ret, evl_enable_instr(EVL_INSTR_FPSTATS, false));
+	__Tcall_assert(ret, evl_lock_mutex(&mutex));
+	__Tcall_assert(ret, evl_unlock_mutex(&mutex));
+	__Tcall_assert(ret, evl_get_thread_fpstats(&stats));
+	__Texpr_assert(stats.entries[EVL_FPSTAT_LOCK_MUTEX].fast == LOOPS);
+
+	__Texpr_assert(evl_fpstat_name(EVL_FPSTAT_PUT_SEM) != NULL);
+	__Texpr_assert(evl_fpstat_name(EVL_FPSTAT_NR_ENTRIES) == NULL);
+
+	evl_close_flags(&flags);
+	evl_close_sem(&sem);
+	evl_close_mutex(&mutex);
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <time.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/latch.h>
+#include "helpers.h"
+
+#define NR_WAITERS 4
+
+static struct evl_latch latch;
+
+static void *latch_waiter(void *arg)
+{
+	int nth = (int)(long)arg, ret, tfd;
+
+	__Tcall_assert(tfd, evl_attach_self("latch-waiter:%d.%d", getpid(), nth));
+	__Tcall_assert(ret, evl_count_down_latch(&latch, 1));
+	__Tcall_assert(ret, evl_wait_latch(&latch));
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t waiters[NR_WAITERS];
+	struct timespec now, timeout;
+	int tfd, ret, n;
+
+	__Tcall_assert(tfd, evl_attach_self("latch-countdown:%d", getpid()));
+	__Tcall_assert(ret, evl_new_latch(&latch, NR_WAITERS + 1));
+
+	for (n = 0; n < NR_WAITERS; n++)
+		new_thread(waiters + n, SCHED_FIFO, 1, latch_waiter, (void *)(long)n);
+
+	/* We hold the last count, so the latch must stay closed. */
+	__Fcall_assert(ret, evl_trywait_latch(&latch));
+	__Texpr_assert(ret == -EAGAIN);
+	evl_read_clock(EVL_CLOCK_MONOTONIC, &now);
+	timespec_add_ns(&timeout, &now, 10000000); /* 10ms */
+	__Fcall_assert(ret, evl_timedwait_latch(&latch, &timeout));
+	__Texpr_assert(ret == -ETIMEDOUT);
+
+	__Tcall_assert(ret, evl_count_down_latch(&latch, 1));
+	__Tcall_assert(ret, evl_wait_latch(&latch));
+	__Tcall_assert(ret, evl_trywait_latch(&latch));
+
+	for (n = 0; n < NR_WAITERS; n++)
+		pthread_join(waiters[n], NULL);
+
+	evl_destroy_latch(&latch);
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/mutex.h>
+#include <evl/mutex-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/rwlock.h>
+#include <evl/lockstat.h>
+#include "helpers.h"
+
+#define LOOPS  16
+
+static DEFINE_EVL_MUTEX(mutex);
+
+static DEFINE_EVL_RWLOCK(rwlock);
+
+static const struct evl_lockstat *
+find_stat(const struct evl_lockstat *stats, ssize_t nr,
+	const void *lock, enum evl_lockstat_type type)
+{
+	ssize_t n;
+
+	for (n = 0; n < nr; n++)
+		if (stats[n].lock == lock && stats[n].type == type)
+			return stats + n;
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct evl_lockstat *s;
+	struct evl_lockstat stats[8];
+	int tfd, ret, n;
+	ssize_t nr;
+
+	__Tcall_assert(ret, evl_enable_instr(EVL_INSTR_LOCKSTAT, true));
+	__Texpr_assert(evl_instr_enabled(EVL_INSTR_LOCKSTAT));
+
+	__Tcall_assert(tfd, evl_attach_self("lockstat-mutex:%d", getpid()));
+
+	for (n = 0; n < LOOPS; n++) {
+		__Tcall_assert(ret, evl_lock_mutex(&mutex));
+		__Tcall_assert(ret, evl_unlock_mutex(&mutex));
+		__Tcall_assert(ret, evl_lock_read(&rwlock));
+		__Tcall_assert(ret, evl_unlock_read(&rwlock));
+	}
+
+	__Tcall_assert(ret, evl_lock_write(&rwlock));
+	__Tcall_assert(ret, evl_unlock_write(&rwlock));
+
+	__Tcall_assert(nr, evl_get_lockstat(stats, 8));
+	__Texpr_assert(nr == 3);
+
+	s = find_stat(stats, nr, &mutex, EVL_LOCKSTAT_MUTEX);
+	__Texpr_assert(s != NULL);
+	__Texpr_assert(s->acquired == LOOPS);
+	__Texpr_assert(s->contended == 0);
+	__Texpr_assert(s->hold_max <= s->hold_total);
+
+	s = find_stat(stats, nr, &rwlock, EVL_LOCKSTAT_RWLOCK_RD);
+	__Texpr_assert(s != NULL);
+	__Texpr_assert(s->acquired == LOOPS);
+
+	s = find_stat(stats, nr, &rwlock, EVL_LOCKSTAT_RWLOCK_WR);
+	__Texpr_assert(s != NULL);
+	__Texpr_assert(s->acquired == 1);
+
+	__Tcall_assert(ret, evl_enable_instr(EVL_INSTR_LOCKSTAT, false));
+	__Tcall_assert(ret, evl_lock_mutex(&mutex));
+	__Tcall_assert(ret, evl_unlock_mutex(&mutex));
+	__Tcall_assert(nr, evl_get_lockstat(stats, 8));
+	s = find_stat(stats, nr, &mutex, EVL_LOCKSTAT_MUTEX);
+	__Texpr_assert(s != NULL && s->acquired == LOOPS);
+
+	evl_close_mutex(&mutex);
+	evl_destroy_rwlock(&rwlock);
+
+	return 0;
+}
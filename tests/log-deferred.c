@@ -0,0 +1,136 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * PURPOSE: check that evl_log() records its arguments from an
+ * out-of-band thread, that the logger formats them later on in
+ * timestamp order with copies of the string arguments, and that
+ * records which do not fit in the ring are dropped and reported.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/log.h>
+#include "helpers.h"
+
+#define RING_SIZE	4096
+#define NR_FLOODS	200
+
+static int pipefd[2];
+
+static char received[65536];
+
+static size_t read_output(void)
+{
+	size_t count = 0;
+	ssize_t ret;
+
+	for (;;) {
+		ret = read(pipefd[0], received + count,
+			sizeof(received) - 1 - count);
+		if (ret <= 0)
+			break;
+		count += ret;
+	}
+
+	received[count] = '\0';
+
+	return count;
+}
+
+/* Match the next output line, skipping the timestamp prefix. */
+static const char *match_line(const char *p, const char *expected)
+{
+	const char *eol;
+
+	__Texpr_assert(*p == '[');
+	p = strstr(p, "] ");
+	__Texpr_assert(p != NULL);
+	p += 2;
+	eol = strchr(p, '\n');
+	__Texpr_assert(eol != NULL);
+	__Texpr_assert((size_t)(eol - p) == strlen(expected));
+	__Texpr_assert(memcmp(p, expected, eol - p) == 0);
+
+	return eol + 1;
+}
+
+int main(int argc, char *argv[])
+{
+	char name[16], expected[128];
+	unsigned long drops;
+	int tfd, ret, n;
+	const char *p;
+	size_t len;
+
+	__Tcall_assert(ret, pipe(pipefd));
+	__Tcall_errno_assert(ret, fcntl(pipefd[0], F_SETFL, O_NONBLOCK));
+
+	/* Nobody to consume the records yet. */
+	__Texpr_assert(evl_log("early") == -ENXIO);
+
+	/* A long period, so that we control when records are drained. */
+	__Tcall_assert(ret, evl_start_logger(pipefd[1], RING_SIZE,
+						10000000000ULL));
+	__Texpr_assert(evl_start_logger(pipefd[1], RING_SIZE, 0) == -EBUSY);
+	__Tcall_assert(tfd, evl_attach_self("log-deferred:%d", getpid()));
+
+	strcpy(name, "first");
+	__Tcall_assert(ret, evl_log("hello"));
+	__Tcall_assert(ret, evl_log("%d %u %ld %llx", -1, 2U, -3L, 0xabcULL));
+	__Tcall_assert(ret, evl_log("%s/%-6s/%.3f", name, "lit", 3.14159));
+	__Tcall_assert(ret, evl_log("%*d|%c|%hhu|%zu|100%%", 5, 42, 'x',
+					(unsigned char)255, (size_t)7));
+	__Tcall_assert(ret, evl_log("%p %s\n", (void *)0x1000,
+					(const char *)NULL));
+	__Tcall_assert(ret, evl_log("%s@%p", name, name));
+	/* The logger must have copied the previous value. */
+	strcpy(name, "second");
+
+	__Tcall_assert(ret, evl_flush_log());
+	read_output();
+	p = received;
+	p = match_line(p, "hello");
+	p = match_line(p, "-1 2 -3 abc");
+	p = match_line(p, "first/lit   /3.142");
+	p = match_line(p, "   42|x|255|7|100%");
+	snprintf(expected, sizeof(expected), "%p (null)", (void *)0x1000);
+	p = match_line(p, expected);
+	snprintf(expected, sizeof(expected), "first@%p", name);
+	p = match_line(p, expected);
+	__Texpr_assert(*p == '\0');
+
+	/* Overflow the ring, the excess must be reported. */
+	for (n = 0; n < NR_FLOODS; n++)
+		evl_log("flood %d", n);
+	drops = evl_log_drops();
+	__Texpr_assert(drops > 0 && drops < NR_FLOODS);
+
+	__Tcall_assert(ret, evl_flush_log());
+	len = read_output();
+	__Texpr_assert(len > 0);
+	snprintf(expected, sizeof(expected),
+		"[evl_log: %lu record(s) lost by thread", drops);
+	__Texpr_assert(strncmp(received, expected, strlen(expected)) == 0);
+	p = strchr(received, '\n') + 1;
+	for (n = 0; n < (int)(NR_FLOODS - drops); n++) {
+		snprintf(expected, sizeof(expected), "flood %d", n);
+		p = match_line(p, expected);
+	}
+	__Texpr_assert(*p == '\0');
+
+	/* Stopping the logger writes out the pending records. */
+	__Tcall_assert(ret, evl_log("last %d", 1));
+	__Tcall_assert(ret, evl_stop_logger());
+	read_output();
+	p = match_line(received, "last 1");
+	__Texpr_assert(*p == '\0');
+	__Texpr_assert(evl_stop_logger() == -ENXIO);
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <evl/atomic.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/mutex.h>
+#include <evl/mutex-evl.h>
+#include <evl/sem.h>
+#include <evl/flags.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include "helpers.h"
+
+#define NR_ELEMENTS  64
+
+static struct evl_mutex mutexes[NR_ELEMENTS];
+
+static struct evl_sem sems[NR_ELEMENTS];
+
+static struct evl_flags flags[NR_ELEMENTS];
+
+int main(int argc, char *argv[])
+{
+	int tfd, ret, n, bits;
+
+	__Tcall_assert(tfd, evl_attach_self("monitor-array:%d", getpid()));
+
+	__Tcall_assert(ret, evl_create_mutex_array(mutexes, NR_ELEMENTS,
+					EVL_CLOCK_MONOTONIC, 0,
+					EVL_MUTEX_NORMAL|EVL_CLONE_PRIVATE));
+	__Tcall_assert(ret, evl_create_sem_array(sems, NR_ELEMENTS,
+					EVL_CLOCK_MONOTONIC, 1,
+					EVL_CLONE_PRIVATE));
+	__Tcall_assert(ret, evl_create_flags_array(flags, NR_ELEMENTS,
+					EVL_CLOCK_MONOTONIC, 0,
+					EVL_CLONE_PRIVATE));
+
+	for (n = 0; n < NR_ELEMENTS; n++) {
+		__Tcall_assert(ret, evl_lock_mutex(mutexes + n));
+		__Tcall_assert(ret, evl_get_sem(sems + n));
+		__Tcall_assert(ret, evl_post_flags(flags + n, n + 1));
+	}
+
+	for (n = 0; n < NR_ELEMENTS; n++) {
+		__Tcall_assert(ret, evl_unlock_mutex(mutexes + n));
+		__Fcall_assert(ret, evl_tryget_sem(sems + n));
+		__Texpr_assert(ret == -EAGAIN);
+		__Tcall_assert(ret, evl_trywait_flags(flags + n, &bits));
+		__Texpr_assert(bits == n + 1);
+	}
+
+	/* Anonymous elements cannot be public. */
+	__Fcall_assert(ret, evl_create_sem_array(sems, 1, EVL_CLOCK_MONOTONIC,
+						0, EVL_CLONE_PUBLIC));
+	__Texpr_assert(ret == -EINVAL);
+
+	for (n = 0; n < NR_ELEMENTS; n++) {
+		__Tcall_assert(ret, evl_close_mutex(mutexes + n));
+		__Tcall_assert(ret, evl_close_sem(sems + n));
+		__Tcall_assert(ret, evl_close_flags(flags + n));
+	}
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <time.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/flags.h>
+#include <evl/sem.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include "helpers.h"
+
+#define LOW_PRIO	1
+#define HIGH_PRIO	2
+
+#define NR_GROUPS	3
+
+struct test_context {
+	struct evl_flags flags[NR_GROUPS];
+	struct evl_flags_group groups[NR_GROUPS];
+	struct evl_flags_waitset ws;
+	struct evl_sem sem;
+};
+
+static void *flags_receiver(void *arg)
+{
+	struct test_context *p = arg;
+	int ret, tfd, bits;
+
+	__Tcall_assert(tfd, evl_attach_self("monitor-flags-any-receiver:%d", getpid()));
+
+	/* Sender should post 0x10 to group #2. */
+	__Tcall_assert(ret, evl_put_sem(&p->sem));
+	__Tcall_assert(ret, evl_wait_any_flags(&p->ws, &bits));
+	__Texpr_assert(ret == 2);
+	__Texpr_assert(bits == 0x10);
+
+	/* Then 0x1 to group #0. */
+	__Tcall_assert(ret, evl_put_sem(&p->sem));
+	__Tcall_assert(ret, evl_wait_any_flags(&p->ws, &bits));
+	__Texpr_assert(ret == 0);
+	__Texpr_assert(bits == 0x1);
+
+	__Tcall_assert(ret, evl_put_sem(&p->sem));
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec now, timeout;
+	struct sched_param param;
+	struct test_context c;
+	void *status = NULL;
+	int tfd, ffd, sfd, ret, bits, n;
+	pthread_t receiver;
+	char *name;
+
+	param.sched_priority = HIGH_PRIO;
+	__Texpr_assert(pthread_setschedparam(pthread_self(),
+				SCHED_FIFO, &param) == 0);
+
+	/* EVL inherits the inband scheduling params upon attachment. */
+	__Tcall_assert(tfd, evl_attach_self("monitor-flags-any:%d", getpid()));
+
+	for (n = 0; n < NR_GROUPS; n++) {
+		name = get_unique_name(EVL_MONITOR_DEV, n);
+		__Tcall_assert(ffd, evl_new_flags(c.flags + n, name));
+		c.groups[n].flags = c.flags + n;
+		c.groups[n].bits = 0xff;
+	}
+
+	name = get_unique_name(EVL_MONITOR_DEV, NR_GROUPS);
+	__Tcall_assert(sfd, evl_new_sem(&c.sem, name));
+
+	__Tcall_assert(ret, evl_create_flags_waitset(&c.ws, c.groups, NR_GROUPS));
+
+	/* Nothing pending: trywait fails, timed wait times out. */
+	__Fcall_assert(ret, evl_trywait_any_flags(&c.ws, &bits));
+	__Texpr_assert(ret == -EAGAIN);
+	evl_read_clock(EVL_CLOCK_MONOTONIC, &now);
+	timespec_add_ns(&timeout, &now, 10000000); /* 10ms */
+	__Fcall_assert(ret, evl_timedwait_any_flags(&c.ws, &timeout, &bits));
+	__Texpr_assert(ret == -ETIMEDOUT);
+
+	/* Lowest index wins, bits outside of the mask stay pending. */
+	__Tcall_assert(ret, evl_post_flags(c.flags + 1, 0x102));
+	__Tcall_assert(ret, evl_post_flags(c.flags + 2, 0x4));
+	__Tcall_assert(ret, evl_trywait_any_flags(&c.ws, &bits));
+	__Texpr_assert(ret == 1);
+	__Texpr_assert(bits == 0x2);
+	__Tcall_assert(ret, evl_peek_flags(c.flags + 1, &bits));
+	__Texpr_assert(bits == 0x100);
+	__Tcall_assert(ret, evl_trywait_flags(c.flags + 1, &bits));
+	__Tcall_assert(ret, evl_trywait_any_flags(&c.ws, &bits));
+	__Texpr_assert(ret == 2);
+	__Texpr_assert(bits == 0x4);
+
+	/*
+	 * Foreign bits do not wake up a blocking wait, but they are
+	 * still pending for other waiters once it returns.
+	 */
+	__Tcall_assert(ret, evl_post_flags(c.flags + 1, 0x100));
+	evl_read_clock(EVL_CLOCK_MONOTONIC, &now);
+	timespec_add_ns(&timeout, &now, 10000000); /* 10ms */
+	__Fcall_assert(ret, evl_timedwait_any_flags(&c.ws, &timeout, &bits));
+	__Texpr_assert(ret == -ETIMEDOUT);
+	__Tcall_assert(ret, evl_peek_flags(c.flags + 1, &bits));
+	__Texpr_assert(bits == 0x100);
+	__Tcall_assert(ret, evl_trywait_some_flags(c.flags + 1, 0x100, &bits));
+	__Texpr_assert(bits == 0x100);
+
+	new_thread(&receiver, SCHED_FIFO, LOW_PRIO,
+			flags_receiver, &c);
+
+	__Tcall_assert(ret, evl_get_sem(&c.sem));
+	__Tcall_assert(ret, evl_usleep(1000));
+	__Tcall_assert(ret, evl_post_flags(c.flags + 2, 0x10));
+	__Tcall_assert(ret, evl_get_sem(&c.sem));
+	__Tcall_assert(ret, evl_usleep(1000));
+	__Tcall_assert(ret, evl_post_flags(c.flags, 0x1));
+	__Tcall_assert(ret, evl_get_sem(&c.sem));
+	__Texpr_assert(pthread_join(receiver, &status) == 0);
+	__Texpr_assert(status == NULL);
+
+	__Tcall_assert(ret, evl_destroy_flags_waitset(&c.ws));
+	__Tcall_assert(ret, evl_close_sem(&c.sem));
+	for (n = 0; n < NR_GROUPS; n++)
+		__Tcall_assert(ret, evl_close_flags(c.flags + n));
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <time.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <evl/atomic.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/mutex.h>
+#include <evl/mutex-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/sem.h>
+#include "helpers.h"
+
+#define LOW_PRIO	1
+#define HIGH_PRIO	3
+
+static DEFINE_EVL_LAZY_MUTEX(lazy_lock);
+
+struct test_context {
+	struct evl_sem start;
+	struct evl_sem sem;
+};
+
+static bool check_priority(int tfd, int prio)
+{
+	struct evl_thread_state statebuf;
+	int ret;
+
+	__Tcall_assert(ret, evl_get_state(tfd, &statebuf));
+
+	return statebuf.eattrs.sched_policy == SCHED_FIFO &&
+		statebuf.eattrs.sched_priority == prio;
+}
+
+static void *pi_contend(void *arg)
+{
+	struct test_context *p = arg;
+	int ret, tfd;
+
+	__Tcall_assert(tfd, evl_attach_self("monitor-pi-lazy-contend:%d", getpid()));
+	__Tcall_assert(ret, evl_get_sem(&p->start));
+
+	/* Failing to grab a busy lazy mutex does not inflate it. */
+	__Fcall_assert(ret, evl_trylock_mutex(&lazy_lock));
+	__Texpr_assert(ret == -EBUSY);
+	__Texpr_assert(lazy_lock.magic == __MUTEX_UNINIT_MAGIC);
+	__Tcall_assert(ret, evl_put_sem(&p->sem));
+
+	/* First contention, this creates the core element. */
+	__Tcall_assert(ret, evl_lock_mutex(&lazy_lock));
+	__Tcall_assert(ret, evl_unlock_mutex(&lazy_lock));
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sched_param param;
+	struct test_context c;
+	pthread_t contender;
+	void *status = NULL;
+	int tfd, sfd, ret;
+	char *name;
+
+	param.sched_priority = LOW_PRIO;
+	__Texpr_assert(pthread_setschedparam(pthread_self(),
+				SCHED_FIFO, &param) == 0);
+
+	__Tcall_assert(tfd, evl_attach_self("monitor-pi-lazy:%d", getpid()));
+
+	name = get_unique_name(EVL_MONITOR_DEV, 0);
+	__Tcall_assert(sfd, evl_new_sem(&c.sem, name));
+
+	name = get_unique_name(EVL_MONITOR_DEV, 1);
+	__Tcall_assert(sfd, evl_new_sem(&c.start, name));
+
+	/* Uncontended locking must not create any element. */
+	__Tcall_assert(ret, evl_lock_mutex(&lazy_lock));
+	__Fcall_assert(ret, evl_lock_mutex(&lazy_lock));
+	__Texpr_assert(ret == -EDEADLK);
+	__Tcall_assert(ret, evl_unlock_mutex(&lazy_lock));
+	__Fcall_assert(ret, evl_unlock_mutex(&lazy_lock));
+	__Texpr_assert(ret == -EPERM);
+	__Tcall_assert(ret, evl_trylock_mutex(&lazy_lock));
+	__Tcall_assert(ret, evl_unlock_mutex(&lazy_lock));
+	__Texpr_assert(lazy_lock.magic == __MUTEX_UNINIT_MAGIC);
+
+	new_thread(&contender, SCHED_FIFO, HIGH_PRIO, pi_contend, &c);
+
+	__Tcall_assert(ret, evl_clear_thread_mode(tfd, EVL_T_WOLI, NULL));
+	__Tcall_assert(ret, evl_lock_mutex(&lazy_lock));
+	__Tcall_assert(ret, evl_put_sem(&c.start));
+	__Tcall_assert(ret, evl_get_sem(&c.sem));
+
+	/*
+	 * Inflating the mutex switches the contender in-band, give
+	 * it some time to block on the core element.
+	 */
+	evl_usleep(100000);
+
+	/*
+	 * The contender should have handed over the gate to us, so
+	 * that we are boosted like with any regular PI mutex.
+	 */
+	__Texpr_assert(lazy_lock.magic == __MUTEX_ACTIVE_MAGIC);
+	__Texpr_assert(lazy_lock.lazy_owner == 0);
+	__Texpr_assert(check_priority(tfd, HIGH_PRIO));
+
+	__Tcall_assert(ret, evl_unlock_mutex(&lazy_lock));
+	__Texpr_assert(check_priority(tfd, LOW_PRIO));
+	__Texpr_assert(pthread_join(contender, &status) == 0);
+	__Texpr_assert(status == NULL);
+
+	__Tcall_assert(ret, evl_lock_mutex(&lazy_lock));
+	__Tcall_assert(ret, evl_unlock_mutex(&lazy_lock));
+
+	evl_close_sem(&c.start);
+	evl_close_sem(&c.sem);
+	evl_close_mutex(&lazy_lock);
+
+	return 0;
+}
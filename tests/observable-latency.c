@@ -0,0 +1,90 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * PURPOSE: check that stamped reads from an observable report the
+ * delivery date, and account for the delivery latency of each
+ * notification into the subscriber's histogram.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/observable.h>
+#include <evl/observable-evl.h>
+#include "helpers.h"
+
+#define NR_NOTICES	8
+#define DELAY_US	2000
+
+int main(int argc, char *argv[])
+{
+	struct evl_notification nf[NR_NOTICES];
+	struct evl_notice ntc[NR_NOTICES];
+	struct evl_notify_latency lat;
+	struct timespec delivered;
+	unsigned long total = 0;
+	int tfd, ofd, ret, n;
+	__u64 p50, p100;
+
+	__Tcall_assert(tfd, evl_attach_self("observable-latency:%d", getpid()));
+	__Tcall_assert(ofd, evl_new_observable("observable:%d", getpid()));
+	__Tcall_assert(ret, evl_subscribe(ofd, NR_NOTICES, 0));
+
+	for (n = 0; n < NR_NOTICES; n++) {
+		ntc[n].tag = EVL_NOTICE_USER;
+		ntc[n].event.val = n;
+	}
+
+	__Tcall_assert(ret, evl_update_observable(ofd, ntc, NR_NOTICES));
+	__Texpr_assert(ret == NR_NOTICES);
+	evl_usleep(DELAY_US);
+
+	evl_reset_notify_latency(&lat);
+	__Texpr_assert(evl_get_latency_percentile(&lat, 50) == 0);
+	__Tcall_assert(ret, evl_read_observable_stamped(ofd, nf, NR_NOTICES,
+							&delivered, &lat));
+	__Texpr_assert(ret == NR_NOTICES);
+
+	for (n = 0; n < NR_NOTICES; n++) {
+		__Texpr_assert(timespec_sub_ns(&delivered, &nf[n].date) >=
+			DELAY_US * 1000LL);
+	}
+
+	__Texpr_assert(lat.count == NR_NOTICES);
+	__Texpr_assert(lat.min_ns >= DELAY_US * 1000ULL);
+	__Texpr_assert(lat.max_ns >= lat.min_ns);
+	__Texpr_assert(lat.sum_ns >= lat.min_ns * NR_NOTICES);
+
+	/* Nothing may land below 2^20ns, which is less than the delay. */
+	for (n = 0; n < EVL_LATENCY_BUCKETS; n++) {
+		__Texpr_assert(n >= 20 || lat.buckets[n] == 0);
+		total += lat.buckets[n];
+	}
+	__Texpr_assert(total == NR_NOTICES);
+
+	p50 = evl_get_latency_percentile(&lat, 50);
+	p100 = evl_get_latency_percentile(&lat, 100);
+	__Texpr_assert(p50 >= lat.min_ns && p50 <= p100);
+	__Texpr_assert(p100 == lat.max_ns);
+
+	/* Latencies beyond the last bucket limit are not capped. */
+	evl_reset_notify_latency(&lat);
+	lat.buckets[EVL_LATENCY_BUCKETS - 1] = 1;
+	lat.count = 1;
+	lat.min_ns = lat.max_ns = lat.sum_ns = 10000000000ULL;
+	__Texpr_assert(evl_get_latency_percentile(&lat, 50) == lat.max_ns);
+
+	/* No histogram, just the delivery date. */
+	__Tcall_assert(ret, evl_update_observable(ofd, ntc, 1));
+	__Tcall_assert(ret, evl_read_observable_stamped(ofd, nf, 1,
+							&delivered, NULL));
+	__Texpr_assert(ret == 1);
+	__Texpr_assert(timespec_sub_ns(&delivered, &nf[0].date) >= 0);
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * PURPOSE: check that the latest-value channel of an observable
+ * always returns a consistent snapshot of the last notice issued for
+ * each tag, while subscribers still receive the whole stream.
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/observable.h>
+#include <evl/observable-evl.h>
+#include "helpers.h"
+
+#define TAG_POSITION	(EVL_NOTICE_USER + 1)
+#define TAG_SPEED	(EVL_NOTICE_USER + 2)
+#define NR_UPDATES	100000
+
+static struct evl_latest_values shadow;
+
+static bool done;
+
+/*
+ * A plain thread reading from a second mapping: the value and serial
+ * of a snapshot must always match.
+ */
+static void *reader(void *arg)
+{
+	struct evl_notification nf;
+	unsigned long samples = 0;
+	int ret;
+
+	while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+		ret = evl_read_latest(&shadow, TAG_POSITION, &nf);
+		if (ret == -ENOENT || ret == -EAGAIN)
+			continue;
+		__Texpr_assert(ret == 0);
+		__Texpr_assert(nf.tag == TAG_POSITION);
+		__Texpr_assert(nf.event.lval == (long long)nf.serial * 3);
+		samples++;
+	}
+
+	return (void *)samples;
+}
+
+int main(int argc, char *argv[])
+{
+	struct evl_latest_values lv;
+	struct evl_notification nf;
+	struct evl_notice ntc[2];
+	int tfd, ofd, ret, n;
+	pthread_t tid;
+	void *samples;
+
+	__Tcall_assert(tfd, evl_attach_self("observable-latest:%d", getpid()));
+	__Tcall_assert(ofd, evl_new_observable("observable:%d", getpid()));
+	__Tcall_assert(ret, evl_subscribe(ofd, 16, 0));
+	__Tcall_errno_assert(ret, fcntl(ofd, F_SETFL, O_NONBLOCK));
+
+	__Tcall_assert(ret, evl_create_latest_values(&lv, ofd, 4));
+	__Texpr_assert(evl_read_latest(&lv, TAG_POSITION, &nf) == -ENOENT);
+
+	/* Both the slots and the stream are updated. */
+	ntc[0].tag = TAG_POSITION;
+	ntc[0].event.lval = 3;
+	ntc[1].tag = TAG_SPEED;
+	ntc[1].event.lval = 42;
+	__Tcall_assert(ret, evl_update_latest(&lv, ntc, 2));
+	__Texpr_assert(ret == 2);
+	__Tcall_assert(ret, evl_read_latest(&lv, TAG_SPEED, &nf));
+	__Texpr_assert(nf.event.lval == 42 && nf.serial == 1);
+	__Texpr_assert(nf.issuer == getpid());
+	__Tcall_assert(ret, evl_read_observable(ofd, &nf, 1));
+	__Texpr_assert(ret == 1 && nf.tag == TAG_POSITION);
+	__Tcall_assert(ret, evl_read_observable(ofd, &nf, 1));
+	__Texpr_assert(ret == 1 && nf.tag == TAG_SPEED);
+	__Tcall_assert(ret, evl_unsubscribe(ofd));
+
+	/* Hammer one slot while another thread samples it. */
+	__Tcall_errno_assert(ret, dup(lv.memfd));
+	__Tcall_assert(ret, evl_open_latest_values(&shadow, -1, ret));
+	__Texpr_assert(shadow.nr_slots == lv.nr_slots);
+	__Texpr_assert(pthread_create(&tid, NULL, reader, NULL) == 0);
+
+	for (n = 2; n <= NR_UPDATES; n++) {
+		ntc[0].event.lval = n * 3LL;
+		__Tcall_assert(ret, evl_update_latest(&lv, ntc, 1));
+	}
+
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	pthread_join(tid, &samples);
+	__Texpr_assert(samples != NULL);
+
+	__Tcall_assert(ret, evl_read_latest(&shadow, TAG_POSITION, &nf));
+	__Texpr_assert(nf.serial == NR_UPDATES);
+	__Texpr_assert(nf.event.lval == NR_UPDATES * 3LL);
+
+	/* A bad request publishes nothing, not even its valid part. */
+	ntc[0].tag = TAG_SPEED;
+	ntc[0].event.lval = 43;
+	ntc[1].tag = 0;
+	__Texpr_assert(evl_update_latest(&lv, ntc, 2) == -EINVAL);
+	__Tcall_assert(ret, evl_read_latest(&lv, TAG_SPEED, &nf));
+	__Texpr_assert(nf.event.lval == 42 && nf.serial == 1);
+
+	/* Running out of slots. */
+	for (n = 0; n < shadow.nr_slots; n++) {
+		ntc[0].tag = EVL_NOTICE_USER + 16 + n;
+		ret = evl_update_latest(&lv, ntc, 1);
+	}
+	__Texpr_assert(ret == -ENOSPC);
+
+	__Tcall_assert(ret, evl_close_latest_values(&shadow));
+	__Tcall_assert(ret, evl_close_latest_values(&lv));
+
+	return 0;
+}
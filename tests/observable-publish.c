@@ -0,0 +1,134 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * PURPOSE: check that a publisher batches notices until the count
+ * or the deadline timer is reached, only keeping the latest value of
+ * coalescable tags.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/observable.h>
+#include <evl/observable-evl.h>
+#include <evl/poll-evl.h>
+#include "helpers.h"
+
+#define TAG_STATE	(EVL_NOTICE_USER + 1)
+#define TAG_EVENT	(EVL_NOTICE_USER + 2)
+
+static int ofd;
+
+static void expect_nothing(void)
+{
+	struct evl_notification nf;
+	int ret;
+
+	__Fcall_assert(ret, evl_read_observable(ofd, &nf, 1));
+	__Texpr_assert(ret == -EAGAIN);
+}
+
+static void expect_notice(__u32 tag, int value)
+{
+	struct evl_notification nf;
+	int ret;
+
+	__Tcall_assert(ret, evl_read_observable(ofd, &nf, 1));
+	__Texpr_assert(ret == 1);
+	__Texpr_assert(nf.tag == tag);
+	__Texpr_assert(nf.event.val == value);
+}
+
+int main(int argc, char *argv[])
+{
+	struct evl_poll_event pollset;
+	struct evl_publisher pub;
+	int tfd, pfd, ret, n;
+
+	__Tcall_assert(tfd, evl_attach_self("observable-publish:%d", getpid()));
+	__Tcall_assert(ofd, evl_new_observable("observable:%d", getpid()));
+	__Tcall_assert(ret, evl_subscribe(ofd, 16, 0));
+	__Tcall_errno_assert(ret, fcntl(ofd, F_SETFL, O_NONBLOCK));
+
+	__Tcall_assert(ret, evl_init_publisher(&pub, ofd, 4, 0));
+	__Tcall_assert(ret, evl_set_coalescing(&pub, TAG_STATE, true));
+
+	/* State updates collapse, events don't. */
+	for (n = 0; n < 10; n++)
+		__Tcall_assert(ret, evl_publish(&pub, TAG_STATE,
+						(union evl_value){ .val = n }));
+	__Tcall_assert(ret, evl_publish(&pub, TAG_EVENT,
+					(union evl_value){ .val = 100 }));
+	__Tcall_assert(ret, evl_publish(&pub, TAG_EVENT,
+					(union evl_value){ .val = 101 }));
+	expect_nothing();
+	__Texpr_assert(pub.nr_pending == 3);
+
+	/* The fourth notice triggers the flush. */
+	__Tcall_assert(ret, evl_publish(&pub, TAG_STATE,
+					(union evl_value){ .val = 10 }));
+	__Tcall_assert(ret, evl_publish(&pub, TAG_EVENT,
+					(union evl_value){ .val = 102 }));
+	__Texpr_assert(pub.nr_pending == 0);
+	expect_notice(TAG_EVENT, 100);
+	expect_notice(TAG_EVENT, 101);
+	expect_notice(TAG_STATE, 10);
+	expect_notice(TAG_EVENT, 102);
+	expect_nothing();
+
+	__Texpr_assert(pub.stats.published == 14);
+	__Texpr_assert(pub.stats.coalesced == 10);
+	__Texpr_assert(pub.stats.sent == 4);
+	__Texpr_assert(pub.stats.flushes == 1);
+	__Texpr_assert(pub.stats.dropped == 0);
+
+	/* Explicit flush. */
+	__Tcall_assert(ret, evl_publish(&pub, TAG_STATE,
+					(union evl_value){ .val = 11 }));
+	__Tcall_assert(ret, evl_flush_publisher(&pub));
+	__Texpr_assert(ret == 1);
+	expect_notice(TAG_STATE, 11);
+
+	/* Coalescing can be turned off. */
+	__Tcall_assert(ret, evl_set_coalescing(&pub, TAG_STATE, false));
+	__Tcall_assert(ret, evl_publish(&pub, TAG_STATE,
+					(union evl_value){ .val = 12 }));
+	__Tcall_assert(ret, evl_publish(&pub, TAG_STATE,
+					(union evl_value){ .val = 13 }));
+	__Texpr_assert(pub.nr_pending == 2);
+	__Tcall_assert(ret, evl_destroy_publisher(&pub));
+	expect_notice(TAG_STATE, 12);
+	expect_notice(TAG_STATE, 13);
+
+	/* Notices older than the deadline are flushed by the timer. */
+	__Tcall_assert(ret, evl_init_publisher(&pub, ofd, 64, 1000000));
+	__Texpr_assert(pub.tfd >= 0);
+	__Tcall_assert(pfd, evl_new_poll());
+	__Tcall_assert(ret, evl_add_pollfd(pfd, pub.tfd, POLLIN, evl_nil));
+	__Tcall_assert(ret, evl_publish(&pub, TAG_EVENT,
+					(union evl_value){ .val = 1 }));
+	expect_nothing();
+	__Tcall_assert(ret, evl_poll(pfd, &pollset, 1));
+	__Texpr_assert(ret == 1);
+	__Tcall_assert(ret, evl_expire_publisher(&pub));
+	__Texpr_assert(ret == 1);
+	expect_notice(TAG_EVENT, 1);
+
+	/* Nothing is flushed before the deadline. */
+	__Tcall_assert(ret, evl_publish(&pub, TAG_EVENT,
+					(union evl_value){ .val = 2 }));
+	__Tcall_assert(ret, evl_expire_publisher(&pub));
+	__Texpr_assert(ret == 0);
+	expect_nothing();
+	__Tcall_assert(ret, evl_destroy_publisher(&pub));
+	expect_notice(TAG_EVENT, 2);
+	close(pfd);
+
+	return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/flags.h>
+#include <evl/sem.h>
+#include <evl/syscall.h>
+#include <evl/syscall-evl.h>
+#include <evl/monitor.h>
+#include "helpers.h"
+
+int main(int argc, char *argv[])
+{
+	struct evl_batch_op ops[3];
+	int tfd, ffd, sfd, ret, bits, val;
+	struct evl_flags flags;
+	__s32 mask, sigval;
+	struct evl_sem sem;
+	char *name;
+
+	__Tcall_assert(tfd, evl_attach_self("oob-batch:%d", getpid()));
+
+	name = get_unique_name(EVL_MONITOR_DEV, 0);
+	__Tcall_assert(ffd, evl_new_flags(&flags, name));
+
+	name = get_unique_name(EVL_MONITOR_DEV, 1);
+	__Tcall_assert(sfd, evl_new_sem(&sem, name));
+
+	mask = 0x5a;
+	ops[0].type = EVL_BATCH_IOCTL;
+	ops[0].fd = ffd;
+	ops[0].request = EVL_MONIOC_SIGNAL;
+	ops[0].arg = &mask;
+	/* Invalid request in the middle of the batch. */
+	ops[1].type = EVL_BATCH_IOCTL;
+	ops[1].fd = -1;
+	ops[1].request = EVL_MONIOC_SIGNAL;
+	ops[1].arg = &mask;
+	sigval = 1;
+	ops[2].type = EVL_BATCH_IOCTL;
+	ops[2].fd = sfd;
+	ops[2].request = EVL_MONIOC_SIGNAL;
+	ops[2].arg = &sigval;
+
+	__Tcall_assert(ret, evl_submit_batch(ops, 3, 0));
+	__Texpr_assert(ret == 3);
+	__Texpr_assert(ops[0].result == 0);
+	__Texpr_assert(ops[1].result == -EBADF);
+	__Texpr_assert(ops[2].result == 0);
+	__Tcall_assert(ret, evl_peek_flags(&flags, &bits));
+	__Texpr_assert(bits == 0x5a);
+	__Tcall_assert(ret, evl_peek_sem(&sem, &val));
+	__Texpr_assert(val == 1);
+
+	/* The batch must stop at the first error on request. */
+	__Tcall_assert(ret, evl_submit_batch(ops, 3, EVL_BATCH_STOP_ON_ERROR));
+	__Texpr_assert(ret == 2);
+	__Tcall_assert(ret, evl_peek_sem(&sem, &val));
+	__Texpr_assert(val == 1);
+
+	__Fcall_assert(ret, evl_submit_batch(ops, 3, ~0));
+	__Texpr_assert(ret == -EINVAL);
+
+	__Tcall_assert(ret, evl_close_sem(&sem));
+	__Tcall_assert(ret, evl_close_flags(&flags));
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <evl/evl.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include "helpers.h"
+
+#define STACK_RESERVE	(64 * 1024)
+#define HEAP_RESERVE	(1024 * 1024)
+
+static void *prefault_thread(void *arg)
+{
+	ssize_t ret;
+	int tfd;
+
+	__Tcall_assert(ret, evl_prefault_stack(STACK_RESERVE));
+	__Texpr_assert(ret > 0 && ret <= STACK_RESERVE);
+	__Tcall_assert(tfd, evl_attach_self("prepare-rt-thread:%d", getpid()));
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct evl_rt_report report;
+	pthread_t thread;
+	void *status;
+	int ret;
+
+	__Tcall_assert(ret, evl_prepare_rt(STACK_RESERVE, HEAP_RESERVE, &report));
+	__Texpr_assert(report.mlock_status == 0);
+	__Texpr_assert(report.stack_bytes == STACK_RESERVE);
+	__Texpr_assert(report.heap_bytes == HEAP_RESERVE);
+	__Texpr_assert(report.shm_bytes > 0);
+	__Texpr_assert(report.locked_bytes < 0 ||
+		(size_t)report.locked_bytes >= HEAP_RESERVE);
+
+	/* Zero means the whole stack. */
+	__Tcall_assert(ret, evl_prepare_rt(0, 0, NULL));
+
+	__Texpr_assert(pthread_create(&thread, NULL,
+					prefault_thread, NULL) == 0);
+	__Texpr_assert(pthread_join(thread, &status) == 0);
+	__Texpr_assert(status == NULL);
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * PURPOSE: check that batched printing stages the output of a thread
+ * until a flush is due, then relays it through the proxy in order,
+ * without splitting any line, including at exit.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/proxy.h>
+#include <evl/proxy-evl.h>
+#include "helpers.h"
+
+#define STAGING_SIZE	1024
+#define PROXY_SIZE	8192
+#define NR_LINES	200
+
+static int pipefd[2], logfd;
+
+static char expected[NR_LINES * 16], received[NR_LINES * 16];
+
+static void check_output(size_t len)
+{
+	size_t count = 0;
+	ssize_t ret;
+
+	while (count < len) {
+		__Tcall_errno_assert(ret, read(pipefd[0], received + count,
+						len - count));
+		count += ret;
+	}
+
+	__Texpr_assert(memcmp(received, expected, len) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	int tfd, ret, n, status;
+	size_t len = 0;
+	pid_t pid;
+	ssize_t count;
+	char c;
+
+	__Tcall_assert(ret, pipe(pipefd));
+	__Tcall_assert(logfd, evl_new_proxy(pipefd[1], PROXY_SIZE,
+					"proxy-batch:%d", getpid()));
+	__Tcall_assert(tfd, evl_attach_self("proxy-batch:%d", getpid()));
+
+	/* Nothing goes out until the staging buffer is flushed. */
+	__Tcall_assert(ret, evl_set_print_batching(STAGING_SIZE,
+						1000000000ULL));
+	for (n = 0; n < 10; n++) {
+		__Tcall_assert(count, evl_print_proxy(logfd, "line %d\n", n));
+		len += sprintf(expected + len, "line %d\n", n);
+	}
+	__Tcall_errno_assert(ret, fcntl(pipefd[0], F_SETFL, O_NONBLOCK));
+	__Texpr_assert(read(pipefd[0], &c, 1) < 0 && errno == EAGAIN);
+	__Tcall_errno_assert(ret, fcntl(pipefd[0], F_SETFL, 0));
+	__Tcall_assert(ret, evl_flush_print());
+	check_output(len);
+
+	/* Overflowing the staging buffer flushes it. */
+	for (n = 0, len = 0; n < NR_LINES; n++) {
+		__Tcall_assert(count, evl_print_proxy(logfd, "line %d\n", n));
+		len += sprintf(expected + len, "line %d\n", n);
+	}
+	__Texpr_assert(len > STAGING_SIZE);
+	__Tcall_assert(ret, evl_flush_print());
+	check_output(len);
+
+	/*
+	 * Outputs which waited for too long are flushed, whether the
+	 * thread prints again or not.
+	 */
+	__Tcall_assert(ret, evl_set_print_batching(STAGING_SIZE, 1000000ULL));
+	__Tcall_assert(count, evl_print_proxy(logfd, "first\n"));
+	evl_usleep(5000);
+	__Tcall_assert(count, evl_print_proxy(logfd, "second\n"));
+	len = sprintf(expected, "first\nsecond\n");
+	check_output(len);
+	__Tcall_assert(count, evl_print_proxy(logfd, "third\n"));
+	len = sprintf(expected, "third\n");
+	check_output(len);
+
+	/* Staged outputs are flushed at exit. */
+	__Tcall_assert(ret, evl_set_print_batching(STAGING_SIZE,
+						1000000000ULL));
+	pid = fork();
+	__Texpr_assert(pid >= 0);
+	if (pid == 0) {
+		evl_print_proxy(logfd, "at exit\n");
+		exit(0);
+	}
+	__Texpr_assert(waitpid(pid, &status, 0) == pid);
+	__Texpr_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	len = sprintf(expected, "at exit\n");
+	check_output(len);
+
+	/* Disabling batching writes directly again. */
+	__Tcall_assert(ret, evl_set_print_batching(0, 0));
+	__Tcall_assert(count, evl_print_proxy(logfd, "direct\n"));
+	len = sprintf(expected, "direct\n");
+	check_output(len);
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * PURPOSE: check that a file proxy relays the output of an
+ * out-of-band thread to a log file, rotating and compressing it as
+ * it grows, without losing or reordering any output, even when
+ * gzip is not available.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/proxy.h>
+#include <evl/proxy-evl.h>
+#include "helpers.h"
+
+#define PROXY_SIZE	8192
+#define NR_LINES	100
+#define NR_KEEP		16
+
+static char expected[NR_LINES * 32], received[NR_LINES * 32 + 1];
+
+static void wait_written(struct evl_file_proxy *fp, size_t len)
+{
+	struct evl_file_proxy_stats stats;
+	int ret, n;
+
+	for (n = 0; n < 1000; n++) {
+		__Tcall_assert(ret, evl_get_file_proxy_stats(fp, &stats));
+		if (stats.written == len)
+			return;
+		usleep(10000);
+	}
+
+	__Texpr_assert(stats.written == len);
+}
+
+static void expect_file(const char *path, const char *contents)
+{
+	char buf[64];
+	size_t count;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	__Texpr_assert(fp != NULL);
+	count = fread(buf, 1, sizeof(buf), fp);
+	fclose(fp);
+	__Texpr_assert(count == strlen(contents));
+	__Texpr_assert(memcmp(buf, contents, count) == 0);
+}
+
+static size_t collect(const char *cmd, size_t pos)
+{
+	size_t count;
+	FILE *fp;
+
+	fp = popen(cmd, "r");
+	__Texpr_assert(fp != NULL);
+	count = fread(received + pos, 1, sizeof(received) - 1 - pos, fp);
+	pclose(fp);
+
+	return pos + count;
+}
+
+int main(int argc, char *argv[])
+{
+	struct evl_rotation rotation = {
+		.max_size = 1024,
+		.keep = NR_KEEP,
+		.compress = true,
+	};
+	struct evl_file_proxy_stats stats;
+	char dir[] = "/tmp/evl-proxy-file.XXXXXX";
+	char path[64], cmd[128], magic[2];
+	struct evl_file_proxy fp;
+	int tfd, efd, ret, n;
+	size_t len = 0, pos;
+	char *oldpath;
+	ssize_t count;
+	FILE *gz;
+
+	__Texpr_assert(mkdtemp(dir) != NULL);
+	snprintf(path, sizeof(path), "%s/out.log", dir);
+
+	__Tcall_assert(efd, evl_new_file_proxy(&fp, path, PROXY_SIZE,
+					&rotation, "proxy-file:%d", getpid()));
+	__Tcall_assert(tfd, evl_attach_self("proxy-file:%d", getpid()));
+
+	for (n = 0; n < NR_LINES; n++) {
+		__Tcall_assert(count, evl_print_file_proxy(&fp,
+						"line %03d of the output\n", n));
+		len += sprintf(expected + len, "line %03d of the output\n", n);
+	}
+
+	wait_written(&fp, len);
+	__Tcall_assert(ret, evl_get_file_proxy_stats(&fp, &stats));
+	__Texpr_assert(stats.rotations >= 1);
+	__Texpr_assert(stats.overflows == 0 && stats.lost == 0);
+	__Texpr_assert(stats.errors == 0);
+
+	__Tcall_assert(ret, evl_rotate_file_proxy(&fp));
+	__Tcall_assert(ret, evl_close_file_proxy(&fp));
+
+	/* Rotated files are compressed. */
+	snprintf(cmd, sizeof(cmd), "%s.1.gz", path);
+	gz = fopen(cmd, "r");
+	__Texpr_assert(gz != NULL);
+	__Texpr_assert(fread(magic, 1, 2, gz) == 2);
+	__Texpr_assert(magic[0] == '\x1f' && magic[1] == '\x8b');
+	fclose(gz);
+
+	/* The oldest file comes last, put everything back in order. */
+	for (n = NR_KEEP, pos = 0; n > 0; n--) {
+		snprintf(cmd, sizeof(cmd),
+			"gzip -dc %s.%d.gz 2>/dev/null", path, n);
+		pos = collect(cmd, pos);
+	}
+	snprintf(cmd, sizeof(cmd), "cat %s", path);
+	pos = collect(cmd, pos);
+
+	__Texpr_assert(pos == len);
+	__Texpr_assert(memcmp(received, expected, len) == 0);
+
+	/* Without gzip, rotated files keep their plain name. */
+	oldpath = getenv("PATH");
+	__Texpr_assert(oldpath != NULL);
+	oldpath = strdup(oldpath);
+	setenv("PATH", "/nonexistent", 1);
+	snprintf(path, sizeof(path), "%s/plain.log", dir);
+	__Tcall_assert(efd, evl_new_file_proxy(&fp, path, PROXY_SIZE,
+					&rotation, "proxy-file-plain:%d", getpid()));
+	__Tcall_assert(count, evl_print_file_proxy(&fp, "one\n"));
+	wait_written(&fp, 4);
+	__Tcall_assert(ret, evl_rotate_file_proxy(&fp));
+	__Tcall_assert(count, evl_print_file_proxy(&fp, "two\n"));
+	wait_written(&fp, 8);
+	__Tcall_assert(ret, evl_rotate_file_proxy(&fp));
+	__Tcall_assert(ret, evl_get_file_proxy_stats(&fp, &stats));
+	__Texpr_assert(stats.errors > 0);
+	__Tcall_assert(ret, evl_close_file_proxy(&fp));
+	setenv("PATH", oldpath, 1);
+	free(oldpath);
+	snprintf(cmd, sizeof(cmd), "%s.2", path);
+	expect_file(cmd, "one\n");
+	snprintf(cmd, sizeof(cmd), "%s.1", path);
+	expect_file(cmd, "two\n");
+
+	/* A steady output does not prevent rotating on age. */
+	rotation.max_size = 0;
+	rotation.max_age_ns = 50000000; /* 50ms */
+	rotation.keep = 2;
+	rotation.compress = false;
+	snprintf(path, sizeof(path), "%s/aged.log", dir);
+	__Tcall_assert(efd, evl_new_file_proxy(&fp, path, PROXY_SIZE,
+					&rotation, "proxy-file-aged:%d", getpid()));
+	for (n = 0; n < 20; n++) {
+		__Tcall_assert(count, evl_print_file_proxy(&fp, "tick\n"));
+		evl_usleep(10000);
+	}
+	wait_written(&fp, 20 * 5);
+	__Tcall_assert(ret, evl_get_file_proxy_stats(&fp, &stats));
+	__Texpr_assert(stats.rotations >= 1);
+	__Tcall_assert(ret, evl_close_file_proxy(&fp));
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	__Texpr_assert(system(cmd) == 0);
+
+	return 0;
+}
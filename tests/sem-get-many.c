@@ -0,0 +1,125 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * PURPOSE: check that multi-unit gets are all-or-nothing, so that
+ * two threads waiting for two units each from a semaphore which
+ * only holds one do not end up sleeping on half of their request
+ * each, deadlocking. Multi-unit getters of distinct semaphores
+ * must not wait for each other, and public semaphores refuse
+ * blocking multi-unit gets.
+ */
+
+#include <sys/types.h>
+#include <time.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/sem.h>
+#include "helpers.h"
+
+#define NR_WAITERS 3
+
+static struct evl_sem start, done;
+
+static struct evl_sem sem, other;
+
+static void *sem_waiter(void *arg)
+{
+	int nth = (int)(long)arg, ret, tfd;
+	struct evl_sem *target = nth < 2 ? &sem : &other;
+
+	__Tcall_assert(tfd, evl_attach_self("sem-get-many-waiter:%d.%d", getpid(), nth));
+	__Tcall_assert(ret, evl_put_sem(&start));
+	__Tcall_assert(ret, evl_get_sem_n(target, 2));
+	__Tcall_assert(ret, evl_put_sem(&done));
+
+	return NULL;
+}
+
+static void expect_done(void)
+{
+	struct timespec now, timeout;
+	int ret;
+
+	__Tcall_assert(ret, evl_read_clock(EVL_CLOCK_MONOTONIC, &now));
+	timespec_add_ns(&timeout, &now, 1000000000); /* 1s */
+	__Tcall_assert(ret, evl_timedget_sem(&done, &timeout));
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t waiters[NR_WAITERS];
+	struct timespec now, timeout;
+	struct evl_sem pub;
+	int tfd, sfd, ret, n, val;
+	char *name;
+
+	__Tcall_assert(tfd, evl_attach_self("sem-get-many:%d", getpid()));
+
+	name = get_unique_name(EVL_MONITOR_DEV, 0);
+	__Tcall_assert(sfd, evl_new_sem(&start, name));
+	name = get_unique_name(EVL_MONITOR_DEV, 1);
+	__Tcall_assert(sfd, evl_new_sem(&done, name));
+	name = get_unique_name(EVL_MONITOR_DEV, 2);
+	__Tcall_assert(sfd, evl_create_sem(&sem, EVL_CLOCK_MONOTONIC, 1,
+						EVL_CLONE_PRIVATE, name));
+	name = get_unique_name(EVL_MONITOR_DEV, 3);
+	__Tcall_assert(sfd, evl_new_sem(&other, name));
+	name = get_unique_name(EVL_MONITOR_DEV, 4);
+	__Tcall_assert(sfd, evl_create_sem(&pub, EVL_CLOCK_MONOTONIC, 2,
+						EVL_CLONE_PUBLIC, name));
+
+	/* Other processes could not wake up a multi-unit getter. */
+	__Fcall_assert(ret, evl_get_sem_n(&pub, 2));
+	__Texpr_assert(ret == -EINVAL);
+	__Tcall_assert(ret, evl_tryget_sem_n(&pub, 2));
+	evl_close_sem(&pub);
+
+	/* A timed out request takes nothing. */
+	__Tcall_assert(ret, evl_read_clock(EVL_CLOCK_MONOTONIC, &now));
+	timespec_add_ns(&timeout, &now, 10000000); /* 10ms */
+	__Fcall_assert(ret, evl_timedget_sem_n(&sem, 2, &timeout));
+	__Texpr_assert(ret == -ETIMEDOUT);
+	__Tcall_assert(ret, evl_peek_sem(&sem, &val));
+	__Texpr_assert(val == 1);
+
+	for (n = 0; n < NR_WAITERS; n++) {
+		new_thread(waiters + n, SCHED_FIFO, 1, sem_waiter, (void *)(long)n);
+		__Tcall_assert(ret, evl_get_sem(&start));
+	}
+
+	/* Let both waiters block on the single unit available. */
+	evl_usleep(10000);
+	__Tcall_assert(ret, evl_peek_sem(&sem, &val));
+	__Texpr_assert(val == 1);
+
+	/* The getter of the other semaphore does not queue up behind. */
+	__Tcall_assert(ret, evl_put_sem_n(&other, 2));
+	expect_done();
+
+	/* Units are posted one at a time, each waiter gets two. */
+	__Tcall_assert(ret, evl_put_sem(&sem));
+	expect_done();
+	__Tcall_assert(ret, evl_put_sem(&sem));
+	__Tcall_assert(ret, evl_put_sem(&sem));
+	expect_done();
+
+	for (n = 0; n < NR_WAITERS; n++)
+		pthread_join(waiters[n], NULL);
+
+	__Tcall_assert(ret, evl_peek_sem(&sem, &val));
+	__Texpr_assert(val == 0);
+
+	evl_close_sem(&other);
+	evl_close_sem(&sem);
+	evl_close_sem(&done);
+	evl_close_sem(&start);
+
+	return 0;
+}
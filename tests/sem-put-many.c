@@ -0,0 +1,79 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <time.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/sem.h>
+#include "helpers.h"
+
+#define NR_WAITERS 5
+
+static struct evl_sem start;
+
+static struct evl_sem sem;
+
+static void *sem_waiter(void *arg)
+{
+	int nth = (int)(long)arg, ret, tfd;
+
+	__Tcall_assert(tfd, evl_attach_self("sem-put-many-waiter:%d.%d", getpid(), nth));
+	__Tcall_assert(ret, evl_put_sem(&start));
+	__Tcall_assert(ret, evl_get_sem(&sem));
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t waiters[NR_WAITERS];
+	int tfd, sfd, ret, n, val;
+	char *name;
+
+	__Tcall_assert(tfd, evl_attach_self("sem-put-many:%d", getpid()));
+
+	name = get_unique_name(EVL_MONITOR_DEV, 0);
+	__Tcall_assert(sfd, evl_new_sem(&start, name));
+	name = get_unique_name(EVL_MONITOR_DEV, 1);
+	__Tcall_assert(sfd, evl_new_sem(&sem, name));
+
+	/* Uncontended: units go through the fast path. */
+	__Tcall_assert(ret, evl_put_sem_n(&sem, 3));
+	__Tcall_assert(ret, evl_peek_sem(&sem, &val));
+	__Texpr_assert(val == 3);
+	__Fcall_assert(ret, evl_tryget_sem_n(&sem, 4));
+	__Texpr_assert(ret == -EAGAIN);
+	__Tcall_assert(ret, evl_tryget_sem_n(&sem, 2));
+	__Tcall_assert(ret, evl_get_sem_n(&sem, 1));
+	__Fcall_assert(ret, evl_tryget_sem(&sem));
+	__Texpr_assert(ret == -EAGAIN);
+	__Fcall_assert(ret, evl_put_sem_n(&sem, 0));
+	__Texpr_assert(ret == -EINVAL);
+
+	/* Contended: a single post releases all waiters. */
+	for (n = 0; n < NR_WAITERS; n++) {
+		new_thread(waiters + n, SCHED_FIFO, 1, sem_waiter, (void *)(long)n);
+		__Tcall_assert(ret, evl_get_sem(&start));
+	}
+
+	__Tcall_assert(ret, evl_put_sem_n(&sem, NR_WAITERS));
+
+	for (n = 0; n < NR_WAITERS; n++)
+		pthread_join(waiters[n], NULL);
+
+	__Tcall_assert(ret, evl_peek_sem(&sem, &val));
+	__Texpr_assert(val == 0);
+
+	evl_close_sem(&sem);
+	evl_close_sem(&start);
+
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/xbuf.h>
+#include <evl/xbuf-evl.h>
+#include "helpers.h"
+
+#define BUFSZ		1024
+#define SMALL_BUFSZ	64
+#define NR_BATCHES	64
+#define BATCH_SIZE	5
+#define MAX_RECORD	40
+
+struct record {
+	int seq;
+	char payload[MAX_RECORD - sizeof(int)];
+};
+
+static int xfd;
+
+/* Records have varying lengths, depending on their sequence. */
+static size_t record_len(int seq)
+{
+	return sizeof(int) + seq % (MAX_RECORD - sizeof(int));
+}
+
+static void *reader(void *arg)
+{
+	struct record recs[3], big;
+	struct evl_framed_xbuf rx;
+	struct iovec iov[3];
+	int seq = 0, ret, n, fd;
+	char *name;
+	ssize_t nr;
+
+	/* Closing the framed xbuf drops its descriptor. */
+	__Tcall_errno_assert(fd, dup(xfd));
+	__Tcall_assert(ret, evl_open_framed_xbuf(&rx, fd, BUFSZ, BUFSZ));
+
+	/* In-band reads drain the outbound ring. */
+	while (seq < NR_BATCHES * BATCH_SIZE) {
+		for (n = 0; n < 3; n++) {
+			iov[n].iov_base = recs + n;
+			iov[n].iov_len = sizeof(recs[n]);
+		}
+		__Tcall_assert(nr, evl_readv_xbuf(&rx, iov, 3));
+		__Texpr_assert(nr >= 1 && nr <= 3);
+		for (n = 0; n < nr; n++, seq++) {
+			__Texpr_assert(recs[n].seq == seq);
+			__Texpr_assert(iov[n].iov_len == record_len(seq));
+		}
+	}
+
+	/* In-band writes go to the inbound ring. */
+	memset(&big, 0, sizeof(big));
+	big.seq = -1;
+	iov[0].iov_base = &big;
+	iov[0].iov_len = sizeof(big);
+	__Tcall_assert(nr, evl_writev_xbuf(&rx, iov, 1));
+	__Texpr_assert(nr == 1);
+
+	__Tcall_assert(ret, evl_close_framed_xbuf(&rx));
+
+	/*
+	 * With asymmetric rings, in-band writes are bounded by the
+	 * smaller inbound ring.
+	 */
+	name = get_unique_name(EVL_XBUF_DEV, 1);
+	__Tcall_assert(fd, evl_create_framed_xbuf(&rx, SMALL_BUFSZ, BUFSZ,
+						EVL_CLONE_PRIVATE, name));
+	for (n = 0; n < 3; n++) {
+		iov[n].iov_base = recs + n;
+		iov[n].iov_len = sizeof(recs[n]);
+	}
+	__Tcall_assert(nr, evl_writev_xbuf(&rx, iov, 3));
+	__Texpr_assert(nr == 1);
+	__Tcall_assert(ret, evl_close_framed_xbuf(&rx));
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct record recs[BATCH_SIZE], big;
+	struct evl_framed_xbuf tx;
+	struct iovec iov[BATCH_SIZE];
+	int tfd, seq = 0, n, b;
+	pthread_t tid;
+	char *name;
+	ssize_t nr;
+
+	__Tcall_assert(tfd, evl_attach_self("xbuf-framed:%d", getpid()));
+
+	name = get_unique_name(EVL_XBUF_DEV, 0);
+	__Tcall_assert(xfd, evl_new_framed_xbuf(&tx, BUFSZ, name));
+
+	new_thread(&tid, SCHED_OTHER, 0, reader, NULL);
+
+	/* Out-of-band writes go to the outbound ring. */
+	for (b = 0; b < NR_BATCHES; b++) {
+		for (n = 0; n < BATCH_SIZE; n++, seq++) {
+			recs[n].seq = seq;
+			iov[n].iov_base = recs + n;
+			iov[n].iov_len = record_len(seq);
+		}
+		__Tcall_assert(nr, evl_writev_xbuf(&tx, iov, BATCH_SIZE));
+		__Texpr_assert(nr == BATCH_SIZE);
+	}
+
+	/* A record larger than the receive vector stays pending. */
+	iov[0].iov_base = &big;
+	iov[0].iov_len = sizeof(int);
+	__Fcall_assert(nr, evl_readv_xbuf(&tx, iov, 1));
+	__Texpr_assert(nr == -EMSGSIZE);
+	iov[0].iov_len = sizeof(big);
+	__Tcall_assert(nr, evl_readv_xbuf(&tx, iov, 1));
+	__Texpr_assert(nr == 1);
+	__Texpr_assert(iov[0].iov_len == sizeof(big) && big.seq == -1);
+
+	pthread_join(tid, NULL);
+
+	evl_close_framed_xbuf(&tx);
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/clock.h>
+#include <evl/clock-evl.h>
+#include <evl/xbuf.h>
+#include <evl/xbuf-evl.h>
+#include "helpers.h"
+
+#define RING_SIZE	16384
+/* Not a divider of the ring size, so that frames straddle the end. */
+#define FRAME_SIZE	5000
+#define NR_FRAMES	64
+
+static struct evl_mapped_xbuf xm;
+
+static void fill_frame(void *buf, int n)
+{
+	memset(buf, 'A' + n % 26, FRAME_SIZE);
+}
+
+static bool check_frame(const char *buf, int n)
+{
+	int i;
+
+	for (i = 0; i < FRAME_SIZE; i++)
+		if (buf[i] != 'A' + n % 26)
+			return false;
+
+	return true;
+}
+
+static void put_frame(struct evl_xbuf_ring *ring, int n)
+{
+	void *buf;
+	int ret;
+
+	for (;;) {
+		ret = evl_reserve_xbuf(ring, FRAME_SIZE, &buf);
+		if (ret != -EAGAIN)
+			break;
+		if (ring->oob_producer)
+			evl_usleep(1000);
+		else
+			usleep(1000);
+	}
+
+	__Texpr_assert(ret == 0);
+	fill_frame(buf, n);
+	__Tcall_assert(ret, evl_commit_xbuf(ring, FRAME_SIZE));
+}
+
+static void get_frame(struct evl_xbuf_ring *ring, int n)
+{
+	ssize_t ret;
+	void *buf;
+
+	do
+		__Tcall_assert(ret, evl_wait_xbuf(ring, &buf));
+	while (ret < FRAME_SIZE);
+
+	__Texpr_assert(check_frame(buf, n));
+	__Tcall_assert(ret, evl_release_xbuf(ring, FRAME_SIZE));
+}
+
+/* In-band peer, consumes outbound then produces inbound frames. */
+static void *peer(void *arg)
+{
+	int n;
+
+	for (n = 0; n < NR_FRAMES; n++)
+		get_frame(&xm.outbound, n);
+
+	for (n = 0; n < NR_FRAMES; n++)
+		put_frame(&xm.inbound, n);
+
+	return NULL;
+}
+
+/* Only the ring with a non-zero size is usable. */
+static void check_oneway(int nth, size_t i_bufsz, size_t o_bufsz)
+{
+	struct evl_xbuf_ring *used, *unused;
+	struct evl_mapped_xbuf oxm;
+	int xfd, ret;
+	ssize_t len;
+	char *name;
+	void *buf;
+
+	name = get_unique_name(EVL_XBUF_DEV, nth);
+	__Tcall_assert(xfd, evl_create_mapped_xbuf(&oxm, i_bufsz, o_bufsz,
+						EVL_CLONE_PRIVATE, name));
+	used = i_bufsz ? &oxm.inbound : &oxm.outbound;
+	unused = i_bufsz ? &oxm.outbound : &oxm.inbound;
+
+	__Fcall_assert(ret, evl_reserve_xbuf(unused, 1, &buf));
+	__Texpr_assert(ret == -ENXIO);
+	__Texpr_assert(evl_peek_xbuf(unused, &buf) == -ENXIO);
+
+	__Tcall_assert(ret, evl_reserve_xbuf(used, FRAME_SIZE, &buf));
+	fill_frame(buf, nth);
+	__Tcall_assert(ret, evl_commit_xbuf(used, FRAME_SIZE));
+	__Tcall_assert(len, evl_peek_xbuf(used, &buf));
+	__Texpr_assert(len == FRAME_SIZE);
+	__Texpr_assert(check_frame(buf, nth));
+	__Tcall_assert(ret, evl_release_xbuf(used, FRAME_SIZE));
+
+	__Tcall_assert(ret, evl_close_mapped_xbuf(&oxm));
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t tid;
+	void *buf;
+	int tfd, xfd, ret, n;
+	char *name;
+
+	__Tcall_assert(tfd, evl_attach_self("xbuf-mapped:%d", getpid()));
+
+	name = get_unique_name(EVL_XBUF_DEV, 0);
+	__Tcall_assert(xfd, evl_new_mapped_xbuf(&xm, RING_SIZE, name));
+
+	__Fcall_assert(ret, evl_reserve_xbuf(&xm.outbound,
+					RING_SIZE + 1, &buf));
+	__Texpr_assert(ret == -EFBIG);
+	__Texpr_assert(evl_peek_xbuf(&xm.inbound, &buf) == 0);
+	__Fcall_assert(ret, evl_release_xbuf(&xm.inbound, 1));
+	__Texpr_assert(ret == -EINVAL);
+
+	new_thread(&tid, SCHED_OTHER, 0, peer, NULL);
+
+	for (n = 0; n < NR_FRAMES; n++)
+		put_frame(&xm.outbound, n);
+
+	for (n = 0; n < NR_FRAMES; n++)
+		get_frame(&xm.inbound, n);
+
+	pthread_join(tid, NULL);
+
+	__Texpr_assert(evl_peek_xbuf(&xm.outbound, &buf) == 0);
+	__Tcall_assert(ret, evl_close_mapped_xbuf(&xm));
+
+	check_oneway(1, 0, RING_SIZE);
+	check_oneway(2, RING_SIZE, 0);
+
+	/* Other processes could not reach the rings. */
+	name = get_unique_name(EVL_XBUF_DEV, 3);
+	__Fcall_assert(ret, evl_create_mapped_xbuf(&xm, RING_SIZE, RING_SIZE,
+						EVL_CLONE_PUBLIC, name));
+	__Texpr_assert(ret == -EINVAL);
+
+	return 0;
+}
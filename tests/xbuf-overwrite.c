@@ -0,0 +1,115 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <evl/thread.h>
+#include <evl/thread-evl.h>
+#include <evl/xbuf.h>
+#include <evl/xbuf-evl.h>
+#include "helpers.h"
+
+#define RECSZ		16
+#define NR_RECORDS	300
+
+struct record {
+	int seq;
+	char payload[RECSZ - sizeof(int)];
+};
+
+static struct evl_mapped_xbuf xm;
+
+static int put_record(struct evl_xbuf_ring *ring, int seq)
+{
+	struct record *rec;
+	int ret;
+
+	ret = evl_reserve_xbuf(ring, sizeof(*rec), (void **)&rec);
+	if (ret)
+		return ret;
+
+	rec->seq = seq;
+
+	return evl_commit_xbuf(ring, sizeof(*rec));
+}
+
+int main(int argc, char *argv[])
+{
+	size_t ringsz, nr_kept, nr_stored;
+	struct evl_xbuf_stats stats;
+	struct record *recs, *rec;
+	int tfd, xfd, ret, n;
+	char *name;
+	ssize_t count;
+
+	__Tcall_assert(tfd, evl_attach_self("xbuf-overwrite:%d", getpid()));
+
+	name = get_unique_name(EVL_XBUF_DEV, 0);
+	__Tcall_assert(xfd, evl_new_mapped_xbuf(&xm, RECSZ, name));
+
+	ringsz = xm.outbound.size;
+	nr_kept = ringsz / RECSZ;
+	recs = malloc(ringsz * 2);
+	__Texpr_assert(recs != NULL);
+
+	/* Overwriting the oldest records on the outbound ring. */
+	__Tcall_assert(ret, evl_set_xbuf_policy(&xm.outbound,
+					EVL_XBUF_OVERWRITE, RECSZ));
+	for (n = 0; n < NR_RECORDS; n++)
+		__Tcall_assert(ret, put_record(&xm.outbound, n));
+
+	__Tcall_assert(ret, evl_get_xbuf_stats(&xm.outbound, &stats));
+	__Texpr_assert(stats.size == ringsz);
+	__Texpr_assert(stats.pending == ringsz);
+	__Texpr_assert(stats.high_water == ringsz);
+	__Texpr_assert(stats.would_block == NR_RECORDS - nr_kept);
+	__Texpr_assert(stats.dropped == (NR_RECORDS - nr_kept) * RECSZ);
+
+	/* Releasing overwritten data must fail. */
+	__Texpr_assert(evl_peek_xbuf(&xm.outbound, (void **)&rec) ==
+		(ssize_t)ringsz);
+	__Tcall_assert(ret, put_record(&xm.outbound, NR_RECORDS));
+	__Fcall_assert(ret, evl_release_xbuf(&xm.outbound, RECSZ));
+	__Texpr_assert(ret == -ESTALE);
+
+	/* Draining picks whole records, starting from the oldest one. */
+	__Tcall_assert(count, evl_drain_xbuf(&xm.outbound, recs,
+					ringsz + RECSZ / 2));
+	__Texpr_assert(count == (ssize_t)ringsz);
+	for (n = 0; n < (int)nr_kept; n++)
+		__Texpr_assert(recs[n].seq ==
+			(int)(NR_RECORDS + 1 - nr_kept + n));
+	__Texpr_assert(evl_drain_xbuf(&xm.outbound, recs, ringsz) == 0);
+
+	/* The inbound ring rejects reservations when full. */
+	for (n = 0; ; n++) {
+		ret = put_record(&xm.inbound, n);
+		if (ret)
+			break;
+	}
+	__Texpr_assert(ret == -EAGAIN);
+	nr_stored = n;
+	__Tcall_assert(ret, evl_get_xbuf_stats(&xm.inbound, &stats));
+	__Texpr_assert(stats.would_block == 1 && stats.dropped == 0);
+	__Texpr_assert(stats.pending == nr_stored * RECSZ);
+
+	__Tcall_assert(count, evl_drain_xbuf(&xm.inbound, recs, ringsz * 2));
+	__Texpr_assert(count == (ssize_t)(nr_stored * RECSZ));
+	__Texpr_assert(recs[0].seq == 0);
+	__Tcall_assert(ret, evl_get_xbuf_stats(&xm.inbound, &stats));
+	__Texpr_assert(stats.pending == 0);
+	__Texpr_assert(stats.high_water == nr_stored * RECSZ);
+
+	__Fcall_assert(ret, evl_set_xbuf_policy(&xm.inbound,
+					EVL_XBUF_OVERWRITE, 0));
+	__Texpr_assert(ret == -EINVAL);
+
+	free(recs);
+	evl_close_mapped_xbuf(&xm);
+
+	return 0;
+}